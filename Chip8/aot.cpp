@@ -0,0 +1,373 @@
+/**	@file aot.cpp
+@note Developed for C++17/vc14.1
+@brief Static recompiler: translates a ROM into a C++ translation unit with one label per
+	   reachable address, plus the runtime support the generated code calls into
+*/
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include "aot.hpp"
+#include "engine.hpp"
+
+static const char * const handlerNames[INSTR_COUNT] = {
+#define INSTR_HANDLER(name, handler) #handler,
+	FOR_EACH_INSTR(INSTR_HANDLER)
+#undef INSTR_HANDLER
+};
+
+typedef struct Translation
+{
+	uint8_t rom_[ROMSIZE];
+	uint32_t size_;
+	bool reachable_[MEMSIZE];
+} Translation;
+
+/**
+@name:		isTranslatable
+@purpose:	True if both bytes of the opcode at an address come from the ROM image
+@param:		const Translation *, uint32_t
+@return:	bool
+*/
+static bool isTranslatable(const Translation * t, uint32_t addr)
+{
+	return addr >= ROM_START && addr + 1 < ROM_START + t->size_;
+}
+
+/**
+@name:		opAt
+@purpose:	Decodes the ROM opcode at an address
+@param:		const Translation *, uint32_t
+@return:	uint16_t
+*/
+static uint16_t opAt(const Translation * t, uint32_t addr)
+{
+	return (t->rom_[addr - ROM_START] << 8) | t->rom_[addr + 1 - ROM_START];
+}
+
+/**
+@name:		isSkip
+@purpose:	True for instructions that continue at PC + 2 or PC + 4
+@param:		uint8_t
+@return:	bool
+*/
+static bool isSkip(uint8_t instr)
+{
+	switch (instr)
+	{
+		case INSTR_VX_SKIP_EQUAL_ADDR:
+		case INSTR_VX_SKIP_NEQUAL_ADDR:
+		case INSTR_VX_NOT_VY:
+		case INSTR_CHECK_VX_IS_VY:
+		case INSTR_SKIP_IF_KEY_PRESSED:
+		case INSTR_SKIP_IF_KEY_NT_PRESSED:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+@name:		markReachable
+@purpose:	Walks every statically known path from the entry point. Computed jumps and returns
+			are left to the dispatcher, but the address after a call is assumed to be returned to.
+@param:		Translation *
+@return:	void
+*/
+static void markReachable(Translation * t)
+{
+	static uint16_t work[MEMSIZE];
+	size_t pending = 0;
+
+	if (isTranslatable(t, ROM_START))
+	{
+		t->reachable_[ROM_START] = true;
+		work[pending++] = ROM_START;
+	}
+
+	while (pending > 0)
+	{
+		uint32_t addr = work[--pending];
+		DecodedOp op = decodeOp(opAt(t, addr));
+		uint32_t next[2];
+		int numNext = 0;
+
+		switch (op.instr_)
+		{
+			case INSTR_TRAP:
+			case INSTR_CLEAR_SCREEN:
+			case INSTR_RETURN:
+			case INSTR_JUMP_TO_ADDR_PLUS_V0:
+				break;
+			case INSTR_GOTO_ADDR:
+				next[numNext++] = op.nnn_;
+				break;
+			case INSTR_CALL_SUB:
+				next[numNext++] = op.nnn_;
+				next[numNext++] = addr + 2;
+				break;
+			default:
+				next[numNext++] = addr + 2;
+				if (isSkip(op.instr_))
+					next[numNext++] = addr + 4;
+				break;
+		}
+
+		for (int i = 0; i < numNext; ++i)
+		{
+			if (isTranslatable(t, next[i]) && !t->reachable_[next[i]])
+			{
+				t->reachable_[next[i]] = true;
+				work[pending++] = static_cast<uint16_t>(next[i]);
+			}
+		}
+	}
+}
+
+/**
+@name:		emitGoto
+@purpose:	Writes a jump to a translated address, or to the dispatcher if there is no label for it
+@param:		FILE *, const Translation *, uint32_t
+@return:	void
+*/
+static void emitGoto(FILE * out, const Translation * t, uint32_t addr)
+{
+	if (isTranslatable(t, addr) && t->reachable_[addr])
+		fprintf(out, "goto L_%03X;\n", addr);
+	else
+		fprintf(out, "goto dispatch;\n");
+}
+
+/**
+@name:		emitInstr
+@purpose:	Writes the label, cycle accounting, operation and control flow for one address
+@param:		FILE *, const Translation *, uint32_t
+@return:	void
+*/
+static void emitInstr(FILE * out, const Translation * t, uint32_t addr)
+{
+	uint16_t opCode = opAt(t, addr);
+	DecodedOp op = decodeOp(opCode);
+
+	fprintf(out, "L_%03X:\t// %04X %s\n", addr, opCode, instrName(op.instr_));
+	fprintf(out, "\tAOT_STEP(0x%016" PRIX64 "ULL)\n", aotPageBits(addr));
+	fprintf(out, "\t{\n");
+	fprintf(out, "\t\tstatic const DecodedOp op = { 0x%03X, INSTR_%s, %u, %u, 0x%02X };\n",
+		op.nnn_, instrName(op.instr_), op.x_, op.y_, op.nn_);
+
+	// memory writes may rewrite translated code, so re-check the pages they touched
+	if (op.instr_ == INSTR_STORE_BINARY_DEC_VX || op.instr_ == INSTR_STORE_V0_TO_VX_AT_IDX)
+	{
+		fprintf(out, "\t\tuint16_t first = chip->regIndex_;\n");
+		fprintf(out, "\t\t%s(chip, &op);\n", handlerNames[op.instr_]);
+		fprintf(out, "\t\tstale = aotUpdateStale(chip, &aotProgram, stale, first, first + %u);\n",
+			op.instr_ == INSTR_STORE_BINARY_DEC_VX ? 2u : op.x_);
+	}
+	else
+		fprintf(out, "\t\t%s(chip, &op);\n", handlerNames[op.instr_]);
+
+	fprintf(out, "\t}\n");
+
+	switch (op.instr_)
+	{
+		case INSTR_TRAP:
+		case INSTR_RETURN:
+		case INSTR_JUMP_TO_ADDR_PLUS_V0:
+			fprintf(out, "\tgoto dispatch;\n");
+			return;
+		case INSTR_CLEAR_SCREEN:
+			fprintf(out, "\t");
+			emitGoto(out, t, addr);
+			return;
+		case INSTR_GOTO_ADDR:
+		case INSTR_CALL_SUB:
+			fprintf(out, "\t");
+			emitGoto(out, t, op.nnn_);
+			return;
+		case INSTR_WAIT_FOR_KEY_PRESS_VX:
+			fprintf(out, "\tif (chip->progCounter_ == 0x%03X)\n\t\t", addr);
+			emitGoto(out, t, addr);
+			break;
+		default:
+			if (isSkip(op.instr_))
+			{
+				fprintf(out, "\tif (chip->progCounter_ == 0x%03X)\n\t\t", addr + 4);
+				emitGoto(out, t, addr + 4);
+			}
+			break;
+	}
+
+	// fall through when the next label is the next instruction
+	uint32_t nextLabel = addr + 1;
+	while (nextLabel < MEMSIZE && !t->reachable_[nextLabel])
+		++nextLabel;
+
+	if (nextLabel != addr + 2)
+	{
+		fprintf(out, "\t");
+		emitGoto(out, t, addr + 2);
+	}
+}
+
+/**
+@name:		translateRom
+@purpose:	Writes a C++ source file containing runAot for one ROM. Compile it in place of
+			the stub in this file by defining CHIP8_AOT. Returns the process exit code.
+@param:		const char *, const char *
+@return:	int
+*/
+int translateRom(const char * path, const char * outPath)
+{
+	static Translation t;
+	memset(&t, 0, sizeof(t));
+
+	FILE * file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open file %s\n", path);
+		return 1;
+	}
+
+	t.size_ = static_cast<uint32_t>(fread(t.rom_, sizeof(uint8_t), ROMSIZE, file));
+	bool tooBig = fgetc(file) != EOF;
+	fclose(file);
+
+	if (tooBig)
+	{
+		fprintf(stderr, "The file \"%s\" exceeded the maximum ROM size, which is %d bytes.\n", path, ROMSIZE);
+		return 1;
+	}
+
+	markReachable(&t);
+
+	FILE * out = fopen(outPath, "w");
+	if (out == NULL)
+	{
+		fprintf(stderr, "Could not create file %s\n", outPath);
+		return 1;
+	}
+
+	const char * name = path;
+	for (const char * c = path; *c != '\0'; ++c)
+	{
+		if (*c == '/' || *c == '\\')
+			name = c + 1;
+	}
+
+	fprintf(out, "// Generated by \"chip8 <rom> --translate <out.cpp>\" from %s. Do not edit.\n", name);
+	fprintf(out, "// Build with the emulator sources and CHIP8_AOT defined, then run with --engine aot.\n\n");
+	fprintf(out, "#include \"aot.hpp\"\n\n");
+
+	fprintf(out, "static const uint8_t aotRom[%u] = {", t.size_ > 0 ? t.size_ : 1);
+	for (uint32_t i = 0; i < t.size_; ++i)
+		fprintf(out, "%s0x%02X,", (i % 16 == 0) ? "\n\t" : " ", t.rom_[i]);
+	fprintf(out, "\n};\n\n");
+	fprintf(out, "static const AotProgram aotProgram = { \"");
+	for (const char * c = name; *c != '\0'; ++c)
+		fprintf(out, (*c == '"' || *c == '\\') ? "\\%c" : "%c", *c);
+	fprintf(out, "\", aotRom, %u };\n\n", t.size_);
+
+	fprintf(out, "uint64_t runAot(Chip8 * chip, uint64_t cycles)\n{\n");
+	fprintf(out, "\tif (chip->printInst_ || chip->dumpRegs_)\n\t\treturn runCycles(chip, cycles);\n\n");
+	fprintf(out, "\tuint64_t done = 0;\n");
+	fprintf(out, "\tuint64_t stale = aotUpdateStale(chip, &aotProgram, 0, 0, ADDR_MASK);\n\n");
+	fprintf(out, "dispatch:\n");
+	fprintf(out, "\twhile (done < cycles && !chip->halted_)\n\t{\n");
+	fprintf(out, "\t\tif ((stale & aotPageBits(chip->progCounter_)) == 0)\n\t\t{\n");
+	fprintf(out, "\t\t\tswitch (chip->progCounter_)\n\t\t\t{\n");
+
+	uint32_t labels = 0;
+	for (uint32_t addr = ROM_START; addr < MEMSIZE; ++addr)
+	{
+		if (t.reachable_[addr])
+		{
+			fprintf(out, "\t\t\t\tcase 0x%03X: goto L_%03X;\n", addr, addr);
+			++labels;
+		}
+	}
+
+	fprintf(out, "\t\t\t\tdefault: break;\n");
+	fprintf(out, "\t\t\t}\n\t\t}\n\n");
+	fprintf(out, "\t\t// computed jumps, returns into untranslated code, and rewritten code\n");
+	fprintf(out, "\t\taotInterpret(chip, &aotProgram, &stale);\n");
+	fprintf(out, "\t\t++done;\n");
+	fprintf(out, "\t}\n\n\treturn done;\n\n");
+
+	for (uint32_t addr = ROM_START; addr < MEMSIZE; ++addr)
+	{
+		if (t.reachable_[addr])
+			emitInstr(out, &t, addr);
+	}
+
+	fprintf(out, "}\n");
+	fclose(out);
+
+	printf("Translated %s to %s: %u reachable addresses in a %u byte ROM\n", path, outPath, labels, t.size_);
+	return 0;
+}
+
+/**
+@name:		aotUpdateStale
+@purpose:	Re-checks the code pages overlapping [first, last] against the translated ROM and
+			returns the stale bits with those pages updated. A page is stale while any of its
+			ROM bytes differ from what was translated.
+@param:		const Chip8 *, const AotProgram *, uint64_t, uint32_t, uint32_t
+@return:	uint64_t
+*/
+uint64_t aotUpdateStale(const Chip8 * chip, const AotProgram * program, uint64_t stale, uint32_t first, uint32_t last)
+{
+	// writes past 0xFFF wrap around to the start of memory
+	if (last > ADDR_MASK)
+	{
+		first = 0;
+		last = ADDR_MASK;
+	}
+
+	for (uint32_t page = first / CODE_PAGE_SIZE; page <= last / CODE_PAGE_SIZE; ++page)
+	{
+		uint32_t begin = page * CODE_PAGE_SIZE;
+		uint32_t end = begin + CODE_PAGE_SIZE;
+		if (begin < ROM_START)
+			begin = ROM_START;
+		if (end > ROM_START + (uint32_t)program->size_)
+			end = ROM_START + program->size_;
+
+		stale &= ~(1ULL << page);
+		if (begin < end && memcmp(memAt(chip, begin), program->rom_ + (begin - ROM_START), end - begin) != 0)
+			stale |= 1ULL << page;
+	}
+
+	return stale;
+}
+
+/**
+@name:		aotInterpret
+@purpose:	Runs one opcode through executeCode for the generated dispatcher, keeping its stale
+			pages current if the opcode writes memory
+@param:		Chip8 *, const AotProgram *, uint64_t *
+@return:	void
+*/
+void aotInterpret(Chip8 * chip, const AotProgram * program, uint64_t * stale)
+{
+	uint8_t instr = decodeOp(fetchOpCode(chip)).instr_;
+	uint16_t first = chip->regIndex_;
+
+	executeCode(chip);
+
+	if (instr == INSTR_STORE_BINARY_DEC_VX || instr == INSTR_STORE_V0_TO_VX_AT_IDX)
+		*stale = aotUpdateStale(chip, program, *stale, first, first + VREGSIZE - 1u);
+}
+
+#ifndef CHIP8_AOT
+/**
+@name:		runAot
+@purpose:	Stand-in used when no translated ROM is linked in: the aot engine is then the switch
+			interpreter. Build a file from --translate with CHIP8_AOT defined to replace it.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t runAot(Chip8 * chip, uint64_t cycles)
+{
+	return runCycles(chip, cycles);
+}
+#endif
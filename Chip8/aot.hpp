@@ -0,0 +1,48 @@
+/**	@file aot.hpp
+@note Developed for C++17/vc14.1
+@brief Ahead-of-time translation of a ROM into C++, and the runtime support the generated code uses
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+#include "opcodes.hpp"
+
+// A ROM baked into a generated translation unit
+typedef struct AotProgram
+{
+	const char * name_;
+	const uint8_t * rom_;		// the image the code was translated from, loaded at 0x200
+	uint16_t size_;
+} AotProgram;
+
+/**
+@name:		AOT_STEP
+@purpose:	Starts one translated instruction in a generated runAot: leaves for the dispatcher
+			when the budget is spent or the instruction's memory no longer holds the translated
+			bytes, otherwise counts the cycle exactly as executeCode does. Uses the generated
+			function's chip, cycles, done and stale locals.
+@param:		uint64_t - aotPageBits of the instruction's address
+*/
+#define AOT_STEP(pages) \
+	if (done >= cycles || (stale & (pages)) != 0) \
+		goto dispatch; \
+	++done; \
+	if (++chip->cycles_ >= chip->nextFrameCycle_) \
+		tickFrame(chip);
+
+/**
+@name:		aotPageBits
+@purpose:	Returns the code page bits covered by the opcode at an address
+@param:		uint32_t
+@return:	uint64_t
+*/
+inline uint64_t aotPageBits(uint32_t addr)
+{
+	return (1ULL << ((addr & ADDR_MASK) / CODE_PAGE_SIZE)) | (1ULL << (((addr + 1) & ADDR_MASK) / CODE_PAGE_SIZE));
+}
+
+int translateRom(const char * path, const char * outPath);
+uint64_t aotUpdateStale(const Chip8 * chip, const AotProgram * program, uint64_t stale, uint32_t first, uint32_t last);
+void aotInterpret(Chip8 * chip, const AotProgram * program, uint64_t * stale);
+uint64_t runAot(Chip8 * chip, uint64_t cycles);
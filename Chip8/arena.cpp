@@ -0,0 +1,178 @@
+/**	@file arena.cpp
+@note Developed for C++17/vc14.1
+@brief Chip8 arena: one contiguous mapping holding many instances back to back,
+	   optionally on huge pages, with a free list for reuse
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include "arena.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Chip8 is cache-line aligned, so its size already is a multiple of the line and slots stay aligned
+static_assert(sizeof(Chip8) % CACHE_LINE_SIZE == 0, "Chip8 slots would straddle cache lines");
+
+/**
+@name:		mapArena
+@purpose:	Maps zeroed memory for an arena, trying explicit huge pages first if asked, then
+			a normal mapping with a transparent huge page hint. Returns NULL on failure.
+@param:		size_t, bool, ArenaPages *
+@return:	uint8_t *
+*/
+static uint8_t * mapArena(size_t bytes, bool hugePages, ArenaPages * pages)
+{
+	*pages = ARENA_PAGES_NORMAL;
+
+#ifdef _WIN32
+	if (hugePages)
+	{
+		// needs SeLockMemoryPrivilege; without it this fails and normal pages are used
+		SIZE_T large = GetLargePageMinimum();
+		if (large != 0)
+		{
+			void * mem = VirtualAlloc(NULL, (bytes + large - 1) / large * large, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (mem != NULL)
+			{
+				*pages = ARENA_PAGES_HUGE;
+				return static_cast<uint8_t *>(mem);
+			}
+		}
+	}
+	return static_cast<uint8_t *>(VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+#ifdef MAP_HUGETLB
+	if (hugePages)
+	{
+		// needs pages reserved in /proc/sys/vm/nr_hugepages
+		void * mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED)
+		{
+			*pages = ARENA_PAGES_HUGE;
+			return static_cast<uint8_t *>(mem);
+		}
+	}
+#endif
+
+	void * mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	if (hugePages && madvise(mem, bytes, MADV_HUGEPAGE) == 0)
+		*pages = ARENA_PAGES_TRANSPARENT;
+#endif
+	return static_cast<uint8_t *>(mem);
+#endif
+}
+
+/**
+@name:		initChipArena
+@purpose:	Maps room for capacity instances in one block. With hugePages the block is rounded
+			up to whole huge pages, so the last instances are not left on normal pages; the
+			slots that adds are usable too. Returns false and prints why on failure.
+@param:		ChipArena *, uint32_t, bool
+@return:	bool
+*/
+bool initChipArena(ChipArena * arena, uint32_t capacity, bool hugePages)
+{
+	size_t granule = hugePages ? ARENA_HUGE_PAGE_SIZE : ARENA_PAGE_SIZE;
+	size_t bytes = (size_t)capacity * sizeof(Chip8);
+	bytes = (bytes + granule - 1) / granule * granule;
+
+	arena->base_ = mapArena(bytes, hugePages, &arena->pages_);
+	if (arena->base_ == NULL)
+	{
+		fprintf(stderr, "Could not map %zu bytes for %u instances\n", bytes, capacity);
+		return false;
+	}
+
+	arena->bytes_ = bytes;
+	arena->capacity_ = (uint32_t)(bytes / sizeof(Chip8));
+	arena->used_ = arena->live_ = 0;
+	arena->free_ = NULL;
+	return true;
+}
+
+/**
+@name:		allocChip
+@purpose:	Returns a zeroed instance: a freed one if any, else the next untouched slot.
+			Returns NULL when the arena is full.
+@param:		ChipArena *
+@return:	Chip8 *
+*/
+Chip8 * allocChip(ChipArena * arena)
+{
+	Chip8 * chip = arena->free_;
+	if (chip != NULL)
+	{
+		memcpy(&arena->free_, chip, sizeof(Chip8 *));
+		memset(chip, 0, sizeof(Chip8));
+	}
+	else if (arena->used_ < arena->capacity_)
+	{
+		// fresh mappings are already zero
+		chip = reinterpret_cast<Chip8 *>(arena->base_ + (size_t)arena->used_++ * sizeof(Chip8));
+	}
+	else
+		return NULL;
+
+	++arena->live_;
+	return chip;
+}
+
+/**
+@name:		freeChip
+@purpose:	Returns an instance to the arena. Its engine caches and own pages must be
+			released first.
+@param:		ChipArena *, Chip8 *
+@return:	void
+*/
+void freeChip(ChipArena * arena, Chip8 * chip)
+{
+	memcpy(chip, &arena->free_, sizeof(Chip8 *));
+	arena->free_ = chip;
+	--arena->live_;
+}
+
+/**
+@name:		releaseChipArena
+@purpose:	Unmaps the arena and every instance in it
+@param:		ChipArena *
+@return:	void
+*/
+void releaseChipArena(ChipArena * arena)
+{
+	if (arena->base_ == NULL)
+		return;
+
+#ifdef _WIN32
+	VirtualFree(arena->base_, 0, MEM_RELEASE);
+#else
+	munmap(arena->base_, arena->bytes_);
+#endif
+	arena->base_ = NULL;
+}
+
+/**
+@name:		arenaPagesName
+@purpose:	Returns a printable name for what backs an arena
+@param:		ArenaPages
+@return:	const char *
+*/
+const char * arenaPagesName(ArenaPages pages)
+{
+	switch (pages)
+	{
+	case ARENA_PAGES_TRANSPARENT:
+		return "transparent huge pages";
+	case ARENA_PAGES_HUGE:
+		return "huge pages";
+	default:
+		return "normal pages";
+	}
+}
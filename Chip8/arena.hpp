@@ -0,0 +1,37 @@
+/**	@file arena.hpp
+@note Developed for C++17/vc14.1
+@brief Chip8 arena: one contiguous mapping holding many instances back to back,
+	   optionally on huge pages, with a free list for reuse
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "chip8.hpp"
+
+#define ARENA_PAGE_SIZE 4096
+#define ARENA_HUGE_PAGE_SIZE (2u << 20)		// x86-64 2MB pages
+
+enum ArenaPages : uint8_t
+{
+	ARENA_PAGES_NORMAL,
+	ARENA_PAGES_TRANSPARENT,	// normal mapping the kernel was asked to back with huge pages
+	ARENA_PAGES_HUGE			// explicit huge pages (MAP_HUGETLB, MEM_LARGE_PAGES)
+};
+
+typedef struct ChipArena
+{
+	uint8_t * base_;
+	size_t bytes_;
+	uint32_t capacity_;
+	uint32_t used_;			// slots handed out at least once; the rest are untouched
+	uint32_t live_;
+	Chip8 * free_;			// freed slots, linked through their first bytes
+	ArenaPages pages_;
+} ChipArena;
+
+bool initChipArena(ChipArena * arena, uint32_t capacity, bool hugePages);
+Chip8 * allocChip(ChipArena * arena);
+void freeChip(ChipArena * arena, Chip8 * chip);
+void releaseChipArena(ChipArena * arena);
+const char * arenaPagesName(ArenaPages pages);
@@ -0,0 +1,219 @@
+/**	@file bench.cpp
+@note Developed for C++17/vc14.1
+@brief Runs each execution engine over the same ROM and reports time and, where
+	   the OS allows it, hardware branch-miss counts
+*/
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include "bench.hpp"
+#include "blockcache.hpp"
+#include "engine.hpp"
+#include "jit.hpp"
+#include "opcodes.hpp"
+#include "snapshot.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_SEED 1
+#define BENCH_SNAPSHOTS 100000
+
+typedef struct BenchEngine
+{
+	const char * name_;
+	EngineFunc run_;
+} BenchEngine;
+
+static BenchEngine engines[ENGINE_COUNT];
+
+/**
+@name:		openBranchMissCounter
+@purpose:	Opens a hardware counter for mispredicted branches in this thread. Returns -1 where unsupported.
+@param:		void
+@return:	int
+*/
+static int openBranchMissCounter()
+{
+#ifdef __linux__
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+/**
+@name:		startCounter
+@purpose:	Resets and enables a counter from openBranchMissCounter
+@param:		int
+@return:	void
+*/
+static void startCounter(int fd)
+{
+#ifdef __linux__
+	if (fd < 0)
+		return;
+
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+/**
+@name:		stopCounter
+@purpose:	Disables a counter and returns its value
+@param:		int
+@return:	uint64_t
+*/
+static uint64_t stopCounter(int fd)
+{
+	uint64_t count = 0;
+#ifdef __linux__
+	if (fd < 0)
+		return 0;
+
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
+		count = 0;
+#endif
+	return count;
+}
+
+/**
+@name:		samePages
+@purpose:	Compares two chips' memory page by page, skipping pages they share
+@param:		const Chip8 *, const Chip8 *
+@return:	bool
+*/
+static bool samePages(const Chip8 * a, const Chip8 * b)
+{
+	for (int page = 0; page < MEM_PAGES; ++page)
+		if (a->memPages_[page] != b->memPages_[page] && memcmp(a->memPages_[page], b->memPages_[page], MEM_PAGE_SIZE) != 0)
+			return false;
+	return true;
+}
+
+/**
+@name:		sameState
+@purpose:	Compares the architectural state of two chips
+@param:		const Chip8 *, const Chip8 *
+@return:	bool
+*/
+static bool sameState(const Chip8 * a, const Chip8 * b)
+{
+	return a->progCounter_ == b->progCounter_ && a->regIndex_ == b->regIndex_
+		&& a->stackPointer_ == b->stackPointer_ && a->cycles_ == b->cycles_
+		&& memcmp(a->vReg_, b->vReg_, sizeof(a->vReg_)) == 0
+		&& memcmp(a->stack_, b->stack_, sizeof(a->stack_)) == 0
+		&& samePages(a, b)
+		&& memcmp(a->gBuffer_, b->gBuffer_, sizeof(a->gBuffer_)) == 0;
+}
+
+/**
+@name:		runBenchmark
+@purpose:	Runs every engine for the same number of cycles from the same start state, prints
+			time, instructions/second and branch misses for each, and checks they all end in
+			the same state. Each engine starts from a snapshot of the loaded ROM; the time to
+			take and restore a snapshot of the end state is reported last. Returns the process
+			exit code.
+@param:		const char *, uint64_t, uint32_t, bool
+@return:	int
+*/
+int runBenchmark(const char * path, uint64_t cycles, uint32_t clockHz, bool clipSprites)
+{
+	static Chip8 start;
+	static Chip8 reference;
+	static Chip8 chip;
+	static ChipSnapshot snap;
+	const size_t numEngines = sizeof(engines) / sizeof(engines[0]);
+
+	for (int i = 0; i < ENGINE_COUNT; ++i)
+	{
+		engines[i].name_ = engineName(static_cast<Engine>(i));
+		engines[i].run_ = engineFunc(static_cast<Engine>(i));
+	}
+
+	initChip(&start);
+	seedRandom(&start, BENCH_SEED);
+	setClockRate(&start, clockHz);
+	start.clipSprites_ = clipSprites;
+	loadGame(&start, path);
+	takeSnapshot(&start, &snap);
+	initChip(&chip);
+
+	int counter = openBranchMissCounter();
+	int result = 0;
+
+	printf("ROM: %s, %" PRIu64 " cycles\n", path, cycles);
+	printf("%-10s %12s %16s %16s %14s\n", "engine", "time (s)", "instr/second", "branch misses", "misses/instr");
+
+	for (size_t i = 0; i < numEngines; ++i)
+	{
+		releaseBlockCache(&chip);
+		releaseJit(&chip);
+		restoreSnapshot(&chip, &snap);
+
+		auto begin = std::chrono::steady_clock::now();
+		startCounter(counter);
+		uint64_t done = engines[i].run_(&chip, cycles);
+		uint64_t misses = stopCounter(counter);
+		auto end = std::chrono::steady_clock::now();
+
+		double secs = std::chrono::duration<double>(end - begin).count();
+		double ips = secs > 0.0 ? done / secs : 0.0;
+
+		if (counter >= 0)
+			printf("%-10s %12.6f %16.0f %16" PRIu64 " %14.4f\n", engines[i].name_, secs, ips, misses, done ? (double)misses / done : 0.0);
+		else
+			printf("%-10s %12.6f %16.0f %16s %14s\n", engines[i].name_, secs, ips, "n/a", "n/a");
+
+		if (i == 0)
+			copyChip(&reference, &chip);
+		else if (!sameState(&reference, &chip))
+		{
+			fprintf(stderr, "Engine \"%s\" finished in a different state from \"%s\".\n", engines[i].name_, engines[0].name_);
+			result = 1;
+		}
+	}
+
+	// put the end state back over a chip that has run on past it, as a rollback would
+	runCycles(&chip, clockHz);
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_SNAPSHOTS; ++i)
+	{
+		takeSnapshot(&reference, &snap);
+		restoreSnapshot(&chip, &snap);
+	}
+	double snapSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	printf("\nSnapshot and restore: %.0f ns\n", snapSecs * 1e9 / BENCH_SNAPSHOTS);
+	if (!sameState(&reference, &chip))
+	{
+		fprintf(stderr, "Restoring a snapshot did not give back the state it was taken from.\n");
+		result = 1;
+	}
+
+	releaseBlockCache(&chip);
+	releaseJit(&chip);
+	releaseMemPages(&chip);
+	releaseMemPages(&reference);
+
+#ifdef __linux__
+	if (counter >= 0)
+		close(counter);
+#endif
+
+	return result;
+}
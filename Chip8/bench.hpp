@@ -0,0 +1,10 @@
+/**	@file bench.hpp
+@note Developed for C++17/vc14.1
+@brief Function declarations for comparing execution engines on the same ROM
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+
+int runBenchmark(const char * path, uint64_t cycles, uint32_t clockHz, bool clipSprites);
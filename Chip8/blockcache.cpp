@@ -0,0 +1,285 @@
+/**	@file blockcache.cpp
+@note Developed for C++17/vc14.1
+@brief Basic-block engine: runs tight loops from their decoded form, with no
+	   fetch or decode, and drops blocks whose memory FX33/FX55 wrote to
+*/
+
+#include <cinttypes>
+#include <cstring>
+#include "blockcache.hpp"
+#include "engine.hpp"
+#include "jit.hpp"
+
+/**
+@name:		endsBlock
+@purpose:	True for instructions that can leave the PC anywhere but +2, or that write memory
+@param:		uint8_t
+@return:	bool
+*/
+static bool endsBlock(uint8_t instr)
+{
+	switch (instr)
+	{
+		case INSTR_TRAP:
+		case INSTR_CLEAR_SCREEN:		// does not advance the PC
+		case INSTR_RETURN:
+		case INSTR_GOTO_ADDR:
+		case INSTR_CALL_SUB:
+		case INSTR_VX_SKIP_EQUAL_ADDR:
+		case INSTR_VX_SKIP_NEQUAL_ADDR:
+		case INSTR_VX_NOT_VY:
+		case INSTR_CHECK_VX_IS_VY:
+		case INSTR_JUMP_TO_ADDR_PLUS_V0:
+		case INSTR_SKIP_IF_KEY_PRESSED:
+		case INSTR_SKIP_IF_KEY_NT_PRESSED:
+		case INSTR_WAIT_FOR_KEY_PRESS_VX:
+		case INSTR_STORE_BINARY_DEC_VX:	// may rewrite the code that follows
+		case INSTR_STORE_V0_TO_VX_AT_IDX:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+@name:		acquireBlockCache
+@purpose:	Returns the chip's block cache, allocating it on first use. A cache left over from a
+			copied chip belongs to the original, so the copy gets its own. Returns NULL if out of memory.
+@param:		Chip8 *
+@return:	BlockCache *
+*/
+BlockCache * acquireBlockCache(Chip8 * chip)
+{
+	if (chip->blockCache_ != NULL && chip->blockCache_->owner_ == chip)
+		return chip->blockCache_;
+
+	BlockCache * cache = static_cast<BlockCache *>(malloc(sizeof(BlockCache)));
+	if (cache == NULL)
+		return NULL;
+
+	cache->owner_ = chip;
+	flushBlockCache(cache);
+	cache->blocksBuilt_ = cache->blocksInvalidated_ = cache->flushes_ = 0;
+	memset(cache->fusionSites_, 0, sizeof(cache->fusionSites_));
+	memset(cache->fusionRuns_, 0, sizeof(cache->fusionRuns_));
+
+	chip->blockCache_ = cache;
+	return cache;
+}
+
+/**
+@name:		releaseBlockCache
+@purpose:	Frees the chip's block cache, if it owns one
+@param:		Chip8 *
+@return:	void
+*/
+void releaseBlockCache(Chip8 * chip)
+{
+	if (chip->blockCache_ != NULL && chip->blockCache_->owner_ == chip)
+		free(chip->blockCache_);
+
+	chip->blockCache_ = NULL;
+}
+
+/**
+@name:		flushBlockCache
+@purpose:	Drops every cached block
+@param:		BlockCache *
+@return:	void
+*/
+void flushBlockCache(BlockCache * cache)
+{
+	for (int i = 0; i < MEMSIZE; ++i)
+		cache->blockAt_[i] = NO_BLOCK;
+
+	cache->numBlocks_ = 0;
+	++cache->flushes_;
+}
+
+/**
+@name:		invalidateBlocks
+@purpose:	Drops every block decoded from one of the dirty pages
+@param:		BlockCache *, uint64_t
+@return:	void
+*/
+static void invalidateBlocks(BlockCache * cache, uint64_t dirtyPages)
+{
+	if (dirtyPages == ALL_PAGES_DIRTY)
+	{
+		flushBlockCache(cache);
+		return;
+	}
+
+	for (uint16_t i = 0; i < cache->numBlocks_; ++i)
+	{
+		Block * block = &cache->blocks_[i];
+		if ((block->pages_ & dirtyPages) != 0 && cache->blockAt_[block->startPc_] == i)
+		{
+			cache->blockAt_[block->startPc_] = NO_BLOCK;
+			++cache->blocksInvalidated_;
+		}
+	}
+}
+
+/**
+@name:		buildBlock
+@purpose:	Decodes the block starting at pc and records it in the cache. Flushes the cache first if it is full.
+@param:		BlockCache *, const Chip8 *, uint16_t
+@return:	const Block *
+*/
+static Block * buildBlock(BlockCache * cache, const Chip8 * chip, uint16_t pc)
+{
+	if (cache->numBlocks_ == MAX_BLOCKS)
+		flushBlockCache(cache);
+
+	int16_t index = cache->numBlocks_++;
+	Block * block = &cache->blocks_[index];
+	block->startPc_ = pc;
+	block->pages_ = 0;
+	block->native_ = NULL;
+	block->usesTimers_ = false;
+	block->length_ = 0;
+
+	uint16_t addr = pc;
+	while (block->length_ < MAX_BLOCK_OPS)
+	{
+		uint16_t opCode = (readMem(chip, addr) << 8) | readMem(chip, addr + 1);
+		DecodedOp * op = &block->ops_[block->length_++];
+		*op = decodeOp(opCode);
+		block->usesTimers_ |= op->instr_ == INSTR_SET_VX_TO_DELAY_TIMER || op->instr_ == INSTR_SET_DELAY_TIMER_TO_VX
+			|| op->instr_ == INSTR_SET_SOUND_TIMER_TO_VX;
+		block->pages_ |= 1ULL << ((addr & ADDR_MASK) / CODE_PAGE_SIZE);
+		block->pages_ |= 1ULL << (((addr + 1) & ADDR_MASK) / CODE_PAGE_SIZE);
+
+		if (endsBlock(op->instr_))
+			break;
+
+		addr += 2;
+	}
+
+	// a counting loop's closing jump sits just past the block, so its page counts too
+	uint16_t next = pc + 2 * block->length_;
+	uint16_t nextOpCode = (readMem(chip, next) << 8) | readMem(chip, next + 1);
+	bool usesNext;
+	block->numFused_ = fuseOps(block->ops_, block->length_, nextOpCode, block->fused_, &usesNext, cache->fusionSites_);
+	block->fusedLength_ = block->length_ + (usesNext ? 1 : 0);
+	if (usesNext)
+	{
+		block->pages_ |= 1ULL << ((next & ADDR_MASK) / CODE_PAGE_SIZE);
+		block->pages_ |= 1ULL << (((next + 1) & ADDR_MASK) / CODE_PAGE_SIZE);
+	}
+
+	cache->blockAt_[pc] = index;
+	++cache->blocksBuilt_;
+	return block;
+}
+
+/**
+@name:		syncBlockCache
+@purpose:	Drops blocks built from memory written since the last call. Must run before a
+			block is looked up.
+@param:		BlockCache *, Chip8 *
+@return:	void
+*/
+void syncBlockCache(BlockCache * cache, Chip8 * chip)
+{
+	if (chip->dirtyPages_ != 0)
+	{
+		invalidateBlocks(cache, chip->dirtyPages_);
+		chip->dirtyPages_ = 0;
+	}
+}
+
+/**
+@name:		lookupBlock
+@purpose:	Returns the block starting at pc, decoding it if it is not cached
+@param:		BlockCache *, const Chip8 *, uint16_t
+@return:	Block *
+*/
+Block * lookupBlock(BlockCache * cache, const Chip8 * chip, uint16_t pc)
+{
+	pc &= ADDR_MASK;
+	int16_t index = cache->blockAt_[pc];
+	return (index != NO_BLOCK) ? &cache->blocks_[index] : buildBlock(cache, chip, pc);
+}
+
+/**
+@name:		runBlocks
+@purpose:	Executes up to the given number of opcodes from cached, fused basic blocks, stopping early
+			if the chip halts. Returns the number executed. Chips with debugger output on use
+			runCycles instead.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t runBlocks(Chip8 * chip, uint64_t cycles)
+{
+	BlockCache * cache = acquireBlockCache(chip);
+	if (cache == NULL || chip->printInst_ || chip->dumpRegs_)
+		return runCycles(chip, cycles);
+
+	uint64_t done = 0;
+	while (done < cycles && !chip->halted_)
+	{
+		// only stores end a block, so checking here catches self-modified code before it runs
+		syncBlockCache(cache, chip);
+
+		const Block * block = lookupBlock(cache, chip, chip->progCounter_);
+		uint8_t length = block->length_;
+
+		if (cycles - done >= block->fusedLength_ && blockFits(chip, block, cycles - done))
+		{
+			// blockFits rules out a tick inside a block that touches the timers, so ticks can be applied after it
+			uint8_t retired = 0;
+			for (uint8_t i = 0; i < block->numFused_; ++i)
+				retired += executeFused(chip, &block->fused_[i], cache->fusionRuns_);
+
+			settleBlockCycles(chip, retired);
+			done += retired;
+		}
+		else
+		{
+			for (uint8_t i = 0; i < length && done < cycles; ++i)
+			{
+				++done;
+				if (++chip->cycles_ >= chip->nextFrameCycle_)
+					tickFrame(chip);
+
+				executeOp(chip, &block->ops_[i]);
+			}
+		}
+	}
+
+	return done;
+}
+
+/**
+@name:		printBlockStats
+@purpose:	Prints block cache counters, if the chip has a cache. Fusion counters are left
+			out when the JIT ran and never fell back to fused blocks.
+@param:		const Chip8 *
+@return:	void
+*/
+void printBlockStats(const Chip8 * chip)
+{
+	const BlockCache * cache = chip->blockCache_;
+	if (cache == NULL || cache->owner_ != chip)
+		return;
+
+	printf("Blocks built: %" PRIu64 ", invalidated: %" PRIu64 ", cache flushes: %" PRIu64 "\n",
+		cache->blocksBuilt_, cache->blocksInvalidated_, cache->flushes_);
+
+	// the JIT compiles from ops_, so under it fused ops only run when it falls back to runBlocks
+	bool jitRan = chip->jit_ != NULL && chip->jit_->owner_ == chip;
+	uint64_t runs = 0;
+	for (int i = 0; i < FUSION_COUNT; ++i)
+		runs += cache->fusionRuns_[i];
+	if (jitRan && runs == 0)
+		return;
+
+	for (int i = 0; i < FUSION_COUNT; ++i)
+	{
+		printf("Fusion %-18s sites: %8" PRIu64 ", runs: %12" PRIu64 "%s\n",
+			fusionPattern(static_cast<Fusion>(i)), cache->fusionSites_[i], cache->fusionRuns_[i],
+			jitRan ? " (block fallback only)" : "");
+	}
+}
@@ -0,0 +1,76 @@
+/**	@file blockcache.hpp
+@note Developed for C++17/vc14.1
+@brief Cache of pre-decoded basic blocks, keyed by start PC
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+#include "fusion.hpp"
+#include "opcodes.hpp"
+
+#define MAX_BLOCK_OPS 32
+#define MAX_BLOCKS 512
+#define NO_BLOCK -1
+
+// A straight run of decoded opcodes. Only the last one may change the PC other than by +2.
+typedef struct Block
+{
+	uint64_t pages_;		// pages of memory the block was decoded from
+	void * native_;			// translated code, filled in by the JIT
+	uint16_t startPc_;
+	uint8_t length_;
+	bool usesTimers_;		// contains FX07, FX15 or FX18
+	uint8_t numFused_;
+	uint8_t fusedLength_;	// most opcodes fused_ can retire: length_, or one more if it ends in a counting loop
+	DecodedOp ops_[MAX_BLOCK_OPS];
+	DecodedOp fused_[MAX_BLOCK_OPS];	// ops_ after macro-op fusion
+} Block;
+
+typedef struct BlockCache
+{
+	const Chip8 * owner_;
+	int16_t blockAt_[MEMSIZE];	// block index for each start PC, or NO_BLOCK
+	uint16_t numBlocks_;
+	Block blocks_[MAX_BLOCKS];
+
+	// stats
+	uint64_t blocksBuilt_;
+	uint64_t blocksInvalidated_;
+	uint64_t flushes_;
+	uint64_t fusionSites_[FUSION_COUNT];	// super-instructions made, per kind
+	uint64_t fusionRuns_[FUSION_COUNT];		// and how often each ran
+} BlockCache;
+
+BlockCache * acquireBlockCache(Chip8 * chip);
+void releaseBlockCache(Chip8 * chip);
+void flushBlockCache(BlockCache * cache);
+void syncBlockCache(BlockCache * cache, Chip8 * chip);
+Block * lookupBlock(BlockCache * cache, const Chip8 * chip, uint16_t pc);
+void printBlockStats(const Chip8 * chip);
+
+/**
+@name:		blockFits
+@purpose:	True if a whole block can run without per-opcode timer checks: it fits in the
+			remaining budget, and either no timer tick falls inside it or nothing in it
+			touches the timers, in which case the ticks can be applied afterwards.
+@param:		const Chip8 *, const Block *, uint64_t
+@return:	bool
+*/
+inline bool blockFits(const Chip8 * chip, const Block * block, uint64_t budget)
+{
+	return budget >= block->length_ && (!block->usesTimers_ || chip->cycles_ + block->length_ < chip->nextFrameCycle_);
+}
+
+/**
+@name:		settleBlockCycles
+@purpose:	Adds a whole block's cycles and applies any timer ticks that fell inside it
+@param:		Chip8 *, uint8_t
+@return:	void
+*/
+inline void settleBlockCycles(Chip8 * chip, uint8_t length)
+{
+	chip->cycles_ += length;
+	while (chip->cycles_ >= chip->nextFrameCycle_)
+		tickFrame(chip);
+}
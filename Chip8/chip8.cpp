@@ -6,57 +6,232 @@
 @brief Chip8 functionality
 */
 
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
 #include <ctime>
-#include <direct.h>
+#include <mutex>
+#include <new>
+#include "blockcache.hpp"
 #include "chip8.hpp"
-#include "graphics.hpp"
+#include "jit.hpp"
+#include "opcodes.hpp"
+
+// registers, cycle count and flags take exactly the first line, stack and frame timing the second
+static_assert(offsetof(Chip8, stack_) == CACHE_LINE_SIZE, "hot Chip8 fields spill out of the first cache line");
+static_assert(offsetof(Chip8, memPages_) == 2 * CACHE_LINE_SIZE, "warm Chip8 fields spill out of the second cache line");
+static_assert(ROM_START % MEM_PAGE_SIZE == 0, "the font and the ROM would share a page");
+static_assert(MEM_PAGES <= 16, "privatePages_ has one bit per page");
 
 static const uint8_t fontsetSize = 80;
-static uint8_t delayCounter = 0;
-static uint8_t soundCounter = 0;
-static const uint32_t fullNano = 16'666'666;
-static const uint32_t halfNano = 8'333'333;
-static std::chrono::time_point<std::chrono::system_clock> soundTime;
-static std::chrono::time_point<std::chrono::system_clock> delayTime;
-static time_t tRand;
+
+// The font and a ROM as every instance loaded with it starts out, shared read-only between them
+typedef struct MemImage
+{
+	alignas(CACHE_LINE_SIZE) uint8_t bytes_[MEMSIZE];
+	uint64_t hash_;
+	size_t size_;
+	struct MemImage * next_;
+} MemImage;
+
+// Images are never freed: there is one per distinct ROM loaded, and instances may outlive any owner
+static std::mutex imagesLock;
+static MemImage * images = NULL;
+static size_t numImages = 0;
+
+/**
+@name:		hashRom
+@purpose:	FNV-1a hash of a ROM, to find its image quickly and to tie save states to it
+@param:		const uint8_t *, size_t
+@return:	uint64_t
+*/
+uint64_t hashRom(const uint8_t * rom, size_t size)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ rom[i]) * 0x100000001B3ULL;
+	return hash;
+}
+
+/**
+@name:		sharedImage
+@purpose:	Returns the shared image for a ROM, making it the first time that ROM is loaded.
+			Exits if out of memory.
+@param:		const uint8_t *, size_t
+@return:	const MemImage *
+*/
+static const MemImage * sharedImage(const uint8_t * rom, size_t size)
+{
+	uint64_t hash = hashRom(rom, size);
+	std::lock_guard<std::mutex> hold(imagesLock);
+
+	for (MemImage * image = images; image != NULL; image = image->next_)
+		if (image->hash_ == hash && image->size_ == size && (size == 0 || memcmp(image->bytes_ + ROM_START, rom, size) == 0))
+			return image;
+
+	MemImage * image = new (std::nothrow) MemImage();
+	if (image == NULL)
+	{
+		fprintf(stderr, "Out of memory for a ROM image\n");
+		exit(1);
+	}
+
+	memcpy(image->bytes_, font, fontsetSize);
+	if (size != 0)
+		memcpy(image->bytes_ + ROM_START, rom, size);
+	image->hash_ = hash;
+	image->size_ = size;
+	image->next_ = images;
+	images = image;
+	++numImages;
+	return image;
+}
+
+/**
+@name:		mapImage
+@purpose:	Points every page of a chip's memory at a shared image, dropping its own pages
+@param:		Chip8 *, const MemImage *
+@return:	void
+*/
+static void mapImage(Chip8 * chip, const MemImage * image)
+{
+	releaseMemPages(chip);
+
+	// only writeMem stores through memPages_, and it never does to a page still shared
+	for (int page = 0; page < MEM_PAGES; ++page)
+		chip->memPages_[page] = const_cast<uint8_t *>(image->bytes_ + page * MEM_PAGE_SIZE);
+	chip->romHash_ = image->hash_;
+	chip->romSize_ = (uint32_t)image->size_;
+
+	// anything decoded from memory before is stale
+	chip->dirtyPages_ = ALL_PAGES_DIRTY;
+}
+
+/**
+@name:		privatisePage
+@purpose:	Gives a chip its own copy of a shared page, for writeMem to store into. Exits if
+			out of memory.
+@param:		Chip8 *, uint16_t
+@return:	void
+*/
+void privatisePage(Chip8 * chip, uint16_t page)
+{
+	uint8_t * copy = static_cast<uint8_t *>(malloc(MEM_PAGE_SIZE));
+	if (copy == NULL)
+	{
+		fprintf(stderr, "Out of memory for a page\n");
+		exit(1);
+	}
+
+	memcpy(copy, chip->memPages_[page], MEM_PAGE_SIZE);
+	chip->memPages_[page] = copy;
+	chip->privatePages_ |= 1u << page;
+}
+
+/**
+@name:		releaseMemPages
+@purpose:	Frees the pages a chip has of its own. The chip needs initChip before it runs again.
+@param:		Chip8 *
+@return:	void
+*/
+void releaseMemPages(Chip8 * chip)
+{
+	for (int page = 0; page < MEM_PAGES; ++page)
+		if (chip->privatePages_ & (1u << page))
+		{
+			free(chip->memPages_[page]);
+			chip->memPages_[page] = NULL;
+		}
+
+	chip->privatePages_ = 0;
+}
+
+/**
+@name:		copyChip
+@purpose:	Copies a chip's whole state into another, which shares the source's shared pages
+			and gets copies of its own ones. Engine caches are not copied: dst's must be
+			released first, and it starts with none.
+@param:		Chip8 *, const Chip8 *
+@return:	void
+*/
+void copyChip(Chip8 * dst, const Chip8 * src)
+{
+	if (dst == src)
+		return;
+
+	releaseMemPages(dst);
+	*dst = *src;
+	dst->blockCache_ = NULL;
+	dst->jit_ = NULL;
+	dst->dirtyPages_ = ALL_PAGES_DIRTY;
+
+	// privatisePage copies from the source's page, which the struct copy left in dst's map
+	dst->privatePages_ = 0;
+	for (uint16_t page = 0; page < MEM_PAGES; ++page)
+		if (src->privatePages_ & (1u << page))
+			privatisePage(dst, page);
+}
+
+/**
+@name:		sharedMemBytes
+@purpose:	Returns the bytes held by shared ROM images, however many instances use them
+@param:		void
+@return:	size_t
+*/
+size_t sharedMemBytes(void)
+{
+	std::lock_guard<std::mutex> hold(imagesLock);
+	return numImages * sizeof(MemImage);
+}
 
 /**
 @name:		initChip
-@purpose:	Initialzes a Chip8 struct
+@purpose:	Initialzes a Chip8 struct, freeing the engine caches and pages it owns from an
+			earlier run. The struct must be zeroed (static or from allocChip) or have been
+			through initChip before.
 @param:		Chip8 *
 @return:	void
 */
 void initChip(Chip8 * chip)
 {
-	chip->progCounter_ = 0x200;
+	chip->progCounter_ = ROM_START;
 	chip->opCode_ = 0;
 	chip->regIndex_ = 0;
 	chip->stackPointer_ = 0;
 	chip->drawFlag_ = false;
+	chip->clipSprites_ = false;
+	chip->halted_ = false;
 
 	// debug flags
 	chip->inDebug_ = chip->dumpRegs_ = chip->printInst_ = chip->goNext_ = false;
 
-	// clear memory
-	memset(chip->mem_, 0, MEMSIZE);
-
 	// clear stack
-	memset(chip->stack_, 0, STACKSIZE);
+	memset(chip->stack_, 0, sizeof(chip->stack_));
 
 	// clear registers V0 to VF
 	memset(chip->vReg_, 0, VREGSIZE);
 
-	// load fontset
-	memcpy_s(chip->mem_, MEMSIZE, font, fontsetSize);
+	// memory holds just the fontset, shared with every other instance
+	mapImage(chip, sharedImage(NULL, 0));
+
+	// no decoded code exists yet
+	releaseBlockCache(chip);
+	releaseJit(chip);
+
+	// clear framebuffer and keypad
+	clearFrame(chip);
+	clearKeys(chip);
 
 	// reset timers
 	chip->delayTimer_ = chip->soundTimer_ = 0;
 	chip->soundPlaying_ = chip->isDelay_ = false;
+	chip->cycles_ = chip->frameCount_ = 0;
+	chip->idleCycles_ = 0;
+	setClockRate(chip, DEFAULT_CLOCK_HZ);
 
-	srand((uint32_t)time(NULL));
+	// instances made in the same second still get different sequences
+	seedRandom(chip, (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)chip);
 }
 
 /**
@@ -67,8 +242,8 @@ void initChip(Chip8 * chip)
 */
 void loadGame(Chip8 * chip, const char * path)
 {
-	FILE * file;
-	if (fopen_s(&file, path, "rb") != 0)
+	FILE * file = fopen(path, "rb");
+	if (file == NULL)
 	{
 		fprintf(stderr, "Could not open file %s\n", path);
 		exit(1);
@@ -83,431 +258,358 @@ void loadGame(Chip8 * chip, const char * path)
 		exit(1);
 	}
 
+	uint8_t rom[ROMSIZE];
 	rewind(file);
-	fread((chip->mem_ + 512), sizeof(uint8_t), fileSize, file);
+	fileSize = fread(rom, sizeof(uint8_t), fileSize, file);
 	fclose(file);
+
+	loadRomImage(chip, rom, fileSize);
 }
 
 /**
-@name:		executeCode
-@purpose:	Executes the opcode at the PC's address
-@param:		Chip8 *, GSI *
+@name:		loadRomImage
+@purpose:	Loads a ROM already in memory into a Chip8, for callers that load the same ROM into
+			many instances. Its memory becomes the shared image of the font and that ROM, so
+			instances with the same ROM hold only the pages they have written. Must follow
+			initChip; the size must not exceed ROMSIZE.
+@param:		Chip8 *, const uint8_t *, size_t
 @return:	void
 */
-void executeCode(Chip8 * chip, GSI * gsi)
+void loadRomImage(Chip8 * chip, const uint8_t * rom, size_t size)
 {
-	chip->goNext_ = false;
+	mapImage(chip, sharedImage(rom, size));
+}
 
-	if (chip->delayTimer_ > 0)
-	{
-		// ticks are 1/60 of a second
-		// actual timestamps are used, because not each iteration of the main loop takes the same number of nanoseconds.
-		auto now = std::chrono::system_clock::now();
-		uint32_t nano = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - delayTime).count();
-		uint8_t ticks = (nano + halfNano) / fullNano;
+/**
+@name:		seedRandom
+@purpose:	Seeds the chip's own random number generator, used by CXNN. Runs seeded alike give
+			the same results.
+@param:		Chip8 *, uint32_t
+@return:	void
+*/
+void seedRandom(Chip8 * chip, uint32_t seed)
+{
+	// xorshift gets stuck on 0
+	chip->rngState_ = seed != 0 ? seed : RNG_ZERO_SEED;
+}
 
-		if (ticks > 0)
-		{
-			if (chip->delayTimer_ >= ticks)
-				chip->delayTimer_ -= ticks;
-			else
-				chip->delayTimer_ = 0;
+/**
+@name:		clearFrame
+@purpose:	Clears the framebuffer, one store per row
+@param:		Chip8 *
+@return:	void
+*/
+void clearFrame(Chip8 * chip)
+{
+	for (int y = 0; y < SCREEN_HEIGHT; ++y)
+		chip->gBuffer_[y] = 0;
+
+	chip->dirtyRows_ = ALL_ROWS_DIRTY;
+}
 
-			// this is only reset if there was a tick because each iteration is less than 1/60 of a second
-			delayTime = std::chrono::system_clock::now();
+/**
+@name:		hashFrame
+@purpose:	Computes a 64-bit FNV-1a hash of the framebuffer, for comparing runs without a display.
+			Pixels are hashed one byte each, column by column, so hashes match the old byte-per-pixel layout.
+@param:		const Chip8 *
+@return:	uint64_t
+*/
+uint64_t hashFrame(const Chip8 * chip)
+{
+	uint64_t hash = 14'695'981'039'346'656'037ULL;
+
+	for (int x = 0; x < SCREEN_WIDTH; ++x)
+	{
+		for (int y = 0; y < SCREEN_HEIGHT; ++y)
+		{
+			hash ^= pixelAt(chip, x, y) ? 1 : 0;
+			hash *= 1'099'511'628'211ULL;
 		}
-		
-		if (chip->delayTimer_ == 0)
-			chip->isDelay_ = false;
 	}
 
-	if (chip->soundTimer_ > 0)
-	{
-		// ticks are 1/60 of a second
-		// actual timestamps are used, because not each iteration of the main loop takes the same number of nanoseconds.
-		auto now = std::chrono::system_clock::now();
-		uint32_t nano = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - soundTime).count();
-		uint8_t ticks = (nano + halfNano) / fullNano;
+	return hash;
+}
 
-		if (ticks > 0)
-		{
-			if (chip->soundTimer_ >= ticks)
-				chip->soundTimer_ -= ticks;
-			else
-				chip->soundTimer_ = 0;
+/**
+@name:		setKey
+@purpose:	Sets the state of one keypad key. This is how front-ends feed input to the core.
+@param:		Chip8 *, uint8_t, bool
+@return:	void
+*/
+void setKey(Chip8 * chip, uint8_t key, bool pressed)
+{
+	uint16_t bit = (uint16_t)(1 << (key & 0xF));
+	chip->keyMask_ = pressed ? (chip->keyMask_ | bit) : (chip->keyMask_ & ~bit);
+}
 
-			// this is only reset if there was a tick because each iteration is less than 1/60 of a second
-			soundTime = std::chrono::system_clock::now();
-		}
+/**
+@name:		setKeyMask
+@purpose:	Sets the whole keypad at once, bit N for key N. Front-ends that latch input once per
+			frame use this instead of setKey.
+@param:		Chip8 *, uint16_t
+@return:	void
+*/
+void setKeyMask(Chip8 * chip, uint16_t mask)
+{
+	chip->keyMask_ = mask;
+}
 
-		if (chip->soundTimer_ == 0)
-			chip->soundPlaying_ = false;
-	}
-	
-	chip->opCode_ = (chip->mem_[chip->progCounter_] << 8) | (chip->mem_[chip->progCounter_ + 1]);
+/**
+@name:		clearKeys
+@purpose:	Releases every keypad key
+@param:		Chip8 *
+@return:	void
+*/
+void clearKeys(Chip8 * chip)
+{
+	chip->keyMask_ = 0;
+}
+
+/**
+@name:		nextFrameBoundary
+@purpose:	Returns the cycle on which the frame after the current one begins
+@param:		const Chip8 *
+@return:	uint64_t
+*/
+static uint64_t nextFrameBoundary(const Chip8 * chip)
+{
+	return ((chip->frameCount_ + 1) * chip->clockHz_ + TIMER_HZ - 1) / TIMER_HZ;
+}
+
+/**
+@name:		setClockRate
+@purpose:	Sets how many instructions make up one emulated second. Timers tick every clockHz / 60 cycles,
+			so rates below 60Hz are raised to 60Hz.
+@param:		Chip8 *, uint32_t
+@return:	void
+*/
+void setClockRate(Chip8 * chip, uint32_t clockHz)
+{
+	chip->clockHz_ = clockHz >= TIMER_HZ ? clockHz : TIMER_HZ;
+
+	// keep the current frame number; only the length of the frames changes
+	chip->frameCount_ = chip->cycles_ * TIMER_HZ / chip->clockHz_;
+	chip->nextFrameCycle_ = nextFrameBoundary(chip);
+}
+
+/**
+@name:		tickFrame
+@purpose:	Called when the cycle counter crosses a 60Hz frame boundary. Decrements the delay and sound timers.
+@param:		Chip8 *
+@return:	void
+*/
+void tickFrame(Chip8 * chip)
+{
+	++chip->frameCount_;
+	chip->nextFrameCycle_ = nextFrameBoundary(chip);
+
+	if (chip->delayTimer_ > 0 && --chip->delayTimer_ == 0)
+		chip->isDelay_ = false;
+
+	if (chip->soundTimer_ > 0 && --chip->soundTimer_ == 0)
+		chip->soundPlaying_ = false;
+}
+
+/**
+@name:		unknownOpCode
+@purpose:	Reports an opcode the interpreter does not understand and halts the chip
+@param:		Chip8 *
+@return:	void
+*/
+void unknownOpCode(Chip8 * chip)
+{
+	printf("Unknown opcode: %x\n", chip->opCode_);
+	chip->halted_ = true;
+}
+
+/**
+@name:		dumpRegisters
+@purpose:	Prints the registers, index, and stack to the console for the debugger
+@param:		const Chip8 *
+@return:	void
+*/
+void dumpRegisters(const Chip8 * chip)
+{
+	printf("Register Values:\n");
+	for (int i = 0; i < 0xF; i += 4)
+		printf("%.4X  %.4X  %.4X  %.4X\n", chip->vReg_[i], chip->vReg_[i + 1], chip->vReg_[i + 2], chip->vReg_[i + 3]);
 
-	unsigned xIdx = (chip->opCode_ & 0x0F00) >> 8;
-	unsigned yIdx = (chip->opCode_ & 0x00F0) >> 4;
-	uint8_t nVal = static_cast<uint8_t>(chip->opCode_ & 0x00FF);
-	uint8_t regVal = chip->vReg_[(chip->opCode_ & 0x0F00) >> 8];
+	printf("Address of index: %.4X\n", chip->regIndex_);
+	printf("Value at index: %.4x\n", readMem(chip, chip->regIndex_));
+
+	printf("Stack:\n");
+	if (chip->stackPointer_ == 0)
+		printf("No stack!\n");
+
+	for(unsigned i = 0; i < chip->stackPointer_; ++i)
+		printf("%u: %.4X\n", i, chip->stack_[i]);
+}
+
+/**
+@name:		stepCode
+@purpose:	Executes the opcode at the PC's address: through the nested switches of
+			executeSwitch, or through decodeOp and executeOp with table set. Inlined into
+			executeCode, runCycles and runTable so neither loop pays for a call per opcode.
+@param:		Chip8 *, bool
+@return:	void
+*/
+static inline void stepCode(Chip8 * chip, bool table)
+{
+	chip->goNext_ = false;
+
+	// timers only change on 60Hz frame boundaries, measured in emulated cycles
+	if (++chip->cycles_ >= chip->nextFrameCycle_)
+		tickFrame(chip);
+
+	chip->opCode_ = fetchOpCode(chip);
 
 	// print memory address hex, memory address local, opcode
 	if (chip->printInst_)
 		printf("%.4u  %.4X  %.4X\n", chip->progCounter_, chip->progCounter_, chip->opCode_);
 
-	switch (chip->opCode_ & static_cast<uint16_t>(0xF000))
+	if (table)
 	{
-		case 0x000:
-			switch (chip->opCode_ & static_cast<uint16_t>(0x0FFF))
-			{
-				case CALL_RCA_ADDR:
-					chip->progCounter_ +=2;
-					break;
-				case CLEAR_SCREEN:
-					clearScreen(gsi);
-					break;
-				case RETURN:
-				{	
-					--chip->stackPointer_;
-					chip->progCounter_ = chip->stack_[chip->stackPointer_];
-					chip->progCounter_ += 2;
-				}
-					break;
-				default:
-					printf("Unknown opcode: %x", chip->opCode_);
-					cleanUpGraphics(gsi);
-					exit(1);
-					break;
-			}
-			break;
-		case GOTO_ADDR:
-			chip->progCounter_ = (chip->opCode_ & 0x0FFF);
-			break;
-		case CALL_SUB:
-		{
-			chip->stack_[chip->stackPointer_] = chip->progCounter_;
-			++chip->stackPointer_;
-			chip->progCounter_ = (chip->opCode_ & 0x0FFF);
-		}
-			break;
-		case VX_SKIP_EQUAL_ADDR:
-		{
-			if (nVal == regVal)
-				chip->progCounter_ += 4;
-			else
-				chip->progCounter_ += 2;
-		}	
-			break;
-		case VX_SKIP_NEQUAL_ADDR:
-		{
-			if (nVal != regVal)
-				chip->progCounter_ += 4;
-			else
-				chip->progCounter_ += 2;
-		}
-			break;
-		case VX_NOT_VY:
-		{
-			if (chip->vReg_[xIdx] != chip->vReg_[yIdx])
-				chip->progCounter_ += 4;
-			else
-				chip->progCounter_ += 2;
-		}
-			break;
-		case SET_VX_TO_ADDR:
-		{
-			chip->vReg_[xIdx] = nVal;
-			chip->progCounter_ += 2;
-		}
-			break;
-		case SET_VX_VX_PLUS_ADDR:
-		{
-			chip->vReg_[xIdx] += nVal;
-			chip->progCounter_ += 2;
-		}
-			break;
-		case 0x8000:
-			switch (chip->opCode_ & static_cast<uint16_t>(0xF00F))
-			{
-				case SET_VX_TO_VY:
-				{
-					chip->vReg_[xIdx] = chip->vReg_[yIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_VX_OR_VY:
-				{
-					chip->vReg_[xIdx] |= chip->vReg_[yIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_VX_AND_VY:
-				{
-					chip->vReg_[xIdx] &= chip->vReg_[yIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_VX_XOR_VY:
-				{
-					chip->vReg_[xIdx] ^= chip->vReg_[yIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_VX_PLUS_VY:
-				{
-					
-					if (chip->vReg_[yIdx] > (0xFF - chip->vReg_[xIdx]))
-						chip->vReg_[0xF] = 1;
-					else 
-						chip->vReg_[0xF] = 0;
-
-					chip->vReg_[xIdx] += chip->vReg_[yIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_VX_MINUS_VY:
-				{
-					if (chip->vReg_[yIdx] > chip->vReg_[xIdx])
-						chip->vReg_[0xF] = 0;
-					else
-						chip->vReg_[0xF] = 1;
-
-					chip->vReg_[xIdx] -= chip->vReg_[yIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_SHIFT_ONE_RIGHT:
-				{
-					chip->vReg_[0xF] = chip->vReg_[xIdx] & 1;	// xVal & 0000 0001 
-					chip->vReg_[xIdx] >>= 1;
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_VY_MINUS_VX:
-				{
-					if (chip->vReg_[xIdx] > chip->vReg_[yIdx])
-						chip->vReg_[0xF] = 0;
-					else
-						chip->vReg_[0xF] = 1;
-
-					chip->vReg_[xIdx] = chip->vReg_[yIdx] - chip->vReg_[xIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_VX_SHIFT_ONE_LEFT:
-				{
-					chip->vReg_[0xF] = chip->vReg_[xIdx] & 128;	// xVal & 1000 0000 
-					chip->vReg_[xIdx] <<= 1;
-					chip->progCounter_ += 2;
-				}
-					break;
-				default:
-					printf("Unknown opcode: %x", chip->opCode_);
-					cleanUpGraphics(gsi);
-					exit(1);
-					break;
-			}
-			break;
-		case CHECK_VX_IS_VY:
-		{	
-			if (chip->vReg_[xIdx] == chip->vReg_[yIdx])
-				chip->progCounter_ += 2;
-			else
-				chip->progCounter_ += 4;
-		}
-			break;
-		case SET_INDEX_TO_ADDR_VAL:
-		{
-			chip->regIndex_ = (chip->opCode_ & 0x0FFF);
-			chip->progCounter_ += 2;
-		}
-			break;
-		case JUMP_TO_ADDR_PLUS_V0:
-		{
-			chip->progCounter_ = (chip->opCode_ & 0x0FFF) + chip->vReg_[0];
-		}
-			break;
-		case SET_VX_RAND_AND_NN:
-		{
-			chip->vReg_[xIdx] = (rand() % 256) & nVal;
-			chip->progCounter_ += 2;
-		}
-			break;
-		case DRAW_VX_VY_N:
-		{
-			uint16_t xCoord = chip->vReg_[xIdx];
-			uint16_t yCoord = chip->vReg_[yIdx];
-			uint16_t height = (chip->opCode_ & 0x000F);
-
-			chip->vReg_[0xF] = 0;
-			for (int y = 0; y < height; ++y)
-			{
-				uint16_t pixelRow = chip->mem_[chip->regIndex_ + y];
-				for (int x = 0; x < 8; ++x)
-				{
-					if ((pixelRow & (0x80 >> x)) != 0)
-						if(drawSprite(gsi, x + xCoord, y + yCoord, height))
-							chip->vReg_[0xF] = 1;
-				}
-			}
-			chip->drawFlag_ = true;
-			chip->progCounter_ += 2;
-		}
-			break;
-		case 0xE000:
-			switch (chip->opCode_ & static_cast<uint16_t>(0xF0FF))
-			{
-				case SKIP_IF_KEY_PRESSED:
-				{
-					if (chip->key_[chip->vReg_[xIdx]] != 0)
-						chip->progCounter_ += 4;
-					else
-						chip->progCounter_ += 2;
-				}
-					break;
-				case SKIP_IF_KEY_NT_PRESSED:
-				{
-					if (chip->key_[chip->vReg_[xIdx]] == 0)
-						chip->progCounter_ += 4;
-					else
-						chip->progCounter_ += 2;
-				}
-					break;
-				default:
-					printf("Unknown opcode: %x", chip->opCode_);
-					cleanUpGraphics(gsi);
-					exit(1);
-					break;
-			}
-			break;
-		case 0xF000:
-			switch (chip->opCode_ & static_cast<uint16_t>(0xF0FF))
-			{
-				case SET_VX_TO_DELAY_TIMER:
-				{
-					chip->vReg_[xIdx] = chip->delayTimer_;
-					chip->progCounter_ += 2;
-				}
-					break;
-				case WAIT_FOR_KEY_PRESS_VX:
-				{
-					bool isPressed = false;
-					for (int i = 0; i < 16; ++i)
-					{
-						if (chip->key_[i] != 0)
-						{
-							isPressed = true;
-							chip->vReg_[xIdx] = i;
-						}
-					}
-
-					if (!isPressed)
-						return;
-
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_DELAY_TIMER_TO_VX:
-				{
-					chip->delayTimer_ = chip->vReg_[xIdx];
-					
-					if (!chip->isDelay_)
-					{
-						delayTime = std::chrono::system_clock::now();
-						chip->isDelay_ = true;
-					}
-						
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_SOUND_TIMER_TO_VX:
-				{
-					chip->soundTimer_ = chip->vReg_[xIdx];
-
-					if (!chip->soundPlaying_)
-					{
-						soundTime = std::chrono::system_clock::now();
-						chip->soundPlaying_ = true;
-					}
-
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_INDEX_PLUS_VX:
-				{
-					if (chip->regIndex_ + chip->vReg_[xIdx] > 0x0FFF)
-						chip->vReg_[0xF] = 1;
-					else
-						chip->vReg_[0xF] = 0;
-
-					chip->regIndex_ += chip->vReg_[xIdx];
-					chip->progCounter_ += 2;
-				}
-					break;
-				case SET_INDEX_TO_SPRITE:
-				{
-					chip->regIndex_ = chip->vReg_[xIdx] * 5; // 4x5 font, offset by 5 to find character
-					chip->progCounter_ += 2;
-				}
-					break;
-				case STORE_BINARY_DEC_VX:
-				{
-					uint8_t xVal = chip->vReg_[xIdx];
-
-					chip->mem_[chip->regIndex_] = (xVal / 100) % 10;
-					chip->mem_[chip->regIndex_ + 1] = (xVal / 10) % 10;
-					chip->mem_[chip->regIndex_ + 2] = xVal % 10;
-					
-					chip->progCounter_ += 2;
-				}
-					break;
-				case STORE_V0_TO_VX_AT_IDX:
-				{
-					for (unsigned i = 0; i <= xIdx; ++i)
-						chip->mem_[chip->regIndex_ + i] = chip->vReg_[i];
-
-					chip->regIndex_ += chip->vReg_[xIdx] + 1;
-					chip->progCounter_ += 2;
-				}
-					break;
-				case FILL_V0_TO_VX_AT_IDX:
-				{
-					for (unsigned i = 0; i <= xIdx; ++i)
-						chip->vReg_[i] = chip->mem_[chip->regIndex_ + i];
-
-					chip->regIndex_ += chip->vReg_[xIdx] + 1;
-					chip->progCounter_ += 2;
-				}
-					break;
-				default:
-					printf("Unknown opcode: %x", chip->opCode_);
-					cleanUpGraphics(gsi);
-					exit(1);
-					break;
-			}
-			break;
-		default:
-			printf("Unknown opcode: %x", chip->opCode_);
-			cleanUpGraphics(gsi);
-			exit(1);
-			break;
+		DecodedOp op = decodeOp(chip->opCode_);
+		executeOp(chip, &op);
 	}
+	else
+		executeSwitch(chip, chip->opCode_);
 
 	// dump registers, mem address at index
 	if (chip->dumpRegs_)
+		dumpRegisters(chip);
+}
+
+/**
+@name:		executeCode
+@purpose:	Executes the opcode at the PC's address
+@param:		Chip8 *
+@return:	void
+*/
+void executeCode(Chip8 * chip)
+{
+	stepCode(chip, false);
+}
+
+/**
+@name:		runCycles
+@purpose:	Executes up to the given number of opcodes, stopping early if the chip halts. Returns the number executed.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t runCycles(Chip8 * chip, uint64_t cycles)
+{
+	uint64_t done = 0;
+	while (done < cycles && !chip->halted_)
 	{
-		printf("Register Values:\n");
-		for (int i = 0; i < 0xF; i += 4)
-			printf("%.4X  %.4X  %.4X  %.4X\n", chip->vReg_[i], chip->vReg_[i + 1], chip->vReg_[i + 2], chip->vReg_[i + 3]);
+		stepCode(chip, false);
+		++done;
+	}
 
-		printf("Address of index: %.4X\n", chip->regIndex_);
-		printf("Value at index: %.4x\n", chip->mem_[chip->regIndex_]);
+	return done;
+}
 
-		printf("Stack:\n");
-		if (chip->stackPointer_ == 0)
-			printf("No stack!\n");
+/**
+@name:		runTable
+@purpose:	runCycles, decoding each opcode through the decode table instead of the switches.
+			Kept as an engine so --bench can compare the two dispatches.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t runTable(Chip8 * chip, uint64_t cycles)
+{
+	uint64_t done = 0;
+	while (done < cycles && !chip->halted_)
+	{
+		stepCode(chip, true);
+		++done;
+	}
+
+	return done;
+}
+
+/**
+@name:		opCodeAt
+@purpose:	Reads the big-endian opcode at an address, wrapping like fetchOpCode
+@param:		const Chip8 *, uint16_t
+@return:	uint16_t
+*/
+static uint16_t opCodeAt(const Chip8 * chip, uint16_t addr)
+{
+	return (readMem(chip, addr) << 8) | readMem(chip, addr + 1);
+}
+
+/**
+@name:		idleWait
+@purpose:	Returns what the chip waits on if it sits in an idle loop at its PC: IDLE_SPIN for a
+			jump to itself, IDLE_KEY for FX0A with no key down, IDLE_DELAY for FX07; 3X00; 1NNN
+			polling a running delay timer. IDLE_NONE otherwise.
+@param:		const Chip8 *
+@return:	IdleWait
+*/
+IdleWait idleWait(const Chip8 * chip)
+{
+	uint16_t pc = chip->progCounter_;
+	DecodedOp decoded = decodeOp(opCodeAt(chip, pc));
+	const DecodedOp * op = &decoded;
+
+	if (op->instr_ == INSTR_GOTO_ADDR && op->nnn_ == pc)
+		return IDLE_SPIN;
+	if (op->instr_ == INSTR_WAIT_FOR_KEY_PRESS_VX && chip->keyMask_ == 0)
+		return IDLE_KEY;
+	if (op->instr_ == INSTR_SET_VX_TO_DELAY_TIMER && chip->delayTimer_ != 0)
+	{
+		// FX07; 3X00; 1NNN back to the FX07: loops until the timer reads 0
+		DecodedOp test = decodeOp(opCodeAt(chip, pc + 2));
+		DecodedOp jump = decodeOp(opCodeAt(chip, pc + 4));
 
-		for(unsigned i = 0; i < chip->stackPointer_; ++i)
-			printf("%u: %.4X\n", i, chip->stack_[i]);
+		if (test.instr_ == INSTR_VX_SKIP_EQUAL_ADDR && test.x_ == op->x_ && test.nn_ == 0
+			&& jump.instr_ == INSTR_GOTO_ADDR && jump.nnn_ == pc)
+			return IDLE_DELAY;
 	}
+
+	return IDLE_NONE;
+}
+
+/**
+@name:		skipIdle
+@purpose:	Checks whether the chip sits in an idle loop at its PC (see idleWait). Nothing in those
+			loops can change until the next timer tick, and keys only change between frames, so whole
+			loop iterations are skipped up to just before the tick, leaving the chip exactly as running
+			them would have. Returns the cycles skipped, at most limit; 0 when not idle or debugging.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t skipIdle(Chip8 * chip, uint64_t limit)
+{
+	if (chip->inDebug_ || chip->printInst_ || chip->dumpRegs_)
+		return 0;
+
+	IdleWait wait = idleWait(chip);
+	uint64_t period = wait == IDLE_DELAY ? 3 : 1;
+	if (wait == IDLE_NONE || chip->cycles_ + period >= chip->nextFrameCycle_)
+		return 0;
+
+	// the last skipped cycle must stay before the tick, which comes with the cycle reaching nextFrameCycle_
+	uint64_t iterations = (chip->nextFrameCycle_ - 1 - chip->cycles_) / period;
+	if (iterations > limit / period)
+		iterations = limit / period;
+	if (iterations == 0)
+		return 0;
+
+	uint64_t skipped = iterations * period;
+	chip->cycles_ += skipped;
+	chip->idleCycles_ += skipped;
+
+	// the loop ends each iteration on its last opcode, with the timer read into VX
+	uint16_t pc = chip->progCounter_;
+	if (wait == IDLE_DELAY)
+	{
+		chip->vReg_[decodeOp(opCodeAt(chip, pc)).x_] = chip->delayTimer_;
+		chip->opCode_ = opCodeAt(chip, pc + 4);
+	}
+	else
+		chip->opCode_ = opCodeAt(chip, pc);
+
+	return skipped;
 }
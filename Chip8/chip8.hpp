@@ -7,19 +7,42 @@
 */
 
 #pragma once
+#include <cstdint>
 #include <cstdio>
-#include <chrono>
 #include "font_set.hpp"
 
 #define SLOW_SPEED	1'666'666	// 600Hz
 #define MED_SPEED	1'000'000	// 1000hz
 #define FAST_SPEED	  666'666	// 1500Hz
 
+#define DEFAULT_CLOCK_HZ 1000
+#define TIMER_HZ 60
+
 #define MEMSIZE 4096
 #define ROMSIZE 3584
+#define ROM_START 0x200
 #define VREGSIZE 16
 #define STACKSIZE 16
 #define KEYSIZE 16
+#define CODE_PAGE_SIZE 64			// granularity of self-modifying-code tracking
+#define ALL_PAGES_DIRTY (~0ULL)		// MEMSIZE / CODE_PAGE_SIZE pages, one bit each
+#define SCREEN_WIDTH 64
+#define SCREEN_HEIGHT 32
+#define SPRITE_WIDTH 8
+#define ALL_ROWS_DIRTY 0xFFFFFFFFu		// SCREEN_HEIGHT rows, one bit each
+#define RNG_ZERO_SEED 0x9E3779B9u		// used in place of a 0 seed
+#define CACHE_LINE_SIZE 64
+#define MEM_PAGE_SIZE 256			// granularity of copy-on-write memory sharing
+#define MEM_PAGES (MEMSIZE / MEM_PAGE_SIZE)
+
+// What a chip in an idle loop is waiting for; see idleWait
+enum IdleWait : uint8_t
+{
+	IDLE_NONE,
+	IDLE_SPIN,		// a jump to itself: waits forever
+	IDLE_KEY,		// FX0A with no key down: waits for a key
+	IDLE_DELAY		// FX07; 3X00; 1NNN: waits for the delay timer to reach 0
+};
 
 enum OpCode : uint16_t
 {
@@ -60,26 +83,61 @@ enum OpCode : uint16_t
 	FILL_V0_TO_VX_AT_IDX = 0xF065	// FX65
 };
 
+/*
+Laid out by how often each field is touched: the first cache line holds everything a plain
+opcode and the cycle counter use, the second the stack and the rest of per-frame state,
+then the memory map, the screen, and the debugger's flags last.
+
+Memory is not stored in the struct. Each MEM_PAGE_SIZE page of it is a pointer either into a
+shared read-only image of the font and ROM, which every instance loaded with the same ROM
+uses, or into a page of the chip's own, which writeMem makes on the first write to a page.
+*/
 typedef struct Chip8
 {
-	uint16_t opCode_;
-	uint8_t mem_[MEMSIZE];
-	uint8_t rom_[ROMSIZE];
-	uint8_t vReg_[VREGSIZE];
-	
+	// hot: registers, cycle count and flags, one cache line
+	alignas(CACHE_LINE_SIZE) uint8_t vReg_[VREGSIZE];
 	uint16_t regIndex_;
 	uint16_t progCounter_;
-	
+	uint16_t stackPointer_;
+	uint16_t opCode_;
+	uint16_t keyMask_;		// bit N set while keypad key N is down
 	uint8_t delayTimer_;
 	uint8_t soundTimer_;
-	bool soundPlaying_;
-	bool isDelay_;
-	
-	uint16_t stack_[STACKSIZE];
-	uint16_t stackPointer_;
-	
-	uint8_t key_[KEYSIZE];
+
+	// emulated time: timers tick when cycles_ reaches nextFrameCycle_
+	uint64_t cycles_;
+	uint64_t nextFrameCycle_;
+
+	// one bit per CODE_PAGE_SIZE bytes of memory written since decoded code was last checked
+	uint64_t dirtyPages_;
+	uint32_t rngState_;		// xorshift32, never 0
+
+	// set when an unknown opcode is hit; the front-end decides how to exit
+	bool halted_;
 	bool drawFlag_;
+	bool isDelay_;
+	bool soundPlaying_;
+
+	// warm: calls, engine caches and frame timing, one cache line
+	alignas(CACHE_LINE_SIZE) uint16_t stack_[STACKSIZE];
+	struct BlockCache * blockCache_;
+	struct JitState * jit_;
+	uint64_t frameCount_;
+	uint32_t clockHz_;
+	uint32_t dirtyRows_;	// one bit per row changed since the front-end last presented; it clears them
+
+	// memory map, two cache lines; shared pages are never written through it
+	alignas(CACHE_LINE_SIZE) uint8_t * memPages_[MEM_PAGES];
+
+	// framebuffer, one word per row, bit 63 is x = 0
+	alignas(CACHE_LINE_SIZE) uint64_t gBuffer_[SCREEN_HEIGHT];
+
+	// cold
+	uint16_t privatePages_;	// bit N set once page N is the chip's own copy
+	uint32_t romSize_;		// the ROM memory was loaded from, to tell save states apart
+	uint64_t romHash_;
+	uint64_t idleCycles_;	// cycles skipIdle fast-forwarded through
+	bool clipSprites_;	// sprites stop at the screen edges instead of wrapping around
 
 	// flags for debugger
 	bool inDebug_;
@@ -88,8 +146,117 @@ typedef struct Chip8
 	bool goNext_;
 } Chip8;
 
-typedef struct GSI GSI;
-
 void initChip(Chip8 * chip);
 void loadGame(Chip8 * chip, const char * path);
-void executeCode(Chip8 * chip, GSI * gsi);
\ No newline at end of file
+void loadRomImage(Chip8 * chip, const uint8_t * rom, size_t size);
+void executeCode(Chip8 * chip);
+uint64_t runCycles(Chip8 * chip, uint64_t cycles);
+uint64_t runTable(Chip8 * chip, uint64_t cycles);
+IdleWait idleWait(const Chip8 * chip);
+uint64_t skipIdle(Chip8 * chip, uint64_t limit);
+
+// memory
+void privatisePage(Chip8 * chip, uint16_t page);
+void releaseMemPages(Chip8 * chip);
+void copyChip(Chip8 * dst, const Chip8 * src);
+uint64_t hashRom(const uint8_t * rom, size_t size);
+size_t sharedMemBytes(void);
+
+/**
+@name:		readMem
+@purpose:	Reads the byte at an address, wrapping past the end of memory
+@param:		const Chip8 *, uint16_t
+@return:	uint8_t
+*/
+inline uint8_t readMem(const Chip8 * chip, uint16_t addr)
+{
+	addr &= MEMSIZE - 1;
+	return chip->memPages_[addr / MEM_PAGE_SIZE][addr % MEM_PAGE_SIZE];
+}
+
+/**
+@name:		memAt
+@purpose:	Returns a pointer to the byte at an address, valid up to the end of its page
+@param:		const Chip8 *, uint16_t
+@return:	const uint8_t *
+*/
+inline const uint8_t * memAt(const Chip8 * chip, uint16_t addr)
+{
+	addr &= MEMSIZE - 1;
+	return chip->memPages_[addr / MEM_PAGE_SIZE] + addr % MEM_PAGE_SIZE;
+}
+
+/**
+@name:		writeMem
+@purpose:	Writes the byte at an address, wrapping past the end of memory, first copying
+			its page if the page is still shared
+@param:		Chip8 *, uint16_t, uint8_t
+@return:	void
+*/
+inline void writeMem(Chip8 * chip, uint16_t addr, uint8_t value)
+{
+	addr &= MEMSIZE - 1;
+	uint16_t page = addr / MEM_PAGE_SIZE;
+	if (!(chip->privatePages_ & (1u << page)))
+		privatisePage(chip, page);
+	chip->memPages_[page][addr % MEM_PAGE_SIZE] = value;
+}
+
+// timers
+void setClockRate(Chip8 * chip, uint32_t clockHz);
+void tickFrame(Chip8 * chip);
+
+// framebuffer
+void clearFrame(Chip8 * chip);
+uint64_t hashFrame(const Chip8 * chip);
+
+// random numbers
+void seedRandom(Chip8 * chip, uint32_t seed);
+
+/**
+@name:		nextRandom
+@purpose:	Steps the chip's xorshift32 generator and returns its low byte
+@param:		Chip8 *
+@return:	uint8_t
+*/
+inline uint8_t nextRandom(Chip8 * chip)
+{
+	uint32_t x = chip->rngState_;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	chip->rngState_ = x;
+	return (uint8_t)x;
+}
+
+// input
+void setKey(Chip8 * chip, uint8_t key, bool pressed);
+void setKeyMask(Chip8 * chip, uint16_t mask);
+void clearKeys(Chip8 * chip);
+
+/**
+@name:		pixelAt
+@purpose:	True if the framebuffer pixel at a coordinate is set
+@param:		const Chip8 *, int, int
+@return:	bool
+*/
+inline bool pixelAt(const Chip8 * chip, int xCoord, int yCoord)
+{
+	return ((chip->gBuffer_[yCoord] >> (SCREEN_WIDTH - 1 - xCoord)) & 1) != 0;
+}
+
+/**
+@name:		spriteRowBits
+@purpose:	Places one byte of sprite data at column xCoord (0-63) of a framebuffer row, either
+			wrapping the bits that run off the right edge around to the left, or dropping them
+@param:		uint8_t, uint8_t, bool
+@return:	uint64_t
+*/
+inline uint64_t spriteRowBits(uint8_t bits, uint8_t xCoord, bool clip)
+{
+	uint64_t row = static_cast<uint64_t>(bits) << (SCREEN_WIDTH - SPRITE_WIDTH);
+	if (clip || xCoord == 0)
+		return row >> xCoord;
+
+	return (row >> xCoord) | (row << (SCREEN_WIDTH - xCoord));
+}
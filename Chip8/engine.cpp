@@ -0,0 +1,75 @@
+/**	@file engine.cpp
+@note Developed for C++17/vc14.1
+@brief Engine registry, used by the command line and the benchmark
+*/
+
+#include <cstring>
+#include "engine.hpp"
+
+typedef struct EngineInfo
+{
+	const char * name_;
+	EngineFunc run_;
+} EngineInfo;
+
+static const EngineInfo engines[ENGINE_COUNT] = {
+	{ "switch", runCycles },
+	{ "table", runTable },
+	{ "threaded", runThreaded },
+	{ "blocks", runBlocks },
+	{ "jit", runJit },
+	{ "aot", runAot },
+};
+
+/**
+@name:		engineFromName
+@purpose:	Looks up an engine by its command-line name. Returns false if there is no such engine.
+@param:		const char *, Engine *
+@return:	bool
+*/
+bool engineFromName(const char * name, Engine * engine)
+{
+	for (int i = 0; i < ENGINE_COUNT; ++i)
+	{
+		if (strcmp(name, engines[i].name_) == 0)
+		{
+			*engine = static_cast<Engine>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+@name:		engineName
+@purpose:	Returns the command-line name of an engine
+@param:		Engine
+@return:	const char *
+*/
+const char * engineName(Engine engine)
+{
+	return engine < ENGINE_COUNT ? engines[engine].name_ : "?";
+}
+
+/**
+@name:		engineFunc
+@purpose:	Returns the run function of an engine
+@param:		Engine
+@return:	EngineFunc
+*/
+EngineFunc engineFunc(Engine engine)
+{
+	return engine < ENGINE_COUNT ? engines[engine].run_ : runCycles;
+}
+
+/**
+@name:		runEngine
+@purpose:	Executes up to the given number of opcodes on the chosen engine. Returns the number executed.
+@param:		Chip8 *, Engine, uint64_t
+@return:	uint64_t
+*/
+uint64_t runEngine(Chip8 * chip, Engine engine, uint64_t cycles)
+{
+	return engineFunc(engine)(chip, cycles);
+}
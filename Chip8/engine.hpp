@@ -0,0 +1,32 @@
+/**	@file engine.hpp
+@note Developed for C++17/vc14.1
+@brief Runtime-selectable execution engines. Every engine runs the same OpCode set
+	   and leaves the chip in the same state as executeCode would.
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+
+enum Engine : uint8_t
+{
+	ENGINE_SWITCH,		// executeCode, one opcode per call, decoded by nested switches
+	ENGINE_TABLE,		// one opcode at a time, decoded through the decode table
+	ENGINE_THREADED,	// computed-goto dispatch, many opcodes per call
+	ENGINE_BLOCKS,		// cached pre-decoded basic blocks
+	ENGINE_JIT,			// basic blocks translated to x86-64
+	ENGINE_AOT,			// a ROM translated to C++ ahead of time (aot.cpp)
+	ENGINE_COUNT
+};
+
+typedef uint64_t (*EngineFunc)(Chip8 * chip, uint64_t cycles);
+
+bool engineFromName(const char * name, Engine * engine);
+const char * engineName(Engine engine);
+EngineFunc engineFunc(Engine engine);
+uint64_t runEngine(Chip8 * chip, Engine engine, uint64_t cycles);
+
+uint64_t runThreaded(Chip8 * chip, uint64_t cycles);
+uint64_t runBlocks(Chip8 * chip, uint64_t cycles);
+uint64_t runJit(Chip8 * chip, uint64_t cycles);
+uint64_t runAot(Chip8 * chip, uint64_t cycles);
@@ -0,0 +1,874 @@
+/**	@file farm.cpp
+@note Developed for C++17/vc14.1
+@brief Regression farm: runs many independent Chip8 instances across all cores on a
+	   work-stealing thread pool, optionally in lockstep groups of the same ROM
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include "arena.hpp"
+#include "blockcache.hpp"
+#include "farm.hpp"
+#include "jit.hpp"
+#include "savestate.hpp"
+
+#define FARM_LINE_SIZE 1024
+
+typedef struct Farm
+{
+	FarmRom * roms_;
+	uint16_t numRoms_;
+	FarmJob * jobs_;
+	uint32_t numJobs_;
+	FarmGroup * groups_;
+	uint32_t numGroups_;
+	FarmWorker * workers_;
+	uint32_t numWorkers_;
+
+	uint32_t clockHz_;
+	Engine engine_;
+	bool clipSprites_;
+	FarmMode mode_;
+	bool hugePages_;		// instances live in arenas on huge pages where the system allows
+	SaveFile state_;		// every job starts from this if it is open
+	std::atomic<uint32_t> failedWorkers_;	// workers that could not set up their instances
+} Farm;
+
+/**
+@name:		findRom
+@purpose:	Returns the index of a ROM in the farm, reading the file the first time it is named.
+			Returns -1 and prints why if it cannot be read.
+@param:		Farm *, const char *
+@return:	int
+*/
+static int findRom(Farm * farm, const char * path)
+{
+	for (uint16_t i = 0; i < farm->numRoms_; ++i)
+		if (strcmp(farm->roms_[i].path_, path) == 0)
+			return i;
+
+	if (farm->numRoms_ == FARM_MAX_ROMS || strlen(path) >= FARM_PATH_SIZE)
+	{
+		fprintf(stderr, "Too many ROMs, or path too long: %s\n", path);
+		return -1;
+	}
+
+	FarmRom * rom = &farm->roms_[farm->numRoms_];
+	FILE * file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open file %s\n", path);
+		return -1;
+	}
+
+	// one byte more than fits, to notice oversized files
+	static uint8_t buffer[ROMSIZE + 1];
+	size_t size = fread(buffer, 1, sizeof(buffer), file);
+	fclose(file);
+
+	if (size > ROMSIZE)
+	{
+		fprintf(stderr, "The file \"%s\" exceeded the maximum ROM size, which is %d bytes.\n", path, ROMSIZE);
+		return -1;
+	}
+
+	strcpy(rom->path_, path);
+	memcpy(rom->data_, buffer, size);
+	rom->size_ = (uint32_t)size;
+	return farm->numRoms_++;
+}
+
+/**
+@name:		parseJob
+@purpose:	Parses one job line: "rom [cycles] [seed] [frame:mask ...]", with masks in hex and
+			frames in ascending order. Missing cycles and seed come from the defaults. Returns
+			false and prints why on a bad line.
+@param:		Farm *, char *, unsigned, uint64_t, uint32_t, FarmJob *
+@return:	bool
+*/
+static bool parseJob(Farm * farm, char * line, unsigned lineNumber, uint64_t cycles, uint32_t seed, FarmJob * job)
+{
+	memset(job, 0, sizeof(FarmJob));
+	job->cycles_ = cycles;
+	job->seed_ = seed;
+
+	int numbers = 0;
+	bool haveRom = false;
+	for (char * token = line; *token != '\0';)
+	{
+		while (*token == ' ' || *token == '\t')
+			++token;
+		if (*token == '\0')
+			break;
+
+		char * end = token;
+		while (*end != '\0' && *end != ' ' && *end != '\t')
+			++end;
+		char * next = *end != '\0' ? end + 1 : end;
+		*end = '\0';
+
+		char * colon = strchr(token, ':');
+		if (!haveRom)
+		{
+			int rom = findRom(farm, token);
+			if (rom < 0)
+				return false;
+			job->rom_ = (uint16_t)rom;
+			haveRom = true;
+		}
+		else if (colon != NULL)
+		{
+			if (job->numInputs_ == FARM_MAX_INPUTS)
+			{
+				fprintf(stderr, "Line %u: more than %d inputs\n", lineNumber, FARM_MAX_INPUTS);
+				return false;
+			}
+
+			FarmInput * input = &job->inputs_[job->numInputs_];
+			input->frame_ = strtoull(token, NULL, 10);
+			input->mask_ = (uint16_t)strtoul(colon + 1, NULL, 16);
+			if (job->numInputs_ > 0 && input->frame_ < job->inputs_[job->numInputs_ - 1].frame_)
+			{
+				fprintf(stderr, "Line %u: inputs must be in frame order\n", lineNumber);
+				return false;
+			}
+			++job->numInputs_;
+		}
+		else if (numbers == 0)
+		{
+			job->cycles_ = strtoull(token, NULL, 10);
+			++numbers;
+		}
+		else if (numbers == 1)
+		{
+			job->seed_ = (uint32_t)strtoul(token, NULL, 10);
+			++numbers;
+		}
+		else
+		{
+			fprintf(stderr, "Line %u: unexpected \"%s\"\n", lineNumber, token);
+			return false;
+		}
+
+		token = next;
+	}
+
+	return true;
+}
+
+/**
+@name:		loadJobs
+@purpose:	Reads the job list; blank lines and lines starting with # are skipped. Each job is
+			queued repeat times, with its seed counting up. Returns false if the list is unusable.
+@param:		Farm *, const char *, uint64_t, uint32_t, uint32_t
+@return:	bool
+*/
+static bool loadJobs(Farm * farm, const char * listPath, uint64_t cycles, uint32_t seed, uint32_t repeat)
+{
+	FILE * list = fopen(listPath, "r");
+	if (list == NULL)
+	{
+		fprintf(stderr, "Could not open file %s\n", listPath);
+		return false;
+	}
+
+	uint32_t capacity = 0;
+	char line[FARM_LINE_SIZE];
+	unsigned lineNumber = 0;
+	bool ok = true;
+
+	while (ok && fgets(line, sizeof(line), list) != NULL)
+	{
+		++lineNumber;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#')
+			continue;
+
+		if (farm->numJobs_ + repeat > capacity)
+		{
+			capacity = (capacity + repeat) * 2;
+			FarmJob * jobs = static_cast<FarmJob *>(realloc(farm->jobs_, capacity * sizeof(FarmJob)));
+			if (jobs == NULL)
+			{
+				fprintf(stderr, "Out of memory for jobs\n");
+				ok = false;
+				break;
+			}
+			farm->jobs_ = jobs;
+		}
+
+		FarmJob * job = &farm->jobs_[farm->numJobs_];
+		if (!parseJob(farm, line, lineNumber, cycles, seed, job))
+		{
+			ok = false;
+			break;
+		}
+
+		for (uint32_t i = 1; i < repeat; ++i)
+		{
+			farm->jobs_[farm->numJobs_ + i] = *job;
+			farm->jobs_[farm->numJobs_ + i].seed_ = job->seed_ + i;
+		}
+		farm->numJobs_ += repeat;
+	}
+
+	fclose(list);
+	if (ok && farm->numJobs_ == 0)
+	{
+		fprintf(stderr, "No jobs in %s\n", listPath);
+		ok = false;
+	}
+
+	return ok;
+}
+
+/**
+@name:		startJob
+@purpose:	Puts a chip in the state a job starts from: fresh, or the farm's save state reseeded
+			with the job's seed, so runs from one checkpoint can differ
+@param:		const Farm *, const FarmJob *, Chip8 *
+@return:	void
+*/
+static void startJob(const Farm * farm, const FarmJob * job, Chip8 * chip)
+{
+	initChip(chip);
+	setClockRate(chip, farm->clockHz_);
+	chip->clipSprites_ = farm->clipSprites_;
+	seedRandom(chip, job->seed_);
+
+	const FarmRom * rom = &farm->roms_[job->rom_];
+	loadRomImage(chip, rom->data_, rom->size_);
+
+	// runFarm has checked that every ROM matches the state
+	if (farm->state_.state_ != NULL)
+	{
+		restoreSaveState(chip, &farm->state_);
+		seedRandom(chip, job->seed_);
+	}
+}
+
+/**
+@name:		jobStop
+@purpose:	Returns the cycle to run a job's chip to before applying input, or the job's end
+			once input has been applied
+@param:		const FarmJob *, const Chip8 *, uint8_t
+@return:	uint64_t
+*/
+static uint64_t jobStop(const FarmJob * job, const Chip8 * chip, uint8_t input)
+{
+	uint64_t stop = job->cycles_;
+	if (input < job->numInputs_)
+	{
+		// frame F begins on the cycle the timers tick for it
+		uint64_t frameStart = (job->inputs_[input].frame_ * chip->clockHz_ + TIMER_HZ - 1) / TIMER_HZ;
+		if (frameStart < stop)
+			stop = frameStart;
+	}
+
+	return stop;
+}
+
+/**
+@name:		finishJob
+@purpose:	Stores a finished job's results
+@param:		FarmJob *, const Chip8 *
+@return:	void
+*/
+static void finishJob(FarmJob * job, const Chip8 * chip)
+{
+	job->done_ = chip->cycles_;
+	job->hash_ = hashFrame(chip);
+	job->progCounter_ = chip->progCounter_;
+	job->halted_ = chip->halted_;
+	job->ran_ = true;
+}
+
+/**
+@name:		continueJob
+@purpose:	Runs a started job on its chip to the end, applying each input from the given one
+			on when its frame begins
+@param:		const Farm *, const FarmJob *, Chip8 *, uint8_t
+@return:	void
+*/
+static void continueJob(const Farm * farm, const FarmJob * job, Chip8 * chip, uint8_t input)
+{
+	for (uint8_t i = input; i <= job->numInputs_ && !chip->halted_; ++i)
+	{
+		uint64_t stop = jobStop(job, chip, i);
+		if (stop > chip->cycles_)
+			runEngine(chip, farm->engine_, stop - chip->cycles_);
+		if (chip->cycles_ < stop)
+			break;
+
+		if (i < job->numInputs_)
+			setKeyMask(chip, job->inputs_[i].mask_);
+	}
+}
+
+/**
+@name:		runJob
+@purpose:	Runs one job on a worker's chip from a fresh start, applying each input when its
+			frame begins, and stores the results in the job
+@param:		const Farm *, FarmJob *, Chip8 *
+@return:	void
+*/
+static void runJob(const Farm * farm, FarmJob * job, Chip8 * chip)
+{
+	startJob(farm, job, chip);
+	continueJob(farm, job, chip, 0);
+	finishJob(job, chip);
+}
+
+/**
+@name:		runLockstepGroup
+@purpose:	Runs a group of jobs together on the lockstep engine, with the same results as
+			runJob on each. Every round runs each unfinished job up to its next input, so
+			jobs whose inputs fall on different frames wait at theirs for the others. Once
+			the jobs have drifted too far apart to share opcodes, each finishes on its own.
+@param:		const Farm *, const FarmGroup *, Chip8 **, Lockstep *
+@return:	void
+*/
+static void runLockstepGroup(const Farm * farm, const FarmGroup * group, Chip8 ** chips, Lockstep * ls)
+{
+	uint8_t input[LOCKSTEP_LANES];
+	uint64_t stops[LOCKSTEP_LANES];
+	uint64_t budgets[LOCKSTEP_LANES];
+	uint32_t running = 0;
+
+	for (uint32_t lane = 0; lane < group->count_; ++lane)
+	{
+		startJob(farm, &farm->jobs_[group->jobs_[lane]], chips[lane]);
+		input[lane] = 0;
+		running |= 1u << lane;
+	}
+	ls->windowSteps_ = 0;
+	ls->windowLaneOps_ = 0;
+	ls->lowChecks_ = 0;
+
+	while (running != 0)
+	{
+		for (uint32_t lane = 0; lane < group->count_; ++lane)
+		{
+			budgets[lane] = 0;
+			if ((running & (1u << lane)) == 0)
+				continue;
+
+			stops[lane] = jobStop(&farm->jobs_[group->jobs_[lane]], chips[lane], input[lane]);
+			if (stops[lane] > chips[lane]->cycles_)
+				budgets[lane] = stops[lane] - chips[lane]->cycles_;
+		}
+
+		if (!runLockstep(ls, chips, budgets, group->count_))
+		{
+			for (uint32_t lane = 0; lane < group->count_; ++lane)
+			{
+				if ((running & (1u << lane)) == 0)
+					continue;
+
+				continueJob(farm, &farm->jobs_[group->jobs_[lane]], chips[lane], input[lane]);
+				++ls->stats_.handedOff_;
+			}
+			break;
+		}
+
+		for (uint32_t lane = 0; lane < group->count_; ++lane)
+		{
+			if ((running & (1u << lane)) == 0)
+				continue;
+
+			const FarmJob * job = &farm->jobs_[group->jobs_[lane]];
+			if (chips[lane]->halted_ || chips[lane]->cycles_ < stops[lane] || input[lane] == job->numInputs_)
+				running &= ~(1u << lane);
+			else
+				setKeyMask(chips[lane], job->inputs_[input[lane]++].mask_);
+		}
+	}
+
+	for (uint32_t lane = 0; lane < group->count_; ++lane)
+		finishJob(&farm->jobs_[group->jobs_[lane]], chips[lane]);
+}
+
+/**
+@name:		takeGroup
+@purpose:	Pops a group index from the tail of a worker's own deque. Returns false if it is empty.
+@param:		FarmWorker *, uint32_t *
+@return:	bool
+*/
+static bool takeGroup(FarmWorker * worker, uint32_t * group)
+{
+	std::lock_guard<std::mutex> guard(worker->lock_);
+	if (worker->head_ == worker->tail_)
+		return false;
+
+	*group = worker->groups_[--worker->tail_];
+	return true;
+}
+
+/**
+@name:		stealGroup
+@purpose:	Takes a group index from the head of another worker's deque, trying each in turn
+			from the next one along. Returns false once every deque is empty.
+@param:		Farm *, uint32_t, uint32_t *
+@return:	bool
+*/
+static bool stealGroup(Farm * farm, uint32_t thief, uint32_t * group)
+{
+	for (uint32_t i = 1; i < farm->numWorkers_; ++i)
+	{
+		FarmWorker * victim = &farm->workers_[(thief + i) % farm->numWorkers_];
+		std::lock_guard<std::mutex> guard(victim->lock_);
+		if (victim->head_ != victim->tail_)
+		{
+			*group = victim->groups_[victim->head_++];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+@name:		workerMain
+@purpose:	Worker thread: runs groups from its own deque, then steals until there are none left
+@param:		Farm *, uint32_t
+@return:	void
+*/
+static void workerMain(Farm * farm, uint32_t id)
+{
+	FarmWorker * self = &farm->workers_[id];
+
+	// zeroed, so initChip has nothing to release on the first job
+	uint32_t numChips = farm->mode_ == FARM_LOCKSTEP ? LOCKSTEP_LANES : 1;
+	Chip8 * chips[LOCKSTEP_LANES];
+	ChipArena arena;
+	if (!initChipArena(&arena, numChips, farm->hugePages_))
+	{
+		// the others steal this worker's jobs; any left over are reported as not run
+		fprintf(stderr, "Worker %u could not start\n", id);
+		++farm->failedWorkers_;
+		return;
+	}
+	for (uint32_t i = 0; i < numChips; ++i)
+		chips[i] = allocChip(&arena);
+	Lockstep * ls = farm->mode_ == FARM_LOCKSTEP ? new Lockstep() : NULL;
+
+	uint32_t index;
+	for (;;)
+	{
+		bool stolen = false;
+		if (!takeGroup(self, &index))
+		{
+			if (!stealGroup(farm, id, &index))
+				break;
+			stolen = true;
+		}
+
+		const FarmGroup * group = &farm->groups_[index];
+		auto start = std::chrono::steady_clock::now();
+		if (ls != NULL)
+			runLockstepGroup(farm, group, chips, ls);
+		else
+			runJob(farm, &farm->jobs_[group->jobs_[0]], chips[0]);
+		auto end = std::chrono::steady_clock::now();
+
+		self->busySecs_ += std::chrono::duration<double>(end - start).count();
+		for (uint32_t i = 0; i < group->count_; ++i)
+		{
+			FarmJob * job = &farm->jobs_[group->jobs_[i]];
+			job->worker_ = (uint16_t)id;
+			self->instructions_ += job->done_;
+			++self->jobsRun_;
+			if (stolen)
+				++self->stolen_;
+		}
+	}
+
+	if (ls != NULL)
+	{
+		self->lockstep_ = ls->stats_;
+		delete ls;
+	}
+	for (uint32_t i = 0; i < numChips; ++i)
+	{
+		releaseBlockCache(chips[i]);
+		releaseJit(chips[i]);
+		releaseMemPages(chips[i]);
+	}
+	releaseChipArena(&arena);
+}
+
+/**
+@name:		groupJobs
+@purpose:	Splits the jobs into the units workers take: with lockstep, runs of up to
+			LOCKSTEP_LANES jobs of the same ROM in list order, otherwise one job each.
+			Returns false if out of memory.
+@param:		Farm *
+@return:	bool
+*/
+static bool groupJobs(Farm * farm)
+{
+	farm->groups_ = static_cast<FarmGroup *>(malloc(farm->numJobs_ * sizeof(FarmGroup)));
+	if (farm->groups_ == NULL)
+	{
+		fprintf(stderr, "Out of memory for jobs\n");
+		return false;
+	}
+
+	// the group still filling for each ROM, or -1
+	static int32_t open[FARM_MAX_ROMS];
+	for (int i = 0; i < FARM_MAX_ROMS; ++i)
+		open[i] = -1;
+
+	farm->numGroups_ = 0;
+	for (uint32_t i = 0; i < farm->numJobs_; ++i)
+	{
+		uint16_t rom = farm->jobs_[i].rom_;
+		if (farm->mode_ != FARM_LOCKSTEP || open[rom] < 0 || farm->groups_[open[rom]].count_ == LOCKSTEP_LANES)
+		{
+			open[rom] = (int32_t)farm->numGroups_;
+			farm->groups_[farm->numGroups_++].count_ = 0;
+		}
+
+		FarmGroup * group = &farm->groups_[open[rom]];
+		group->jobs_[group->count_++] = i;
+	}
+
+	return true;
+}
+
+/**
+@name:		printJobResults
+@purpose:	Prints each job's result in list order and adds up the instructions run. Returns
+			the number of jobs that halted; notRun gets the number no worker got to.
+@param:		const Farm *, uint64_t *, uint32_t *
+@return:	uint32_t
+*/
+static uint32_t printJobResults(const Farm * farm, uint64_t * total, uint32_t * notRun)
+{
+	uint32_t halted = 0;
+	*total = 0;
+	*notRun = 0;
+
+	for (uint32_t i = 0; i < farm->numJobs_; ++i)
+	{
+		const FarmJob * job = &farm->jobs_[i];
+		if (!job->ran_)
+		{
+			printf("%6u %s seed %u: not run\n", i, farm->roms_[job->rom_].path_, job->seed_);
+			++*notRun;
+			continue;
+		}
+		printf("%6u %s seed %u: %" PRIu64 " instructions, hash %.16" PRIx64, i, farm->roms_[job->rom_].path_, job->seed_, job->done_, job->hash_);
+		if (job->halted_)
+		{
+			printf(", halted at PC %.4X", job->progCounter_);
+			++halted;
+		}
+		printf("\n");
+		*total += job->done_;
+	}
+
+	return halted;
+}
+
+/**
+@name:		printFarmResults
+@purpose:	Prints each job's result in list order, then per-worker and aggregate throughput.
+			Returns the number of jobs that halted; notRun gets the number no worker got to.
+@param:		const Farm *, double, uint32_t *
+@return:	uint32_t
+*/
+static uint32_t printFarmResults(const Farm * farm, double wallSecs, uint32_t * notRun)
+{
+	uint64_t total;
+	uint32_t halted = printJobResults(farm, &total, notRun);
+
+	printf("\n%-8s %8s %8s %16s %10s %16s\n", "worker", "jobs", "stolen", "instructions", "busy (s)", "instr/second");
+	for (uint32_t i = 0; i < farm->numWorkers_; ++i)
+	{
+		const FarmWorker * worker = &farm->workers_[i];
+		printf("%-8u %8" PRIu64 " %8" PRIu64 " %16" PRIu64 " %10.3f %16.0f\n", i, worker->jobsRun_, worker->stolen_, worker->instructions_,
+			worker->busySecs_, worker->busySecs_ > 0.0 ? worker->instructions_ / worker->busySecs_ : 0.0);
+	}
+
+	printf("\nJobs: %u on %u workers (%s engine), %u halted, %u not run\n", farm->numJobs_, farm->numWorkers_,
+		farm->mode_ == FARM_LOCKSTEP ? "lockstep" : engineName(farm->engine_), halted, *notRun);
+	printf("Instructions: %" PRIu64 " in %.3f s\n", total, wallSecs);
+	printf("Aggregate instructions/second: %.0f (%.0f per worker)\n", wallSecs > 0.0 ? total / wallSecs : 0.0,
+		wallSecs > 0.0 ? total / wallSecs / farm->numWorkers_ : 0.0);
+
+	if (farm->mode_ == FARM_LOCKSTEP)
+	{
+		LockstepStats stats = {};
+		for (uint32_t i = 0; i < farm->numWorkers_; ++i)
+		{
+			const LockstepStats * worker = &farm->workers_[i].lockstep_;
+			stats.steps_ += worker->steps_;
+			stats.laneOps_ += worker->laneOps_;
+			stats.liveLanes_ += worker->liveLanes_;
+			stats.perLaneOps_ += worker->perLaneOps_;
+			stats.fallbackOps_ += worker->fallbackOps_;
+			stats.regroups_ += worker->regroups_;
+			stats.handedOff_ += worker->handedOff_;
+		}
+		printf("Groups: %u of up to %d jobs\n", farm->numGroups_, LOCKSTEP_LANES);
+		printLockstepStats(&stats);
+	}
+
+	return halted;
+}
+
+// A job's key change, in the order the host delivers them
+typedef struct FarmHostInput
+{
+	uint64_t frame_;
+	uint32_t job_;
+	uint8_t input_;
+} FarmHostInput;
+
+/**
+@name:		compareHostInputs
+@purpose:	qsort order for host inputs: by frame, then job, then the job's own order
+@param:		const void *, const void *
+@return:	int
+*/
+static int compareHostInputs(const void * a, const void * b)
+{
+	const FarmHostInput * left = static_cast<const FarmHostInput *>(a);
+	const FarmHostInput * right = static_cast<const FarmHostInput *>(b);
+
+	if (left->frame_ != right->frame_)
+		return left->frame_ < right->frame_ ? -1 : 1;
+	if (left->job_ != right->job_)
+		return left->job_ < right->job_ ? -1 : 1;
+	return (int)left->input_ - (int)right->input_;
+}
+
+/**
+@name:		printMemory
+@purpose:	Prints how much memory the host's instances' address spaces take: the shared ROM
+			images plus each instance's own pages, against a full copy per instance
+@param:		const Host *
+@return:	void
+*/
+static void printMemory(const Host * host)
+{
+	uint64_t privatePages = 0;
+	for (uint32_t i = 0; i < host->numTasks_; ++i)
+		for (uint16_t bits = host->tasks_[i].chip_->privatePages_; bits != 0; bits &= bits - 1)
+			++privatePages;
+
+	size_t shared = sharedMemBytes();
+	printf("Memory: %.1f KB shared ROM images + %" PRIu64 " own pages (%.1f KB), against %.1f KB unshared\n",
+		shared / 1024.0, privatePages, privatePages * MEM_PAGE_SIZE / 1024.0, (double)host->numTasks_ * MEMSIZE / 1024.0);
+}
+
+/**
+@name:		runHosted
+@purpose:	Runs every job as a task on the cooperative host, a frame at a time, delivering
+			each input as a key event when its frame begins, and reports the results and how
+			much of the time tasks spent parked. Returns the number of jobs that halted, or -1
+			if out of memory.
+@param:		Farm *, uint32_t
+@return:	int
+*/
+static int runHosted(Farm * farm, uint32_t threads)
+{
+	static Host host;
+	static ChipArena arena;
+	if (!initChipArena(&arena, farm->numJobs_, farm->hugePages_))
+		return -1;
+
+	uint32_t numInputs = 0;
+	for (uint32_t i = 0; i < farm->numJobs_; ++i)
+		numInputs += farm->jobs_[i].numInputs_;
+	FarmHostInput * inputs = static_cast<FarmHostInput *>(malloc((numInputs + 1) * sizeof(FarmHostInput)));
+
+	if (inputs == NULL || !initHost(&host, farm->numJobs_, farm->engine_, threads))
+	{
+		fprintf(stderr, "Out of memory for %u jobs\n", farm->numJobs_);
+		free(inputs);
+		releaseChipArena(&arena);
+		return -1;
+	}
+
+	// one instance per job, back to back in the arena
+	numInputs = 0;
+	for (uint32_t i = 0; i < farm->numJobs_; ++i)
+	{
+		const FarmJob * job = &farm->jobs_[i];
+		Chip8 * chip = allocChip(&arena);
+		startJob(farm, job, chip);
+		addHostTask(&host, chip, job->cycles_);
+
+		for (uint8_t j = 0; j < job->numInputs_; ++j)
+		{
+			inputs[numInputs].frame_ = job->inputs_[j].frame_;
+			inputs[numInputs].job_ = i;
+			inputs[numInputs].input_ = j;
+			++numInputs;
+		}
+	}
+	qsort(inputs, numInputs, sizeof(FarmHostInput), compareHostInputs);
+
+	// task i is job i, and frame F of the host is frame F of every job
+	auto start = std::chrono::steady_clock::now();
+	uint32_t next = 0;
+	do
+	{
+		for (; next < numInputs && inputs[next].frame_ <= host.frame_; ++next)
+			hostKeys(&host, inputs[next].job_, farm->jobs_[inputs[next].job_].inputs_[inputs[next].input_].mask_);
+	} while (runHostFrame(&host));
+	auto end = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < farm->numJobs_; ++i)
+		finishJob(&farm->jobs_[i], host.tasks_[i].chip_);
+
+	uint64_t total;
+	uint32_t notRun;
+	uint32_t halted = printJobResults(farm, &total, &notRun);
+	double wallSecs = std::chrono::duration<double>(end - start).count();
+
+	printf("\nJobs: %u as host tasks (%s engine), %u halted\n", farm->numJobs_, engineName(farm->engine_), halted);
+	printf("Instructions: %" PRIu64 " in %.3f s, %.0f/second\n", total, wallSecs, wallSecs > 0.0 ? total / wallSecs : 0.0);
+	printf("Instances: %u of %zu bytes in a %.1f MB arena on %s\n", farm->numJobs_, sizeof(Chip8),
+		arena.bytes_ / (1024.0 * 1024.0), arenaPagesName(arena.pages_));
+	printMemory(&host);
+	printHostStats(&host);
+
+	for (uint32_t i = 0; i < farm->numJobs_; ++i)
+	{
+		releaseBlockCache(host.tasks_[i].chip_);
+		releaseJit(host.tasks_[i].chip_);
+		releaseMemPages(host.tasks_[i].chip_);
+	}
+	releaseHost(&host);
+	releaseChipArena(&arena);
+	free(inputs);
+	return (int)halted;
+}
+
+/**
+@name:		openFarmState
+@purpose:	Opens the save state every job starts from, and checks it was saved from the ROM
+			of every job. Host tasks must start at power-on, so it cannot be used with
+			FARM_HOST. Returns false and prints why if it is unusable.
+@param:		Farm *, const char *
+@return:	bool
+*/
+static bool openFarmState(Farm * farm, const char * statePath)
+{
+	if (farm->mode_ == FARM_HOST)
+	{
+		fprintf(stderr, "Host tasks start at power-on; a save state cannot be used with --host.\n");
+		return false;
+	}
+	if (!openSaveState(&farm->state_, statePath))
+		return false;
+
+	for (uint16_t i = 0; i < farm->numRoms_; ++i)
+		if (!saveStateMatches(&farm->state_, hashRom(farm->roms_[i].data_, farm->roms_[i].size_), farm->roms_[i].size_))
+		{
+			fprintf(stderr, "%s was not saved from %s.\n", statePath, farm->roms_[i].path_);
+			closeSaveState(&farm->state_);
+			return false;
+		}
+
+	printf("Starting every job from %s, at frame %" PRIu64 "\n", statePath, farm->state_.state_->frameCount_);
+	return true;
+}
+
+/**
+@name:		runFarm
+@purpose:	Runs every job in a job list to completion on a pool of worker threads, one per core
+			unless threads is set, and reports results and throughput. cycles and seed are the
+			defaults for lines that leave them out. FARM_LOCKSTEP runs jobs of the same ROM
+			together on the lockstep engine instead of engine; FARM_HOST runs every job on the
+			cooperative host instead of the pool. hugePages puts the instances' arenas on huge
+			pages where the system allows. With statePath, every job starts from that save
+			state instead of power-on; cycle counts and input frames still count from
+			power-on. Returns the process exit code: 1 if the list or state is unusable, a
+			worker could not start, or any job halted or was not run.
+@param:		const char *, uint64_t, uint32_t, Engine, bool, uint32_t, uint32_t, uint32_t, FarmMode, bool, const char *
+@return:	int
+*/
+int runFarm(const char * listPath, uint64_t cycles, uint32_t clockHz, Engine engine, bool clipSprites, uint32_t seed, uint32_t repeat, uint32_t threads, FarmMode mode, bool hugePages, const char * statePath)
+{
+	static Farm farm;
+	farm.clockHz_ = clockHz;
+	farm.engine_ = engine;
+	farm.clipSprites_ = clipSprites;
+	farm.mode_ = mode;
+	farm.hugePages_ = hugePages;
+
+	farm.roms_ = static_cast<FarmRom *>(malloc(FARM_MAX_ROMS * sizeof(FarmRom)));
+	if (farm.roms_ == NULL || !loadJobs(&farm, listPath, cycles, seed, repeat > 0 ? repeat : 1) || !groupJobs(&farm))
+		return 1;
+	if (statePath != NULL && !openFarmState(&farm, statePath))
+		return 1;
+
+	if (mode == FARM_HOST)
+	{
+		int halted = runHosted(&farm, threads);
+		closeSaveState(&farm.state_);
+		free(farm.groups_);
+		free(farm.jobs_);
+		free(farm.roms_);
+		return halted != 0 ? 1 : 0;
+	}
+
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	if (threads > FARM_MAX_WORKERS)
+		threads = FARM_MAX_WORKERS;
+	if (threads > farm.numGroups_)
+		threads = farm.numGroups_;
+
+	farm.numWorkers_ = threads;
+	farm.workers_ = new FarmWorker[threads];
+
+	// deal the jobs out round-robin; stealing evens out whatever that gets wrong
+	for (uint32_t w = 0; w < threads; ++w)
+	{
+		FarmWorker * worker = &farm.workers_[w];
+		worker->groups_ = static_cast<uint32_t *>(malloc((farm.numGroups_ / threads + 1) * sizeof(uint32_t)));
+		worker->head_ = worker->tail_ = 0;
+		worker->instructions_ = worker->jobsRun_ = worker->stolen_ = 0;
+		worker->busySecs_ = 0.0;
+		worker->lockstep_ = {};
+	}
+
+	// pushed in reverse, so each worker's own groups run in list order
+	for (uint32_t i = farm.numGroups_; i-- > 0;)
+	{
+		FarmWorker * worker = &farm.workers_[i % threads];
+		worker->groups_[worker->tail_++] = i;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t w = 0; w < threads; ++w)
+		farm.workers_[w].thread_ = std::thread(workerMain, &farm, w);
+	for (uint32_t w = 0; w < threads; ++w)
+		farm.workers_[w].thread_.join();
+	auto end = std::chrono::steady_clock::now();
+
+	uint32_t notRun;
+	uint32_t halted = printFarmResults(&farm, std::chrono::duration<double>(end - start).count(), &notRun);
+	if (farm.failedWorkers_ > 0)
+		fprintf(stderr, "%u of %u workers could not start; %u jobs not run\n", farm.failedWorkers_.load(), threads, notRun);
+
+	for (uint32_t w = 0; w < threads; ++w)
+		free(farm.workers_[w].groups_);
+	delete[] farm.workers_;
+	closeSaveState(&farm.state_);
+	free(farm.groups_);
+	free(farm.jobs_);
+	free(farm.roms_);
+
+	return halted != 0 || notRun != 0 || farm.failedWorkers_ > 0 ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+/**	@file farm.hpp
+@note Developed for C++17/vc14.1
+@brief Regression farm: runs many independent Chip8 instances across all cores on a
+	   work-stealing thread pool
+*/
+
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "chip8.hpp"
+#include "engine.hpp"
+#include "host.hpp"
+#include "lockstep.hpp"
+
+#define FARM_MAX_ROMS 256			// distinct ROM files in one job list
+#define FARM_MAX_INPUTS 32			// key changes per job
+#define FARM_MAX_WORKERS 256
+#define FARM_PATH_SIZE 260
+
+// The key mask to hold from an emulated frame onwards
+typedef struct FarmInput
+{
+	uint64_t frame_;
+	uint16_t mask_;
+} FarmInput;
+
+// A ROM file, read once however many jobs use it
+typedef struct FarmRom
+{
+	char path_[FARM_PATH_SIZE];
+	uint8_t data_[ROMSIZE];
+	uint32_t size_;
+} FarmRom;
+
+typedef struct FarmJob
+{
+	uint16_t rom_;
+	uint32_t seed_;
+	uint64_t cycles_;
+	uint8_t numInputs_;
+	FarmInput inputs_[FARM_MAX_INPUTS];
+
+	// results, written by whichever worker ran the job
+	uint64_t done_;
+	uint64_t hash_;
+	uint16_t progCounter_;
+	bool halted_;
+	bool ran_;				// false if no worker got to it
+	uint16_t worker_;
+} FarmJob;
+
+enum FarmMode : uint8_t
+{
+	FARM_STEAL,			// one job at a time per worker; idle workers steal
+	FARM_LOCKSTEP,		// jobs of one ROM in lockstep groups, dealt out the same way
+	FARM_HOST			// every job a task on the cooperative host, parked while idle
+};
+
+// Jobs run together: up to LOCKSTEP_LANES jobs of one ROM with --lockstep, otherwise one
+typedef struct FarmGroup
+{
+	uint32_t jobs_[LOCKSTEP_LANES];
+	uint32_t count_;
+} FarmGroup;
+
+/*
+Each worker owns a deque of group indices, groups_[head_, tail_). The owner takes from the
+tail; a worker whose deque is empty steals from the head of another's. Groups never spawn
+more groups, so a worker is done once every deque is empty.
+*/
+typedef struct FarmWorker
+{
+	std::mutex lock_;
+	uint32_t * groups_;
+	uint32_t head_;
+	uint32_t tail_;
+	std::thread thread_;
+
+	// stats
+	uint64_t instructions_;
+	uint64_t jobsRun_;
+	uint64_t stolen_;
+	double busySecs_;
+	LockstepStats lockstep_;
+} FarmWorker;
+
+int runFarm(const char * listPath, uint64_t cycles, uint32_t clockHz, Engine engine, bool clipSprites, uint32_t seed, uint32_t repeat, uint32_t threads, FarmMode mode, bool hugePages, const char * statePath);
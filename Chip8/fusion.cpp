@@ -0,0 +1,104 @@
+/**	@file fusion.cpp
+@note Developed for C++17/vc14.1
+@brief Decode-time pass that rewrites a block's opcodes into super-instructions
+*/
+
+#include "fusion.hpp"
+
+static const char * const fusionPatterns[FUSION_COUNT] = {
+#define FUSION_PATTERN(fused, pattern) pattern,
+	FOR_EACH_FUSION(FUSION_PATTERN)
+#undef FUSION_PATTERN
+};
+
+/**
+@name:		fusePair
+@purpose:	Combines two adjacent ops into a super-instruction. Returns false if they are not a known idiom.
+@param:		const DecodedOp *, const DecodedOp *, DecodedOp *
+@return:	bool
+*/
+static bool fusePair(const DecodedOp * first, const DecodedOp * second, DecodedOp * fused)
+{
+	if (first->instr_ == INSTR_SET_INDEX_TO_ADDR_VAL && second->instr_ == INSTR_DRAW_VX_VY_N)
+	{
+		*fused = *second;
+		fused->instr_ = fusedInstr(FUSION_INDEX_DRAW);
+		fused->nnn_ = first->nnn_;
+		return true;
+	}
+
+	if (first->instr_ == INSTR_SET_VX_TO_ADDR && second->instr_ == INSTR_SET_VX_TO_ADDR)
+	{
+		*fused = *first;
+		fused->instr_ = fusedInstr(FUSION_LOAD_PAIR);
+		fused->y_ = second->x_;
+		fused->nnn_ = second->nn_;
+		return true;
+	}
+
+	if (first->instr_ == INSTR_SET_INDEX_TO_ADDR_VAL && second->instr_ == INSTR_FILL_V0_TO_VX_AT_IDX)
+	{
+		*fused = *second;
+		fused->instr_ = fusedInstr(FUSION_INDEX_FILL);
+		fused->nnn_ = first->nnn_;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+@name:		fuseOps
+@purpose:	Writes the fused form of a block's ops to fused and returns its length. A block
+			ending in 7XNN; 3XNN followed in memory by 1NNN (nextOpCode) becomes a counting-loop
+			step, and usesNext is set since that jump is then part of the block. sites counts
+			each fusion made, per kind.
+@param:		const DecodedOp *, uint8_t, uint16_t, DecodedOp *, bool *, uint64_t *
+@return:	uint8_t
+*/
+uint8_t fuseOps(const DecodedOp * ops, uint8_t length, uint16_t nextOpCode, DecodedOp * fused, bool * usesNext, uint64_t * sites)
+{
+	uint8_t numFused = 0;
+	*usesNext = false;
+
+	for (uint8_t i = 0; i < length; ++i)
+	{
+		const DecodedOp * op = &ops[i];
+
+		if (i + 2 == length && op[0].instr_ == INSTR_SET_VX_VX_PLUS_ADDR && op[1].instr_ == INSTR_VX_SKIP_EQUAL_ADDR
+			&& op[0].x_ == op[1].x_ && decodeOp(nextOpCode).instr_ == INSTR_GOTO_ADDR)
+		{
+			DecodedOp * loop = &fused[numFused++];
+			*loop = op[0];
+			loop->instr_ = fusedInstr(FUSION_COUNT_LOOP);
+			loop->y_ = op[1].nn_;
+			loop->nnn_ = decodeOp(nextOpCode).nnn_;
+			*usesNext = true;
+			++sites[FUSION_COUNT_LOOP];
+			break;
+		}
+
+		if (i + 1 < length && fusePair(&op[0], &op[1], &fused[numFused]))
+		{
+			++sites[fused[numFused].instr_ - INSTR_COUNT];
+			++numFused;
+			++i;
+			continue;
+		}
+
+		fused[numFused++] = *op;
+	}
+
+	return numFused;
+}
+
+/**
+@name:		fusionPattern
+@purpose:	Returns the opcode pattern a super-instruction replaces, for reports
+@param:		Fusion
+@return:	const char *
+*/
+const char * fusionPattern(Fusion fusion)
+{
+	return fusion < FUSION_COUNT ? fusionPatterns[fusion] : "?";
+}
@@ -0,0 +1,97 @@
+/**	@file fusion.hpp
+@note Developed for C++17/vc14.1
+@brief Macro-op fusion: common opcode idioms run as one super-instruction with the same
+	   architectural effect as running them one at a time
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+#include "opcodes.hpp"
+
+// X(fused, pattern) - one entry per super-instruction
+#define FOR_EACH_FUSION(X) \
+	X(INDEX_DRAW,		"ANNN; DXYN") \
+	X(LOAD_PAIR,		"6XNN; 6YNN") \
+	X(INDEX_FILL,		"ANNN; FX65") \
+	X(COUNT_LOOP,		"7XNN; 3XNN; 1NNN")
+
+enum Fusion : uint8_t
+{
+#define FUSION_ENUM(fused, pattern) FUSION_##fused,
+	FOR_EACH_FUSION(FUSION_ENUM)
+#undef FUSION_ENUM
+	FUSION_COUNT
+};
+
+/**
+@name:		fusedInstr
+@purpose:	Returns the DecodedOp::instr_ value of a super-instruction, numbered after the plain instructions
+@param:		Fusion
+@return:	uint8_t
+*/
+constexpr uint8_t fusedInstr(Fusion fusion)
+{
+	return static_cast<uint8_t>(INSTR_COUNT + fusion);
+}
+
+/*
+Operand layout of each super-instruction:
+	INDEX_DRAW	nnn_ = ANNN address, x_/y_/nn_ from DXYN
+	LOAD_PAIR	x_/nn_ from 6XNN, y_ = Y and nnn_ = NN from 6YNN
+	INDEX_FILL	nnn_ = ANNN address, x_ from FX65
+	COUNT_LOOP	x_/nn_ from 7XNN, y_ = NN from 3XNN, nnn_ = 1NNN target
+*/
+
+uint8_t fuseOps(const DecodedOp * ops, uint8_t length, uint16_t nextOpCode, DecodedOp * fused, bool * usesNext, uint64_t * sites);
+const char * fusionPattern(Fusion fusion);
+
+/**
+@name:		executeFused
+@purpose:	Runs one entry of a fused op list and returns how many opcodes it retired. Plain
+			instructions go through executeOp.
+@param:		Chip8 *, const DecodedOp *, uint64_t *
+@return:	uint8_t
+*/
+inline uint8_t executeFused(Chip8 * chip, const DecodedOp * op, uint64_t * runs)
+{
+	switch (op->instr_)
+	{
+		case fusedInstr(FUSION_INDEX_DRAW):
+			++runs[FUSION_INDEX_DRAW];
+			chip->regIndex_ = op->nnn_;
+			chip->progCounter_ += 2;
+			opDrawVxVyN(chip, op);
+			return 2;
+
+		case fusedInstr(FUSION_LOAD_PAIR):
+			++runs[FUSION_LOAD_PAIR];
+			chip->vReg_[op->x_] = op->nn_;
+			chip->vReg_[op->y_] = static_cast<uint8_t>(op->nnn_);
+			chip->progCounter_ += 4;
+			return 2;
+
+		case fusedInstr(FUSION_INDEX_FILL):
+			++runs[FUSION_INDEX_FILL];
+			chip->regIndex_ = op->nnn_;
+			chip->progCounter_ += 2;
+			opFillV0ToVxAtIdx(chip, op);
+			return 2;
+
+		case fusedInstr(FUSION_COUNT_LOOP):
+			++runs[FUSION_COUNT_LOOP];
+			chip->vReg_[op->x_] += op->nn_;
+			if (chip->vReg_[op->x_] == op->y_)
+			{
+				// the skip hops over the jump, which never runs
+				chip->progCounter_ += 6;
+				return 2;
+			}
+			chip->progCounter_ = op->nnn_;
+			return 3;
+
+		default:
+			executeOp(chip, op);
+			return 1;
+	}
+}
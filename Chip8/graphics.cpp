@@ -7,10 +7,17 @@
 */
 
 #include <chrono>
+#include <cinttypes>
+#include <cstring>
 #include "graphics.hpp"
 
-static const short NUM_ROWS = 32;
-static const short NUM_COLS = 64;
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+static const short NUM_ROWS = SCREEN_HEIGHT;
+static const short NUM_COLS = SCREEN_WIDTH;
 static const short WIN_WIDTH = 1024;
 static const short WIN_HEIGHT = 512;
 static const short RECT_SIZE = 16;
@@ -19,6 +26,17 @@ static const short OFFSET = 1;
 static const char keys[] = "1234QWERASDFZXCV";
 static std::chrono::time_point<std::chrono::system_clock> drawDelay;
 
+/**
+@name:		steadyNanos
+@purpose:	Returns the steady clock in nanoseconds, for timestamps shared between threads
+@param:		void
+@return:	int64_t
+*/
+static int64_t steadyNanos()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 /**
 @name:		getFlippedY
 @purpose:	SIGIL's y-axis is the reverse of most GUI y-axes. This reverses the y-coordinate around.
@@ -32,11 +50,12 @@ static unsigned getFlippedY(unsigned y)
 
 /**
 @name:		setupScreen
-@purpose:	Prepares the screen and input keys
-@param:		GSI *, Chip8 *
+@purpose:	Prepares the screen and input keys. With a filter, also creates the texture that
+			rasterized frames are uploaded to.
+@param:		GSI *, Chip8 *, const RasterFilter *
 @return:	void
 */
-void setupScreen(GSI * gi, Chip8 * chip)
+void setupScreen(GSI * gi, Chip8 * chip, const RasterFilter * filter)
 {
 	gi->chip_ = chip;
 
@@ -44,12 +63,49 @@ void setupScreen(GSI * gi, Chip8 * chip)
 	slSetBackColor(0, 0, 0);
 	slSetForeColor(1, 1, 1, 1);
 
+	// the framebuffer is left alone: initChip cleared it, and a loaded save state filled it
+	gi->keyMask_.store(0);
+	gi->inputTime_.store(0);
+	gi->latchedInputTime_ = 0;
+	gi->shownInputTime_ = 0;
+	gi->latencySamples_ = 0;
+	gi->latencySumMs_ = 0.0;
+	gi->latencyMinMs_ = 0.0;
+	gi->latencyMaxMs_ = 0.0;
+	gi->inDebug_.store(false);
+	gi->printInst_.store(false);
+	gi->dumpRegs_.store(false);
+	gi->goNext_.store(false);
+	gi->turbo_.store(false);
+	gi->rewind_.store(false);
+	gi->frameSkip_ = DEFAULT_FRAME_SKIP;
+
+	initTripleBuffer(&gi->frames_);
 	for (int y = 0; y < NUM_ROWS; ++y)
-		for (int x = 0; x < NUM_COLS; ++x)
-			gi->gBuffer_[x][y] = 0;
+	{
+		gi->shownRows_[y] = 0;
+		gi->numRuns_[y] = 0;
+	}
 
-	for(int i = 0; i < 16; ++i)
-		gi->keys_[i] = 0;
+	gi->raster_ = NULL;
+	gi->texture_ = 0;
+	if (filter != NULL)
+	{
+		static Raster raster;
+		initRaster(&raster, *filter);
+		raster.bottomUp_ = true;
+		rasterize(&raster, gi->shownRows_);
+		gi->raster_ = &raster;
+
+		// SIGIL draws sprites from plain GL texture names, so the texture is made here
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, RASTER_WIDTH, RASTER_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, raster.pixels_);
+		gi->texture_ = texture;
+	}
 
 	drawDelay = std::chrono::system_clock::now();
 }
@@ -62,20 +118,7 @@ void setupScreen(GSI * gi, Chip8 * chip)
 */
 void clearScreen(GSI * gsi)
 {
-	for (int y = 0; y < NUM_ROWS; ++y)
-		for (int x = 0; x < NUM_COLS; ++x)
-			gsi->gBuffer_[x][y] = 0;
-}
-
-/**
-@name:		drawSprite
-@purpose:	Flips the bit at a coordinate in the buffer. Returns true if that bit is now 0.
-@param:		GSI *, uint16_t, uint16_t, uint16_t
-@return:	bool
-*/
-bool drawSprite(GSI * gsi, uint16_t xCoord, uint16_t yCoord, uint16_t height)
-{
-	return (gsi->gBuffer_[xCoord][yCoord] ^= 1) == 0;
+	clearFrame(gsi->chip_);
 }
 
 
@@ -103,9 +146,72 @@ void stopSound(GSI * gsi)
 		slSoundStop(gsi->loopSoundId_);*/
 }
 
+/**
+@name:		buildRuns
+@purpose:	Splits a framebuffer row into runs of lit pixels. Returns the number of runs.
+@param:		uint64_t, SpanRun *
+@return:	uint8_t
+*/
+static uint8_t buildRuns(uint64_t row, SpanRun * runs)
+{
+	uint8_t count = 0;
+	int x = 0;
+
+	while (x < NUM_COLS)
+	{
+		if (((row >> (NUM_COLS - 1 - x)) & 1) == 0)
+		{
+			++x;
+			continue;
+		}
+
+		int start = x;
+		while (x < NUM_COLS && ((row >> (NUM_COLS - 1 - x)) & 1) != 0)
+			++x;
+
+		runs[count].start_ = static_cast<uint8_t>(start);
+		runs[count].length_ = static_cast<uint8_t>(x - start);
+		++count;
+	}
+
+	return count;
+}
+
+/**
+@name:		presentScreen
+@purpose:	Draws the last frame taken: the rasterized texture as one sprite, or one rectangle per run
+@param:		GSI *
+@return:	void
+*/
+static void presentScreen(GSI * gsi)
+{
+	if (gsi->raster_ != NULL)
+	{
+		slSprite(gsi->texture_, WIN_WIDTH / 2, WIN_HEIGHT / 2, WIN_WIDTH, WIN_HEIGHT);
+		slRender();
+		drawDelay = std::chrono::system_clock::now();
+		return;
+	}
+
+	for (int y = 0; y < NUM_ROWS; ++y)
+	{
+		for (int i = 0; i < gsi->numRuns_[y]; ++i)
+		{
+			const SpanRun * run = &gsi->runs_[y][i];
+			slRectangleFill(run->start_ * RECT_SIZE + run->length_ * HALF_RECT_SIZE, getFlippedY(y * RECT_SIZE + HALF_RECT_SIZE),
+				run->length_ * RECT_SIZE, RECT_SIZE);
+		}
+	}
+
+	slRender();
+	drawDelay = std::chrono::system_clock::now();
+}
+
 /**
 @name:		drawScreen
-@purpose:	Draws the buffer to the screen
+@purpose:	Presents the latest frame the CPU thread published, if there is a new one. Runs
+			are only rebuilt for rows that differ from the frame drawn before; with a raster,
+			the frame is rasterized and uploaded in one go. Render thread only.
 @param:		GSI *
 @return:	void
 */
@@ -114,120 +220,203 @@ void drawScreen(GSI * gsi)
 	auto now = std::chrono::system_clock::now();
 	uint32_t mSecs = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(now - drawDelay).count();
 
+	const Frame * frame = acquireFrame(&gsi->frames_);
+	if (frame != NULL && gsi->raster_ != NULL)
+	{
+		rasterize(gsi->raster_, frame->rows_);
+		glBindTexture(GL_TEXTURE_2D, gsi->texture_);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, RASTER_WIDTH, RASTER_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, gsi->raster_->pixels_);
+	}
+	else if (frame != NULL)
+	{
+		for (int y = 0; y < NUM_ROWS; ++y)
+		{
+			if (frame->rows_[y] != gsi->shownRows_[y])
+			{
+				gsi->shownRows_[y] = frame->rows_[y];
+				gsi->numRuns_[y] = buildRuns(frame->rows_[y], gsi->runs_[y]);
+			}
+		}
+	}
+
 	// Due to the fact that slRender() also handles inputs, many
 	// endgame screens can actually freeze SIGIL.
-	// slRender() is called if no draw command has been issued for 750 milliseconds.
-	if (!gsi->chip_->drawFlag_ && mSecs < 750)
+	// slRender() is called if nothing has been presented for 750 milliseconds,
+	// and all the time in debug mode so the step keys are read.
+	if (frame == NULL && mSecs < 750 && !gsi->inDebug_.load())
 		return;
 
-	for (int y = 0; y < NUM_ROWS; ++y)
-		for (int x = 0; x < NUM_COLS; ++x)
-			if (gsi->gBuffer_[x][y] == 1)
-				slRectangleFill(x * RECT_SIZE + HALF_RECT_SIZE, getFlippedY(y * RECT_SIZE + HALF_RECT_SIZE), RECT_SIZE, RECT_SIZE);
+	presentScreen(gsi);
 
-	slRender();
-	gsi->chip_->drawFlag_ = false;
-	drawDelay = std::chrono::system_clock::now();
+	// the first frame shown since a key change was latched
+	if (frame != NULL && frame->inputTime_ != 0 && frame->inputTime_ != gsi->shownInputTime_)
+	{
+		double ms = (steadyNanos() - frame->inputTime_) / 1e6;
+		gsi->shownInputTime_ = frame->inputTime_;
+		if (gsi->latencySamples_ == 0 || ms < gsi->latencyMinMs_)
+			gsi->latencyMinMs_ = ms;
+		if (ms > gsi->latencyMaxMs_)
+			gsi->latencyMaxMs_ = ms;
+		gsi->latencySumMs_ += ms;
+		++gsi->latencySamples_;
+	}
+}
+
+/**
+@name:		publishScreen
+@purpose:	Copies the framebuffer into the triple buffer for the render thread, if any row
+			changed since the last copy. CPU thread only.
+@param:		GSI *
+@return:	void
+*/
+void publishScreen(GSI * gsi)
+{
+	Chip8 * chip = gsi->chip_;
+	if (chip->dirtyRows_ == 0)
+		return;
+
+	Frame * frame = backFrame(&gsi->frames_);
+	memcpy(frame->rows_, chip->gBuffer_, sizeof(frame->rows_));
+	frame->frameCount_ = chip->frameCount_;
+	frame->inputTime_ = gsi->latchedInputTime_;
+	chip->dirtyRows_ = 0;
+	chip->drawFlag_ = false;
+
+	publishFrame(&gsi->frames_);
+}
+
+/**
+@name:		toggle
+@purpose:	Turns a debug flag on or off when its key is held, printing the change
+@param:		std::atomic<bool> *, bool, const char *
+@return:	void
+*/
+static void toggle(std::atomic<bool> * flag, bool on, const char * name)
+{
+	if (flag->load() != on)
+	{
+		flag->store(on);
+		printf("%s %s.\n", name, on ? "ON" : "OFF");
+	}
 }
 
 /**
 @name:		getInput
-@purpose:	Detects if any input keys are currently pressed
+@purpose:	Detects if any input keys are currently pressed, for latchInput to pick up, and
+			timestamps changes. Render thread only.
 @param:		GSI *
 @return:	void
 */
 void getInput(GSI * gsi)
 {
-	memset(gsi->chip_->key_, 0, 16);	// clear the key buffer
-
+	uint16_t mask = 0;
 	for (int i = 0; i < 16; ++i)
 		if (slGetKey(keys[i]) != 0)
-			gsi->chip_->key_[i] = 1;
+			mask |= 1 << i;
 
-	do
+	if (mask != gsi->keyMask_.load(std::memory_order_relaxed))
 	{
-		// debug keys
-		if (slGetKey('B') != 0)
-		{
-			if (gsi->chip_->inDebug_ == false)
-			{
-				gsi->chip_->inDebug_ = true;
-				printf("Debug Mode ON.\n");
-			}
-		}
+		// timestamp first, so a CPU thread that sees the new mask also sees its time
+		gsi->inputTime_.store(steadyNanos(), std::memory_order_relaxed);
+		gsi->keyMask_.store(mask, std::memory_order_release);
+	}
 
-		if (slGetKey('G') != 0)
-		{
-			if (gsi->chip_->inDebug_ == true)
-			{
-				gsi->chip_->inDebug_ = false;
-				printf("Debug Mode OFF.\n");
-			}
-		}
+	// debug keys
+	if (slGetKey('B') != 0)
+		toggle(&gsi->inDebug_, true, "Debug Mode");
 
-		if (slGetKey('P') != 0)
-		{
-			if (gsi->chip_->printInst_ == false)
-			{
-				gsi->chip_->printInst_ = true;
-				printf("Print-Instruction Mode ON.\n");
-			}
-		}
+	if (slGetKey('G') != 0)
+		toggle(&gsi->inDebug_, false, "Debug Mode");
 
-		if (slGetKey('L') != 0)
-		{
-			if (gsi->chip_->printInst_ == true)
-			{
-				gsi->chip_->printInst_ = false;
-				printf("Print-Instruction Mode OFF.\n");
-			}
-		}
+	if (slGetKey('P') != 0)
+		toggle(&gsi->printInst_, true, "Print-Instruction Mode");
 
-		if (slGetKey('O') != 0)
-		{
-			if (gsi->chip_->dumpRegs_ == false)
-			{
-				gsi->chip_->dumpRegs_ = true;
-				printf("Register-Dump Mode ON.\n");
-			}
-		}
+	if (slGetKey('L') != 0)
+		toggle(&gsi->printInst_, false, "Print-Instruction Mode");
 
-		if (slGetKey('K') != 0)
-		{
-			if (gsi->chip_->dumpRegs_ == true)
-			{
-				gsi->chip_->dumpRegs_ = false;
-				printf("Register-Dump Mode OFF.\n");
-			}
-		}
+	if (slGetKey('O') != 0)
+		toggle(&gsi->dumpRegs_, true, "Register-Dump Mode");
 
-		if (slGetKey('N') != 0 && gsi->chip_->inDebug_)
-			if (gsi->chip_->goNext_ == false)
-				gsi->chip_->goNext_ = true;
-		
-		// Same problem as before: we need to call slRender() to get
-		// key inputs.
-		if (gsi->chip_->inDebug_)
-		{
-			bool draw = gsi->chip_->drawFlag_;
-			gsi->chip_->drawFlag_ = true;
-			drawScreen(gsi);
-			gsi->chip_->drawFlag_ = draw;
-		}
-	} 
-	while (!gsi->chip_->goNext_ && gsi->chip_->inDebug_);
+	if (slGetKey('K') != 0)
+		toggle(&gsi->dumpRegs_, false, "Register-Dump Mode");
+
+	if (slGetKey('T') != 0)
+		toggle(&gsi->turbo_, true, "Turbo Mode");
+
+	if (slGetKey('Y') != 0)
+		toggle(&gsi->turbo_, false, "Turbo Mode");
+
+	if (slGetKey('N') != 0 && gsi->inDebug_.load())
+		gsi->goNext_.store(true);
+
+	// held, not toggled: rewinding stops as soon as the key is let go
+	gsi->rewind_.store(slGetKey(SL_KEY_BACKSPACE) != 0, std::memory_order_relaxed);
+}
+
+/**
+@name:		applyInput
+@purpose:	Hands the latest debug flags to the chip. Returns false while the debugger is paused
+			between steps. CPU thread only.
+@param:		GSI *
+@return:	bool
+*/
+bool applyInput(GSI * gsi)
+{
+	Chip8 * chip = gsi->chip_;
+	chip->inDebug_ = gsi->inDebug_.load();
+	chip->printInst_ = gsi->printInst_.load();
+	chip->dumpRegs_ = gsi->dumpRegs_.load();
+
+	if (!chip->inDebug_)
+		return true;
+
+	chip->goNext_ = gsi->goNext_.exchange(false);
+	return chip->goNext_;
+}
+
+/**
+@name:		latchInput
+@purpose:	Copies the keypad state into the chip's key mask. Called once per emulated frame, so
+			EX9E/EXA1/FX0A see the same keys for the whole frame. CPU thread only.
+@param:		GSI *
+@return:	void
+*/
+void latchInput(GSI * gsi)
+{
+	uint16_t mask = gsi->keyMask_.load(std::memory_order_acquire);
+	if (mask != gsi->chip_->keyMask_)
+		gsi->latchedInputTime_ = gsi->inputTime_.load(std::memory_order_relaxed);
+
+	setKeyMask(gsi->chip_, mask);
+}
+
+/**
+@name:		printFrameStats
+@purpose:	Prints how many frames the CPU thread published, and how many were presented or
+			dropped, then the input-to-visible latency
+@param:		GSI *
+@return:	void
+*/
+void printFrameStats(GSI * gsi)
+{
+	printf("Frames published: %" PRIu64 ", presented: %" PRIu64 ", dropped: %" PRIu64 "\n",
+		gsi->frames_.published_.load(), gsi->frames_.presented_.load(), gsi->frames_.dropped_.load());
+
+	if (gsi->latencySamples_ != 0)
+		printf("Input-to-visible latency: %.1f ms average, %.1f min, %.1f max (%" PRIu64 " key changes)\n",
+			gsi->latencySumMs_ / gsi->latencySamples_, gsi->latencyMinMs_, gsi->latencyMaxMs_, gsi->latencySamples_);
 }
 
 /**
 @name:		cleanUpGraphics
-@purpose:	Cleans up the screen before exiting the program
+@purpose:	Cleans up the screen before exiting the program. Call once the CPU thread has stopped.
 @param:		GSI *
 @return:	void
 */
 void cleanUpGraphics(GSI * gsi)
 {
-	gsi->chip_->drawFlag_ = true;
 	clearScreen(gsi);
+	publishScreen(gsi);
 	drawScreen(gsi);
 	stopSound(gsi);
 }
@@ -8,25 +8,71 @@
 
 #pragma once
 #include <sl.h>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include "chip8.hpp"
+#include "raster.hpp"
+#include "scheduler.hpp"
+#include "triplebuffer.hpp"
+
+// A horizontal run of lit pixels in one framebuffer row
+typedef struct SpanRun
+{
+	uint8_t start_;
+	uint8_t length_;
+} SpanRun;
 
 // GSI - Graphics, Sound, and Input
 typedef struct GSI
 {
-	uint8_t gBuffer_[64][32];
-	uint8_t keys_[16];
 	Chip8 * chip_;
 	int soundFileId_;
 	int loopSoundId_;
+
+	// input, written by the render thread and handed to the chip on the CPU thread by applyInput
+	std::atomic<uint16_t> keyMask_;
+	std::atomic<int64_t> inputTime_;	// steady_clock ns of the last change to keyMask_
+	std::atomic<bool> inDebug_;
+	std::atomic<bool> printInst_;
+	std::atomic<bool> dumpRegs_;
+	std::atomic<bool> goNext_;
+	std::atomic<bool> turbo_;		// unthrottled: no pacing, only every frameSkip_-th frame published
+	std::atomic<bool> rewind_;		// held: step back a frame each frame instead of running
+	uint32_t frameSkip_;
+
+	// frames published by the CPU thread, and what the render thread last drew
+	TripleBuffer frames_;
+	uint64_t shownRows_[SCREEN_HEIGHT];
+	uint8_t numRuns_[SCREEN_HEIGHT];
+	SpanRun runs_[SCREEN_HEIGHT][SCREEN_WIDTH / 2];
+
+	// input-to-visible latency: from a key change to the first frame presented after the
+	// CPU thread latched it
+	int64_t latchedInputTime_;		// CPU thread
+	int64_t shownInputTime_;		// render thread, from here on
+	uint64_t latencySamples_;
+	double latencySumMs_;
+	double latencyMinMs_;
+	double latencyMaxMs_;
+
+	// with --filter, frames are rasterized on the CPU and drawn as one texture instead of runs
+	Raster * raster_;
+	unsigned texture_;
 } GSI;
 
-void setupScreen(GSI * gi, Chip8 * chip);
+void setupScreen(GSI * gi, Chip8 * chip, const RasterFilter * filter);
 void clearScreen(GSI * gsi);
 void cleanUpGraphics(GSI * gsi);
-bool drawSprite(GSI * gsi, uint16_t xCoord, uint16_t yCoord, uint16_t height);
 void playSound(GSI * gsi);
 void stopSound(GSI * gsi);
+
+// render thread
 void drawScreen(GSI * gsi);
-void getInput(GSI * gsi);
\ No newline at end of file
+void getInput(GSI * gsi);
+void printFrameStats(GSI * gsi);
+
+// CPU thread
+bool applyInput(GSI * gsi);
+void latchInput(GSI * gsi);
+void publishScreen(GSI * gsi);
\ No newline at end of file
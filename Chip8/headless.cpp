@@ -0,0 +1,172 @@
+/**	@file headless.cpp
+@note Developed for C++17/vc14.1
+@brief Batch mode: runs a ROM flat out with no display and reports throughput
+*/
+
+#include <chrono>
+#include <cinttypes>
+#include "blockcache.hpp"
+#include "engine.hpp"
+#include "headless.hpp"
+#include "jit.hpp"
+#include "rewind.hpp"
+#include "savestate.hpp"
+
+/**
+@name:		checkRewind
+@purpose:	Steps a chip back through half its rewind history, times it, then replays to where
+			it was and checks it ends in the same state. Returns false if it does not.
+@param:		Rewind *, Chip8 *, Engine
+@return:	bool
+*/
+static bool checkRewind(Rewind * rewind, Chip8 * chip, Engine engine)
+{
+	uint64_t endCycles = chip->cycles_;
+	uint64_t endHash = hashFrame(chip);
+	uint16_t endPc = chip->progCounter_;
+
+	auto start = std::chrono::steady_clock::now();
+	uint32_t back = rewindFrames(rewind, chip, rewind->count_ / 2);
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	runEngine(chip, engine, endCycles - chip->cycles_);
+	bool same = chip->cycles_ == endCycles && chip->progCounter_ == endPc && hashFrame(chip) == endHash;
+	printf("Rewind: went back %u frames in %.3f ms and replayed them to %s state\n", back, secs * 1e3, same ? "the same" : "a different");
+	return same;
+}
+
+/**
+@name:		runHeadless
+@purpose:	Runs a ROM for a fixed number of cycles as fast as possible, then prints
+			instructions/second and a hash of the final framebuffer. Returns the process exit code.
+			clockHz only sets how emulated cycles map onto 60Hz timer ticks. If dumpPath is
+			set, the final frame is also rasterized with the given filter and saved there. If
+			recordPath is set, every emulated frame is recorded there, without drops. If
+			rewindBytes is set, every frame is kept in a rewind history of that size; at the
+			end the run steps back through half of it and replays to check it gets the same
+			state. A seed makes CXNN repeatable; without one it is seeded from the clock.
+			With loadStatePath the run starts from that save state, reseeded if a seed is
+			given, and runs the given number of cycles from there; with saveStatePath the end
+			state is saved.
+@param:		const char *, uint64_t, uint32_t, Engine, bool, const uint32_t *, const char *, RasterFilter, const char *, uint32_t, const char *, const char *
+@return:	int
+*/
+int runHeadless(const char * path, uint64_t cycles, uint32_t clockHz, Engine engine, bool clipSprites, const uint32_t * seed, const char * dumpPath, RasterFilter filter, const char * recordPath, uint32_t rewindBytes, const char * loadStatePath, const char * saveStatePath)
+{
+	static Recorder recorder;
+	static Rewind rewind;
+	static SaveFile state;
+	static Chip8 chip;
+
+	initChip(&chip);
+	setClockRate(&chip, clockHz);
+	chip.clipSprites_ = clipSprites;
+	if (seed != NULL)
+		seedRandom(&chip, *seed);
+	loadGame(&chip, path);
+
+	if (loadStatePath != NULL)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		if (!openSaveState(&state, loadStatePath) || !restoreSaveState(&chip, &state))
+			return 1;
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		if (seed != NULL)
+			seedRandom(&chip, *seed);
+		printf("State: %s, frame %" PRIu64 ", mapped and restored in %.1f us\n", loadStatePath, chip.frameCount_, secs * 1e6);
+	}
+
+	if (recordPath != NULL && !startRecording(&recorder, recordPath, true))
+	{
+		fprintf(stderr, "Could not open %s for recording\n", recordPath);
+		return 1;
+	}
+	if (rewindBytes != 0 && !initRewind(&rewind, rewindBytes))
+		return 1;
+
+	bool framed = recordPath != NULL || rewindBytes != 0;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t done = 0;
+	if (!framed)
+		done = runEngine(&chip, engine, cycles);
+
+	// recording: run a frame at a time so each one can be captured
+	while (framed && done < cycles && !chip.halted_)
+	{
+		uint64_t frame = chip.frameCount_;
+		uint64_t budget = chip.nextFrameCycle_ - chip.cycles_;
+		if (budget > cycles - done)
+			budget = cycles - done;
+
+		uint64_t ran = runEngine(&chip, engine, budget);
+		done += ran;
+		if (recordPath != NULL && chip.frameCount_ != frame)
+			recordFrame(&recorder, chip.gBuffer_, chip.frameCount_);
+		if (rewindBytes != 0 && chip.frameCount_ != frame)
+			recordRewind(&rewind, &chip);
+		if (ran < budget)
+			break;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double secs = std::chrono::duration<double>(end - start).count();
+	double ips = secs > 0.0 ? done / secs : 0.0;
+
+	printf("ROM: %s\n", path);
+	printf("Engine: %s\n", engineName(engine));
+	printf("Instructions: %" PRIu64 "\n", done);
+	printf("Time: %.6f s\n", secs);
+	printf("Instructions/second: %.0f\n", ips);
+	printf("Framebuffer hash: %.16" PRIx64 "\n", hashFrame(&chip));
+	printBlockStats(&chip);
+	printJitStats(&chip);
+
+	if (saveStatePath != NULL)
+	{
+		if (!writeSaveState(&chip, saveStatePath))
+			return 1;
+		printf("State: saved to %s at frame %" PRIu64 "\n", saveStatePath, chip.frameCount_);
+	}
+
+	if (recordPath != NULL && !stopRecording(&recorder))
+		return 1;
+
+	if (rewindBytes != 0)
+	{
+		bool same = checkRewind(&rewind, &chip, engine);
+		printRewindStats(&rewind);
+		releaseRewind(&rewind);
+		if (!same)
+			return 1;
+	}
+
+	if (dumpPath != NULL)
+	{
+		static Raster raster;
+		initRaster(&raster, filter);
+
+		auto rasterStart = std::chrono::steady_clock::now();
+		rasterize(&raster, chip.gBuffer_);
+		auto rasterEnd = std::chrono::steady_clock::now();
+
+		if (!writeScreenshot(&raster, dumpPath))
+		{
+			fprintf(stderr, "Could not write screenshot %s\n", dumpPath);
+			return 1;
+		}
+
+		printf("Screenshot: %s (%s, rasterized in %.3f ms)\n", dumpPath, rasterFilterName(filter),
+			std::chrono::duration<double, std::milli>(rasterEnd - rasterStart).count());
+	}
+
+	closeSaveState(&state);
+
+	if (chip.halted_)
+	{
+		fprintf(stderr, "Halted at PC %.4X after %" PRIu64 " instructions.\n", chip.progCounter_, done);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+/**	@file headless.hpp
+@note Developed for C++17/vc14.1
+@brief Function declarations for running the Chip8 core without a window
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+#include "engine.hpp"
+#include "raster.hpp"
+#include "recorder.hpp"
+
+#define DEFAULT_HEADLESS_CYCLES 10'000'000
+
+int runHeadless(const char * path, uint64_t cycles, uint32_t clockHz, Engine engine, bool clipSprites, const uint32_t * seed, const char * dumpPath, RasterFilter filter, const char * recordPath, uint32_t rewindBytes, const char * loadStatePath, const char * saveStatePath);
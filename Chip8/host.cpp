@@ -0,0 +1,448 @@
+/**	@file host.cpp
+@note Developed for C++17/vc14.1
+@brief Cooperative host: runs many Chip8 instances a frame at a time on a few threads,
+	   parking instances that wait on a key or the delay timer until that event comes
+*/
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include "host.hpp"
+
+/**
+@name:		frameStart
+@purpose:	Returns the cycle on which a chip's timers tick for a frame of its own
+@param:		const Chip8 *, uint64_t
+@return:	uint64_t
+*/
+static uint64_t frameStart(const Chip8 * chip, uint64_t frame)
+{
+	return (frame * chip->clockHz_ + TIMER_HZ - 1) / TIMER_HZ;
+}
+
+/**
+@name:		frameReaching
+@purpose:	Returns the first frame of a chip's own that starts on or after a cycle
+@param:		const Chip8 *, uint64_t
+@return:	uint64_t
+*/
+static uint64_t frameReaching(const Chip8 * chip, uint64_t cycle)
+{
+	uint64_t frame = cycle * TIMER_HZ / chip->clockHz_;
+	while (frameStart(chip, frame) < cycle)
+		++frame;
+	while (frame > 0 && frameStart(chip, frame - 1) >= cycle)
+		--frame;
+	return frame;
+}
+
+/**
+@name:		pushWake
+@purpose:	Adds a parked task to the wake heap. Returns false if out of memory.
+@param:		Host *, uint64_t, uint32_t
+@return:	bool
+*/
+static bool pushWake(Host * host, uint64_t frame, uint32_t task)
+{
+	if (host->numWakes_ == host->maxWakes_)
+	{
+		uint32_t capacity = host->maxWakes_ * 2;
+		HostWake * wakes = static_cast<HostWake *>(realloc(host->wakes_, capacity * sizeof(HostWake)));
+		if (wakes == NULL)
+			return false;
+		host->wakes_ = wakes;
+		host->maxWakes_ = capacity;
+	}
+
+	uint32_t i = host->numWakes_++;
+	while (i > 0 && host->wakes_[(i - 1) / 2].frame_ > frame)
+	{
+		host->wakes_[i] = host->wakes_[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	host->wakes_[i].frame_ = frame;
+	host->wakes_[i].task_ = task;
+	return true;
+}
+
+/**
+@name:		popWake
+@purpose:	Removes and returns the earliest entry of a non-empty wake heap
+@param:		Host *
+@return:	HostWake
+*/
+static HostWake popWake(Host * host)
+{
+	HostWake top = host->wakes_[0];
+	HostWake last = host->wakes_[--host->numWakes_];
+
+	uint32_t i = 0;
+	for (;;)
+	{
+		uint32_t child = i * 2 + 1;
+		if (child >= host->numWakes_)
+			break;
+		if (child + 1 < host->numWakes_ && host->wakes_[child + 1].frame_ < host->wakes_[child].frame_)
+			++child;
+		if (host->wakes_[child].frame_ >= last.frame_)
+			break;
+		host->wakes_[i] = host->wakes_[child];
+		i = child;
+	}
+	host->wakes_[i] = last;
+	return top;
+}
+
+/**
+@name:		wakeTask
+@purpose:	Moves a parked task back onto this frame's ready list
+@param:		Host *, uint32_t
+@return:	void
+*/
+static void wakeTask(Host * host, uint32_t index)
+{
+	HostTask * task = &host->tasks_[index];
+	task->state_ = HOST_READY;
+	task->woken_ = true;
+	--host->parked_;
+	host->ready_[host->numReady_++] = index;
+}
+
+/**
+@name:		catchUp
+@purpose:	Brings a resumed task's chip up to a cycle, running or skipping the idle loop it was
+			parked in exactly as if it had never stopped. Returns the cycles covered.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+static uint64_t catchUp(Chip8 * chip, uint64_t target)
+{
+	uint64_t from = chip->cycles_;
+	while (chip->cycles_ < target && !chip->halted_)
+	{
+		skipIdle(chip, target - chip->cycles_);
+		if (chip->cycles_ < target)
+			executeCode(chip);
+	}
+	return chip->cycles_ - from;
+}
+
+/**
+@name:		runTask
+@purpose:	Runs one task through the current frame: catches it up if it was resumed, applies
+			keys that arrived meanwhile, then runs to the start of the next frame. Afterwards the
+			task is done, ready for the next frame, or parked if it ended in an idle loop.
+			Touches only the task, so any thread may run it.
+@param:		const Host *, HostTask *, uint64_t
+@return:	void
+*/
+static void runTask(const Host * host, HostTask * task, uint64_t frame)
+{
+	Chip8 * chip = task->chip_;
+	uint64_t start = frameStart(chip, frame);
+	uint64_t target = frameStart(chip, frame + 1);
+	if (start > task->endCycle_)
+		start = task->endCycle_;
+	if (target > task->endCycle_)
+		target = task->endCycle_;
+
+	if (task->woken_)
+	{
+		task->caughtUp_ += catchUp(chip, start);
+		task->woken_ = false;
+	}
+	if (task->keysPending_)
+	{
+		setKeyMask(chip, task->keys_);
+		task->keysPending_ = false;
+	}
+
+	if (chip->cycles_ < target && !chip->halted_)
+		runEngine(chip, host->engine_, target - chip->cycles_);
+
+	if (chip->halted_ || chip->cycles_ >= task->endCycle_)
+	{
+		task->state_ = HOST_DONE;
+		return;
+	}
+
+	task->wait_ = idleWait(chip);
+	if (task->wait_ == IDLE_NONE)
+		return;
+
+	// the end of the budget wakes it if nothing else does first
+	uint64_t wake = frameReaching(chip, task->endCycle_);
+	if (task->wait_ == IDLE_DELAY && chip->frameCount_ + chip->delayTimer_ < wake)
+		wake = chip->frameCount_ + chip->delayTimer_;
+
+	task->state_ = HOST_PARKED;
+	task->wakeFrame_ = task->firstFrame_ + wake;
+}
+
+/**
+@name:		runSlices
+@purpose:	Takes tasks off the ready list until it is used up. Run by the calling thread and
+			every worker at once.
+@param:		Host *
+@return:	void
+*/
+static void runSlices(Host * host)
+{
+	for (uint32_t i; (i = host->next_.fetch_add(1, std::memory_order_relaxed)) < host->numReady_;)
+	{
+		HostTask * task = &host->tasks_[host->ready_[i]];
+		runTask(host, task, host->frame_ - task->firstFrame_);
+	}
+}
+
+/**
+@name:		hostWorker
+@purpose:	Worker thread: sleeps until a frame starts, helps run it, and reports back
+@param:		Host *
+@return:	void
+*/
+static void hostWorker(Host * host)
+{
+	uint64_t seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(host->lock_);
+			host->start_.wait(lock, [&] { return host->quit_ || host->generation_ != seen; });
+			if (host->quit_)
+				return;
+			seen = host->generation_;
+		}
+
+		runSlices(host);
+
+		std::lock_guard<std::mutex> guard(host->lock_);
+		if (--host->busy_ == 0)
+			host->done_.notify_one();
+	}
+}
+
+/**
+@name:		initHost
+@purpose:	Sets up an empty host for up to maxTasks tasks, run by the caller plus threads - 1
+			workers (one per core if 0). Returns false if out of memory.
+@param:		Host *, uint32_t, Engine, uint32_t
+@return:	bool
+*/
+bool initHost(Host * host, uint32_t maxTasks, Engine engine, uint32_t threads)
+{
+	host->tasks_ = static_cast<HostTask *>(calloc(maxTasks, sizeof(HostTask)));
+	host->ready_ = static_cast<uint32_t *>(malloc(maxTasks * sizeof(uint32_t)));
+	host->maxWakes_ = maxTasks + 1;
+	host->wakes_ = static_cast<HostWake *>(malloc(host->maxWakes_ * sizeof(HostWake)));
+	if (host->tasks_ == NULL || host->ready_ == NULL || host->wakes_ == NULL)
+	{
+		fprintf(stderr, "Out of memory for %u tasks\n", maxTasks);
+		return false;
+	}
+
+	host->numTasks_ = host->numReady_ = host->numWakes_ = 0;
+	host->maxTasks_ = maxTasks;
+	host->live_ = host->parked_ = 0;
+	host->frame_ = 0;
+	host->engine_ = engine;
+	memset(&host->stats_, 0, sizeof(host->stats_));
+
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	if (threads > HOST_MAX_THREADS)
+		threads = HOST_MAX_THREADS;
+
+	host->numThreads_ = threads;
+	host->generation_ = 0;
+	host->busy_ = 0;
+	host->quit_ = false;
+	for (uint32_t i = 1; i < threads; ++i)
+		host->threads_[i] = std::thread(hostWorker, host);
+
+	return true;
+}
+
+/**
+@name:		addHostTask
+@purpose:	Adds a chip as a task that runs from the next frame until it has run endCycle cycles
+			or halts. Its frames count from there, so it must stand at cycle 0. Returns its index.
+@param:		Host *, Chip8 *, uint64_t
+@return:	uint32_t
+*/
+uint32_t addHostTask(Host * host, Chip8 * chip, uint64_t endCycle)
+{
+	uint32_t index = host->numTasks_++;
+	HostTask * task = &host->tasks_[index];
+	memset(task, 0, sizeof(HostTask));
+	task->chip_ = chip;
+	task->endCycle_ = endCycle;
+	task->firstFrame_ = host->frame_;
+	task->state_ = HOST_READY;
+
+	host->ready_[host->numReady_++] = index;
+	++host->live_;
+	return index;
+}
+
+/**
+@name:		hostKeys
+@purpose:	Sets a task's key mask from the start of the coming frame. A task parked on FX0A
+			resumes; one parked on the delay timer or a spin gets the keys when it resumes, as
+			nothing it runs until then reads them. Call between frames only.
+@param:		Host *, uint32_t, uint16_t
+@return:	void
+*/
+void hostKeys(Host * host, uint32_t index, uint16_t mask)
+{
+	HostTask * task = &host->tasks_[index];
+	if (task->state_ == HOST_DONE)
+		return;
+
+	if (task->state_ == HOST_READY && !task->woken_)
+	{
+		setKeyMask(task->chip_, mask);
+		return;
+	}
+
+	task->keys_ = mask;
+	task->keysPending_ = true;
+	if (task->state_ == HOST_PARKED && task->wait_ == IDLE_KEY)
+	{
+		wakeTask(host, index);
+		++host->stats_.keyWakes_;
+	}
+}
+
+/**
+@name:		runHostFrame
+@purpose:	Resumes the parked tasks due this frame, runs every ready task through the frame
+			across the threads, then parks or retires tasks by how they finished. Returns false
+			once every task is done.
+@param:		Host *
+@return:	bool
+*/
+bool runHostFrame(Host * host)
+{
+	while (host->numWakes_ > 0 && host->wakes_[0].frame_ <= host->frame_)
+	{
+		HostWake wake = popWake(host);
+		HostTask * task = &host->tasks_[wake.task_];
+
+		// stale if the task was resumed by a key in the meantime
+		if (task->state_ == HOST_PARKED && task->wakeFrame_ == wake.frame_)
+		{
+			wakeTask(host, wake.task_);
+			++host->stats_.timerWakes_;
+		}
+	}
+
+	if (host->live_ == 0)
+		return false;
+
+	host->stats_.parkedFrames_ += host->parked_;
+	if (host->parked_ > host->stats_.maxParked_)
+		host->stats_.maxParked_ = host->parked_;
+
+	auto start = std::chrono::steady_clock::now();
+	host->next_.store(0, std::memory_order_relaxed);
+	if (host->numThreads_ > 1 && host->numReady_ > 1)
+	{
+		{
+			std::lock_guard<std::mutex> guard(host->lock_);
+			++host->generation_;
+			host->busy_ = host->numThreads_ - 1;
+		}
+		host->start_.notify_all();
+
+		runSlices(host);
+
+		std::unique_lock<std::mutex> lock(host->lock_);
+		host->done_.wait(lock, [&] { return host->busy_ == 0; });
+	}
+	else
+		runSlices(host);
+	auto end = std::chrono::steady_clock::now();
+	host->stats_.busySecs_ += std::chrono::duration<double>(end - start).count();
+	host->stats_.slices_ += host->numReady_;
+
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < host->numReady_; ++i)
+	{
+		uint32_t index = host->ready_[i];
+		HostTask * task = &host->tasks_[index];
+
+		if (task->state_ == HOST_READY)
+			host->ready_[kept++] = index;
+		else if (task->state_ == HOST_DONE)
+			--host->live_;
+		else
+		{
+			++host->parked_;
+			++host->stats_.parks_[task->wait_];
+			if (!pushWake(host, task->wakeFrame_, index))
+			{
+				// no room to remember when to wake it, so it stays in the ready list and spins
+				fprintf(stderr, "Out of memory for parked tasks\n");
+				task->state_ = HOST_READY;
+				--host->parked_;
+				host->ready_[kept++] = index;
+			}
+		}
+	}
+	host->numReady_ = kept;
+
+	++host->frame_;
+	++host->stats_.frames_;
+	return host->live_ > 0;
+}
+
+/**
+@name:		releaseHost
+@purpose:	Stops the workers and frees the host's lists. The chips belong to the caller.
+@param:		Host *
+@return:	void
+*/
+void releaseHost(Host * host)
+{
+	{
+		std::lock_guard<std::mutex> guard(host->lock_);
+		host->quit_ = true;
+	}
+	host->start_.notify_all();
+	for (uint32_t i = 1; i < host->numThreads_; ++i)
+		host->threads_[i].join();
+
+	free(host->tasks_);
+	free(host->ready_);
+	free(host->wakes_);
+	host->tasks_ = NULL;
+	host->ready_ = NULL;
+	host->wakes_ = NULL;
+}
+
+/**
+@name:		printHostStats
+@purpose:	Prints how many task-frames ran and how many were spent parked, what tasks parked
+			on and what resumed them
+@param:		const Host *
+@return:	void
+*/
+void printHostStats(const Host * host)
+{
+	const HostStats * stats = &host->stats_;
+	uint64_t caughtUp = 0;
+	for (uint32_t i = 0; i < host->numTasks_; ++i)
+		caughtUp += host->tasks_[i].caughtUp_;
+
+	uint64_t taskFrames = stats->slices_ + stats->parkedFrames_;
+	printf("Host: %u tasks over %" PRIu64 " frames on %u threads, busy %.3f s\n", host->numTasks_, stats->frames_, host->numThreads_, stats->busySecs_);
+	printf("Task-frames: %" PRIu64 " run, %" PRIu64 " parked (%.1f%%), at most %" PRIu64 " parked at once\n",
+		stats->slices_, stats->parkedFrames_, taskFrames ? 100.0 * stats->parkedFrames_ / taskFrames : 0.0, stats->maxParked_);
+	printf("Parked on: spin %" PRIu64 ", key %" PRIu64 ", delay timer %" PRIu64 "; resumed by key %" PRIu64 ", by timer or end %" PRIu64 "\n",
+		stats->parks_[IDLE_SPIN], stats->parks_[IDLE_KEY], stats->parks_[IDLE_DELAY], stats->keyWakes_, stats->timerWakes_);
+	printf("Cycles covered catching up resumed tasks: %" PRIu64 "\n", caughtUp);
+}
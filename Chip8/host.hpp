@@ -0,0 +1,104 @@
+/**	@file host.hpp
+@note Developed for C++17/vc14.1
+@brief Cooperative host: runs many Chip8 instances a frame at a time on a few threads,
+	   parking instances that wait on a key or the delay timer until that event comes
+*/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "chip8.hpp"
+#include "engine.hpp"
+
+#define HOST_MAX_THREADS 64
+
+enum HostState : uint8_t
+{
+	HOST_READY,			// runs next frame
+	HOST_PARKED,		// in an idle loop; waits for wakeFrame_ or, on IDLE_KEY, a key
+	HOST_DONE			// reached its end cycle or halted
+};
+
+/*
+Each task is a coroutine whose frame is its Chip8: executeCode already returns after every
+opcode with all state in the struct, so a task suspends at the end of a frame simply by not
+being run again, and resumes from wherever it left off. A task that ends its frame in an
+idle loop is parked instead of queued. While parked it is on no list but the wake heap and
+costs nothing per frame. When it resumes, it is brought up to date with skipIdle and
+executeCode, as if it had spun all along.
+*/
+typedef struct HostTask
+{
+	Chip8 * chip_;
+	uint64_t endCycle_;		// the task is done once its chip has run this many cycles
+	uint64_t firstFrame_;	// host frame its chip's frame 0 ran in
+
+	HostState state_;
+	IdleWait wait_;			// what a parked task waits on
+	uint64_t wakeFrame_;	// when a parked task resumes without a key
+	bool woken_;			// resumed since its last run, so behind the frame
+	bool keysPending_;		// keys_ arrived while it was parked or behind
+	uint16_t keys_;
+
+	uint64_t caughtUp_;		// cycles run or skipped bringing it up to date after resuming
+} HostTask;
+
+// A parked task and the frame it resumes at
+typedef struct HostWake
+{
+	uint64_t frame_;
+	uint32_t task_;
+} HostWake;
+
+typedef struct HostStats
+{
+	uint64_t frames_;
+	uint64_t slices_;			// task-frames run
+	uint64_t parkedFrames_;		// task-frames spent parked
+	uint64_t parks_[IDLE_DELAY + 1];	// by IdleWait
+	uint64_t keyWakes_;			// resumed by a key
+	uint64_t timerWakes_;		// resumed at wakeFrame_
+	uint64_t maxParked_;
+	double busySecs_;
+} HostStats;
+
+typedef struct Host
+{
+	HostTask * tasks_;
+	uint32_t numTasks_;
+	uint32_t maxTasks_;
+	uint32_t live_;				// tasks not done
+	uint32_t parked_;
+
+	uint32_t * ready_;			// tasks to run this frame
+	uint32_t numReady_;
+	HostWake * wakes_;			// min-heap on frame_; entries for tasks woken early go stale
+	uint32_t numWakes_;
+	uint32_t maxWakes_;
+
+	uint64_t frame_;			// frame about to run: ready tasks stand at its first cycle
+	Engine engine_;
+
+	// workers run the ready list alongside the calling thread
+	std::thread threads_[HOST_MAX_THREADS];
+	uint32_t numThreads_;
+	std::mutex lock_;
+	std::condition_variable start_;
+	std::condition_variable done_;
+	uint64_t generation_;
+	uint32_t busy_;
+	bool quit_;
+	std::atomic<uint32_t> next_;
+
+	HostStats stats_;
+} Host;
+
+bool initHost(Host * host, uint32_t maxTasks, Engine engine, uint32_t threads);
+uint32_t addHostTask(Host * host, Chip8 * chip, uint64_t endCycle);
+void hostKeys(Host * host, uint32_t task, uint16_t mask);
+bool runHostFrame(Host * host);
+void releaseHost(Host * host);
+void printHostStats(const Host * host);
@@ -0,0 +1,745 @@
+/**	@file jit.cpp
+@note Developed for C++17/vc14.1
+@brief x86-64 dynamic recompiler. Cached basic blocks are translated to native code
+	   with the V registers they use held in host registers. Anything without a native
+	   translation (DXYN, FX0A, calls, stores...) calls back into the shared op functions,
+	   and blocks that straddle a timer tick or the cycle budget run through executeCode.
+*/
+
+#include <cinttypes>
+#include <cstring>
+#include "blockcache.hpp"
+#include "engine.hpp"
+#include "jit.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64 1
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#ifdef CHIP8_JIT_X64
+
+typedef void (*JitFunc)(Chip8 * chip);
+
+// host register numbers, as encoded in ModRM/REX
+enum HostReg : uint8_t
+{
+	RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+	R8 = 8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// V registers are allocated from r8-r15; rbx holds the Chip8 pointer, rax/rcx are scratch
+static const uint8_t vRegPool[] = { R8, R9, R10, R11, R12, R13, R14, R15 };
+#define NUM_POOL_REGS (sizeof(vRegPool) / sizeof(vRegPool[0]))
+#define NO_HOST_REG 0xFF
+
+// 8-bit ALU opcodes, "op r/m8, r8" form
+#define ALU_ADD 0x00
+#define ALU_OR  0x08
+#define ALU_AND 0x20
+#define ALU_SUB 0x28
+#define ALU_XOR 0x30
+#define ALU_CMP 0x38
+#define ALU_MOV 0x88
+
+// condition codes for setcc/cmovcc
+#define CC_C  0x2
+#define CC_NC 0x3
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_A  0x7
+
+#define FIELD(field) static_cast<int32_t>(offsetof(Chip8, field))
+
+typedef struct Emitter
+{
+	uint8_t * buf_;
+	size_t pos_;
+} Emitter;
+
+static void emit8(Emitter * e, uint8_t byte)
+{
+	e->buf_[e->pos_++] = byte;
+}
+
+static void emit16(Emitter * e, uint16_t value)
+{
+	memcpy(e->buf_ + e->pos_, &value, 2);
+	e->pos_ += 2;
+}
+
+static void emit32(Emitter * e, uint32_t value)
+{
+	memcpy(e->buf_ + e->pos_, &value, 4);
+	e->pos_ += 4;
+}
+
+static void emit64(Emitter * e, uint64_t value)
+{
+	memcpy(e->buf_ + e->pos_, &value, 8);
+	e->pos_ += 8;
+}
+
+/**
+@name:		emitRex
+@purpose:	Emits a REX prefix. Byte-register instructions always get one, so sil/dil/r8b-r15b encode.
+@param:		Emitter *, bool, uint8_t, uint8_t
+@return:	void
+*/
+static void emitRex(Emitter * e, bool wide, uint8_t reg, uint8_t rm)
+{
+	emit8(e, 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+// op r8, [rbx + disp32]
+static void emitByteMem(Emitter * e, uint8_t opcode, uint8_t reg, int32_t disp)
+{
+	emitRex(e, false, reg, RBX);
+	emit8(e, opcode);
+	emit8(e, 0x80 | ((reg & 7) << 3) | RBX);
+	emit32(e, disp);
+}
+
+static void emitLoadByte(Emitter * e, uint8_t reg, int32_t disp)
+{
+	emitByteMem(e, 0x8A, reg, disp);
+}
+
+static void emitStoreByte(Emitter * e, uint8_t reg, int32_t disp)
+{
+	emitByteMem(e, 0x88, reg, disp);
+}
+
+// op r/m8, r8 with both operands in registers
+static void emitAluRR(Emitter * e, uint8_t opcode, uint8_t dst, uint8_t src)
+{
+	emitRex(e, false, src, dst);
+	emit8(e, opcode);
+	emit8(e, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+// op r/m8, imm8 (group 1: /0 add, /4 and, /7 cmp)
+static void emitAluImm(Emitter * e, uint8_t ext, uint8_t dst, uint8_t imm)
+{
+	emitRex(e, false, 0, dst);
+	emit8(e, 0x80);
+	emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+	emit8(e, imm);
+}
+
+static void emitMovImm8(Emitter * e, uint8_t dst, uint8_t imm)
+{
+	emitRex(e, false, 0, dst);
+	emit8(e, 0xB0 | (dst & 7));
+	emit8(e, imm);
+}
+
+static void emitSetcc(Emitter * e, uint8_t cc, uint8_t dst)
+{
+	emitRex(e, false, 0, dst);
+	emit8(e, 0x0F);
+	emit8(e, 0x90 | cc);
+	emit8(e, 0xC0 | (dst & 7));
+}
+
+// shl/shr r8, 1 (/4 shl, /5 shr)
+static void emitShift1(Emitter * e, uint8_t ext, uint8_t dst)
+{
+	emitRex(e, false, 0, dst);
+	emit8(e, 0xD0);
+	emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+}
+
+// movzx r32, r8
+static void emitMovzxByte(Emitter * e, uint8_t dst, uint8_t src)
+{
+	emitRex(e, false, dst, src);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit8(e, 0xC0 | ((dst & 7) << 3) | (src & 7));
+}
+
+// mov word [rbx + disp32], imm16
+static void emitStoreWordImm(Emitter * e, int32_t disp, uint16_t value)
+{
+	emit8(e, 0x66);
+	emit8(e, 0xC7);
+	emit8(e, 0x80 | RBX);
+	emit32(e, disp);
+	emit16(e, value);
+}
+
+// mov word [rbx + disp32], ax
+static void emitStoreAx(Emitter * e, int32_t disp)
+{
+	emit8(e, 0x66);
+	emit8(e, 0x89);
+	emit8(e, 0x80 | RBX);
+	emit32(e, disp);
+}
+
+// movzx eax, word [rbx + disp32]
+static void emitLoadWordEax(Emitter * e, int32_t disp)
+{
+	emit8(e, 0x0F);
+	emit8(e, 0xB7);
+	emit8(e, 0x80 | RBX);
+	emit32(e, disp);
+}
+
+static void emitStorePc(Emitter * e, uint16_t pc)
+{
+	emitStoreWordImm(e, FIELD(progCounter_), pc);
+}
+
+/**
+@name:		emitSkip
+@purpose:	progCounter_ = condition ? pc + 4 : pc + 2, using the flags already set
+@param:		Emitter *, uint8_t, uint16_t
+@return:	void
+*/
+static void emitSkip(Emitter * e, uint8_t skipCc, uint16_t pc)
+{
+	emit8(e, 0xB8);					// mov eax, pc + 2
+	emit32(e, static_cast<uint16_t>(pc + 2));
+	emit8(e, 0xB9);					// mov ecx, pc + 4
+	emit32(e, static_cast<uint16_t>(pc + 4));
+	emit8(e, 0x0F);					// cmovcc eax, ecx
+	emit8(e, 0x40 | skipCc);
+	emit8(e, 0xC1);
+	emitStoreAx(e, FIELD(progCounter_));
+}
+
+static void emitPrologue(Emitter * e)
+{
+	emit8(e, 0x53);					// push rbx
+	emit8(e, 0x41); emit8(e, 0x54);	// push r12
+	emit8(e, 0x41); emit8(e, 0x55);	// push r13
+	emit8(e, 0x41); emit8(e, 0x56);	// push r14
+	emit8(e, 0x41); emit8(e, 0x57);	// push r15
+#ifdef _WIN32
+	emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xEC); emit8(e, 0x20);	// sub rsp, 32 (shadow space)
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xCB);					// mov rbx, rcx
+#else
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xFB);					// mov rbx, rdi
+#endif
+}
+
+static void emitEpilogue(Emitter * e)
+{
+#ifdef _WIN32
+	emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xC4); emit8(e, 0x20);	// add rsp, 32
+#endif
+	emit8(e, 0x41); emit8(e, 0x5F);	// pop r15
+	emit8(e, 0x41); emit8(e, 0x5E);	// pop r14
+	emit8(e, 0x41); emit8(e, 0x5D);	// pop r13
+	emit8(e, 0x41); emit8(e, 0x5C);	// pop r12
+	emit8(e, 0x5B);					// pop rbx
+	emit8(e, 0xC3);					// ret
+}
+
+/**
+@name:		jitCallOp
+@purpose:	Called from translated code for instructions that have no native translation
+@param:		Chip8 *, const DecodedOp *
+@return:	void
+*/
+static void jitCallOp(Chip8 * chip, const DecodedOp * op)
+{
+	executeOp(chip, op);
+}
+
+/**
+@name:		emitCallOp
+@purpose:	Emits a call to jitCallOp(chip, op)
+@param:		Emitter *, const DecodedOp *
+@return:	void
+*/
+static void emitCallOp(Emitter * e, const DecodedOp * op)
+{
+#ifdef _WIN32
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xD9);		// mov rcx, rbx
+	emit8(e, 0x48); emit8(e, 0xBA);						// mov rdx, op
+#else
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF);		// mov rdi, rbx
+	emit8(e, 0x48); emit8(e, 0xBE);						// mov rsi, op
+#endif
+	emit64(e, reinterpret_cast<uint64_t>(op));
+	emit8(e, 0x48); emit8(e, 0xB8);						// mov rax, jitCallOp
+	emit64(e, reinterpret_cast<uint64_t>(&jitCallOp));
+	emit8(e, 0xFF); emit8(e, 0xD0);						// call rax
+}
+
+typedef struct RegMap
+{
+	uint8_t host_[VREGSIZE];
+	uint8_t used_;
+} RegMap;
+
+/**
+@name:		mapRegs
+@purpose:	Makes sure every listed V register has a host register. Returns false, changing
+			nothing, if the pool would run out.
+@param:		RegMap *, const uint8_t *, int
+@return:	bool
+*/
+static bool mapRegs(RegMap * map, const uint8_t * regs, int count)
+{
+	int needed = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		bool seen = false;
+		for (int j = 0; j < i; ++j)
+			seen |= regs[j] == regs[i];
+
+		if (!seen && map->host_[regs[i]] == NO_HOST_REG)
+			++needed;
+	}
+
+	if (map->used_ + needed > (int)NUM_POOL_REGS)
+		return false;
+
+	for (int i = 0; i < count; ++i)
+		if (map->host_[regs[i]] == NO_HOST_REG)
+			map->host_[regs[i]] = vRegPool[map->used_++];
+
+	return true;
+}
+
+/**
+@name:		nativeRegs
+@purpose:	Lists the V registers an instruction needs in host registers. Returns -1 if the
+			instruction has no native translation.
+@param:		const DecodedOp *, uint8_t *
+@return:	int
+*/
+static int nativeRegs(const DecodedOp * op, uint8_t * regs)
+{
+	// flag-setting ops that name VF as an operand depend on the exact order of the VF
+	// write, so those go through the interpreter
+	bool touchesVf = op->x_ == 0xF || op->y_ == 0xF;
+
+	switch (op->instr_)
+	{
+		case INSTR_CALL_RCA_ADDR:
+		case INSTR_GOTO_ADDR:
+		case INSTR_SET_INDEX_TO_ADDR_VAL:
+			return 0;
+		case INSTR_VX_SKIP_EQUAL_ADDR:
+		case INSTR_VX_SKIP_NEQUAL_ADDR:
+		case INSTR_SET_VX_TO_ADDR:
+		case INSTR_SET_VX_VX_PLUS_ADDR:
+		case INSTR_SET_VX_TO_DELAY_TIMER:
+		case INSTR_SET_DELAY_TIMER_TO_VX:
+		case INSTR_SET_SOUND_TIMER_TO_VX:
+		case INSTR_SET_INDEX_TO_SPRITE:
+			regs[0] = op->x_;
+			return 1;
+		case INSTR_VX_NOT_VY:
+		case INSTR_CHECK_VX_IS_VY:
+		case INSTR_SET_VX_TO_VY:
+		case INSTR_SET_VX_VX_OR_VY:
+		case INSTR_SET_VX_VX_AND_VY:
+		case INSTR_SET_VX_VX_XOR_VY:
+			regs[0] = op->x_;
+			regs[1] = op->y_;
+			return 2;
+		case INSTR_SET_VX_VX_PLUS_VY:
+		case INSTR_SET_VX_VX_MINUS_VY:
+		case INSTR_SET_VX_VY_MINUS_VX:
+		case INSTR_SET_VX_SHIFT_ONE_RIGHT:
+		case INSTR_SET_VX_SHIFT_ONE_LEFT:
+			if (touchesVf)
+				return -1;
+			regs[0] = op->x_;
+			regs[1] = op->y_;
+			regs[2] = 0xF;
+			return 3;
+		case INSTR_SET_INDEX_PLUS_VX:
+			if (op->x_ == 0xF)
+				return -1;
+			regs[0] = op->x_;
+			regs[1] = 0xF;
+			return 2;
+		default:
+			return -1;
+	}
+}
+
+static void emitLoadMapped(Emitter * e, const RegMap * map)
+{
+	for (int i = 0; i < VREGSIZE; ++i)
+		if (map->host_[i] != NO_HOST_REG)
+			emitLoadByte(e, map->host_[i], FIELD(vReg_) + i);
+}
+
+static void emitStoreMapped(Emitter * e, const RegMap * map)
+{
+	for (int i = 0; i < VREGSIZE; ++i)
+		if (map->host_[i] != NO_HOST_REG)
+			emitStoreByte(e, map->host_[i], FIELD(vReg_) + i);
+}
+
+/**
+@name:		emitNative
+@purpose:	Emits the native translation of one instruction at address pc
+@param:		Emitter *, const RegMap *, const DecodedOp *, uint16_t
+@return:	void
+*/
+static void emitNative(Emitter * e, const RegMap * map, const DecodedOp * op, uint16_t pc)
+{
+	uint8_t rx = map->host_[op->x_];
+	uint8_t ry = map->host_[op->y_];
+	uint8_t rf = map->host_[0xF];
+
+	switch (op->instr_)
+	{
+		case INSTR_CALL_RCA_ADDR:
+			break;
+		case INSTR_GOTO_ADDR:
+			emitStorePc(e, op->nnn_);
+			break;
+		case INSTR_SET_INDEX_TO_ADDR_VAL:
+			emitStoreWordImm(e, FIELD(regIndex_), op->nnn_);
+			break;
+		case INSTR_VX_SKIP_EQUAL_ADDR:
+			emitAluImm(e, 7, rx, op->nn_);
+			emitSkip(e, CC_E, pc);
+			break;
+		case INSTR_VX_SKIP_NEQUAL_ADDR:
+			emitAluImm(e, 7, rx, op->nn_);
+			emitSkip(e, CC_NE, pc);
+			break;
+		case INSTR_VX_NOT_VY:
+		case INSTR_CHECK_VX_IS_VY:		// both skip when the registers differ
+			emitAluRR(e, ALU_CMP, rx, ry);
+			emitSkip(e, CC_NE, pc);
+			break;
+		case INSTR_SET_VX_TO_ADDR:
+			emitMovImm8(e, rx, op->nn_);
+			break;
+		case INSTR_SET_VX_VX_PLUS_ADDR:
+			emitAluImm(e, 0, rx, op->nn_);
+			break;
+		case INSTR_SET_VX_TO_VY:
+			emitAluRR(e, ALU_MOV, rx, ry);
+			break;
+		case INSTR_SET_VX_VX_OR_VY:
+			emitAluRR(e, ALU_OR, rx, ry);
+			break;
+		case INSTR_SET_VX_VX_AND_VY:
+			emitAluRR(e, ALU_AND, rx, ry);
+			break;
+		case INSTR_SET_VX_VX_XOR_VY:
+			emitAluRR(e, ALU_XOR, rx, ry);
+			break;
+		case INSTR_SET_VX_VX_PLUS_VY:
+			emitAluRR(e, ALU_ADD, rx, ry);
+			emitSetcc(e, CC_C, rf);
+			break;
+		case INSTR_SET_VX_VX_MINUS_VY:
+			emitAluRR(e, ALU_SUB, rx, ry);
+			emitSetcc(e, CC_NC, rf);
+			break;
+		case INSTR_SET_VX_SHIFT_ONE_RIGHT:
+			emitShift1(e, 5, rx);
+			emitSetcc(e, CC_C, rf);
+			break;
+		case INSTR_SET_VX_VY_MINUS_VX:
+			emitAluRR(e, ALU_MOV, RAX, ry);
+			emitAluRR(e, ALU_SUB, RAX, rx);
+			emitSetcc(e, CC_NC, rf);
+			emitAluRR(e, ALU_MOV, rx, RAX);
+			break;
+		case INSTR_SET_VX_SHIFT_ONE_LEFT:
+			// VF gets bit 7 itself (0 or 128), as the interpreter has always done
+			emitAluRR(e, ALU_MOV, RAX, rx);
+			emitAluImm(e, 4, RAX, 0x80);
+			emitAluRR(e, ALU_MOV, rf, RAX);
+			emitShift1(e, 4, rx);
+			break;
+		case INSTR_SET_VX_TO_DELAY_TIMER:
+			emitLoadByte(e, rx, FIELD(delayTimer_));
+			break;
+		case INSTR_SET_DELAY_TIMER_TO_VX:
+		case INSTR_SET_SOUND_TIMER_TO_VX:
+		{
+			bool delay = op->instr_ == INSTR_SET_DELAY_TIMER_TO_VX;
+			emitStoreByte(e, rx, delay ? FIELD(delayTimer_) : FIELD(soundTimer_));
+			emitAluRR(e, 0x84, rx, rx);		// test rx, rx
+			emit8(e, 0x0F);					// setnz byte [rbx + flag]
+			emit8(e, 0x90 | CC_NE);
+			emit8(e, 0x80 | RBX);
+			emit32(e, delay ? FIELD(isDelay_) : FIELD(soundPlaying_));
+		}
+			break;
+		case INSTR_SET_INDEX_PLUS_VX:
+			emitLoadWordEax(e, FIELD(regIndex_));
+			emitMovzxByte(e, RCX, rx);
+			emit8(e, 0x01); emit8(e, 0xC8);	// add eax, ecx
+			emit8(e, 0x3D); emit32(e, 0x0FFF);	// cmp eax, 0xFFF
+			emitSetcc(e, CC_A, rf);
+			emitStoreAx(e, FIELD(regIndex_));
+			break;
+		case INSTR_SET_INDEX_TO_SPRITE:
+			emitMovzxByte(e, RAX, rx);
+			emit8(e, 0x8D); emit8(e, 0x04); emit8(e, 0x80);	// lea eax, [rax + rax * 4]
+			emitStoreAx(e, FIELD(regIndex_));
+			break;
+	}
+}
+
+/**
+@name:		isNativeTerminator
+@purpose:	True for the natively translated instructions that set the PC themselves
+@param:		uint8_t
+@return:	bool
+*/
+static bool isNativeTerminator(uint8_t instr)
+{
+	return instr == INSTR_GOTO_ADDR || instr == INSTR_VX_SKIP_EQUAL_ADDR || instr == INSTR_VX_SKIP_NEQUAL_ADDR
+		|| instr == INSTR_VX_NOT_VY || instr == INSTR_CHECK_VX_IS_VY;
+}
+
+/**
+@name:		compileBlock
+@purpose:	Translates a cached block into native code at the end of the code buffer. The
+			caller guarantees JIT_MAX_BLOCK_CODE bytes are free.
+@param:		JitState *, Block *
+@return:	void
+*/
+static void compileBlock(JitState * jit, Block * block)
+{
+	Emitter e;
+	e.buf_ = jit->code_ + jit->used_;
+	e.pos_ = 0;
+
+	// pick which ops run natively and give their registers host registers, in order,
+	// until the pool runs out
+	RegMap map;
+	memset(map.host_, NO_HOST_REG, sizeof(map.host_));
+	map.used_ = 0;
+
+	bool native[MAX_BLOCK_OPS];
+	for (uint8_t i = 0; i < block->length_; ++i)
+	{
+		uint8_t regs[3];
+		int count = nativeRegs(&block->ops_[i], regs);
+		native[i] = count >= 0 && mapRegs(&map, regs, count);
+	}
+
+	emitPrologue(&e);
+	emitLoadMapped(&e, &map);
+
+	bool regsLive = true;
+	uint16_t pc = block->startPc_;
+	for (uint8_t i = 0; i < block->length_; ++i, pc += 2)
+	{
+		const DecodedOp * op = &block->ops_[i];
+		bool last = i + 1 == block->length_;
+
+		if (native[i])
+		{
+			emitNative(&e, &map, op, pc);
+			if (last && !isNativeTerminator(op->instr_))
+				emitStorePc(&e, pc + 2);
+		}
+		else
+		{
+			// the op functions work on the Chip8 struct, so hand it the current registers and PC
+			emitStoreMapped(&e, &map);
+			emitStorePc(&e, pc);
+			emitCallOp(&e, op);
+
+			if (last)
+				regsLive = false;
+			else
+				emitLoadMapped(&e, &map);
+		}
+	}
+
+	if (regsLive)
+		emitStoreMapped(&e, &map);
+
+	emitEpilogue(&e);
+
+	block->native_ = jit->code_ + jit->used_;
+	jit->used_ += (e.pos_ + 15) & ~static_cast<size_t>(15);
+	++jit->blocksCompiled_;
+}
+
+/**
+@name:		allocCode
+@purpose:	Allocates the executable code buffer. Returns NULL if the OS refuses.
+@param:		void
+@return:	uint8_t *
+*/
+static uint8_t * allocCode()
+{
+#ifdef _WIN32
+	return static_cast<uint8_t *>(VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+	void * mem = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return mem == MAP_FAILED ? NULL : static_cast<uint8_t *>(mem);
+#endif
+}
+
+static void freeCode(uint8_t * code)
+{
+#ifdef _WIN32
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, JIT_CODE_SIZE);
+#endif
+}
+
+#endif // CHIP8_JIT_X64
+
+/**
+@name:		jitSupported
+@purpose:	True if this build can generate native code
+@param:		void
+@return:	bool
+*/
+bool jitSupported()
+{
+#ifdef CHIP8_JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+@name:		acquireJit
+@purpose:	Returns the chip's JIT state, allocating it and its code buffer on first use.
+			Returns NULL if there is no JIT for this platform or the OS refuses executable memory.
+@param:		Chip8 *
+@return:	JitState *
+*/
+JitState * acquireJit(Chip8 * chip)
+{
+#ifdef CHIP8_JIT_X64
+	if (chip->jit_ != NULL && chip->jit_->owner_ == chip)
+		return chip->jit_;
+
+	JitState * jit = static_cast<JitState *>(calloc(1, sizeof(JitState)));
+	if (jit == NULL)
+		return NULL;
+
+	jit->code_ = allocCode();
+	if (jit->code_ == NULL)
+	{
+		free(jit);
+		return NULL;
+	}
+
+	jit->owner_ = chip;
+	chip->jit_ = jit;
+	return jit;
+#else
+	return NULL;
+#endif
+}
+
+/**
+@name:		releaseJit
+@purpose:	Frees the chip's JIT state and code buffer, if it owns them
+@param:		Chip8 *
+@return:	void
+*/
+void releaseJit(Chip8 * chip)
+{
+#ifdef CHIP8_JIT_X64
+	if (chip->jit_ != NULL && chip->jit_->owner_ == chip)
+	{
+		freeCode(chip->jit_->code_);
+		free(chip->jit_);
+	}
+#endif
+	chip->jit_ = NULL;
+}
+
+/**
+@name:		runJit
+@purpose:	Executes up to the given number of opcodes, running translated blocks natively,
+			and stops early if the chip halts. Returns the number executed. Without a JIT,
+			or with debugger output on, this is runBlocks.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t runJit(Chip8 * chip, uint64_t cycles)
+{
+#ifdef CHIP8_JIT_X64
+	JitState * jit = acquireJit(chip);
+	BlockCache * cache = acquireBlockCache(chip);
+	if (jit == NULL || cache == NULL || chip->printInst_ || chip->dumpRegs_)
+		return runBlocks(chip, cycles);
+
+	uint64_t done = 0;
+	while (done < cycles && !chip->halted_)
+	{
+		syncBlockCache(cache, chip);
+
+		if (jit->used_ + JIT_MAX_BLOCK_CODE > JIT_CODE_SIZE)
+			flushBlockCache(cache);
+
+		Block * block = lookupBlock(cache, chip, chip->progCounter_);
+
+		// a flushed cache has no blocks pointing into the code buffer any more
+		if (cache->flushes_ != jit->seenFlushes_)
+		{
+			jit->seenFlushes_ = cache->flushes_;
+			jit->used_ = 0;
+			++jit->codeResets_;
+		}
+
+		// translated code has the block's PC baked in, so a PC that ran past 0xFFF is interpreted
+		uint8_t length = block->length_;
+		if (chip->progCounter_ == block->startPc_ && blockFits(chip, block, cycles - done))
+		{
+			if (block->native_ == NULL)
+				compileBlock(jit, block);
+
+			settleBlockCycles(chip, length);
+			done += length;
+			jit->nativeInstrs_ += length;
+			reinterpret_cast<JitFunc>(block->native_)(chip);
+		}
+		else
+		{
+			// an unaligned PC, a timer tick the block could observe, or the end of the budget
+			for (uint8_t i = 0; i < length && done < cycles && !chip->halted_; ++i)
+			{
+				executeCode(chip);
+				++done;
+				++jit->interpretedInstrs_;
+			}
+		}
+	}
+
+	return done;
+#else
+	return runBlocks(chip, cycles);
+#endif
+}
+
+/**
+@name:		printJitStats
+@purpose:	Prints JIT counters, if the chip has JIT state
+@param:		const Chip8 *
+@return:	void
+*/
+void printJitStats(const Chip8 * chip)
+{
+	const JitState * jit = chip->jit_;
+	if (jit == NULL || jit->owner_ != chip)
+		return;
+
+	printf("JIT blocks compiled: %" PRIu64 ", code resets: %" PRIu64 "\n", jit->blocksCompiled_, jit->codeResets_);
+	printf("JIT native instructions: %" PRIu64 ", interpreted: %" PRIu64 "\n", jit->nativeInstrs_, jit->interpretedInstrs_);
+}
@@ -0,0 +1,31 @@
+/**	@file jit.hpp
+@note Developed for C++17/vc14.1
+@brief Function declarations and state for the x86-64 dynamic recompiler
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "chip8.hpp"
+
+#define JIT_CODE_SIZE (1024 * 1024)
+#define JIT_MAX_BLOCK_CODE 8192		// worst case for one translated block
+
+typedef struct JitState
+{
+	const Chip8 * owner_;
+	uint8_t * code_;			// executable buffer, JIT_CODE_SIZE bytes
+	size_t used_;
+	uint64_t seenFlushes_;		// block cache flush count when code_ was last reset
+
+	// stats
+	uint64_t blocksCompiled_;
+	uint64_t nativeInstrs_;
+	uint64_t interpretedInstrs_;
+	uint64_t codeResets_;
+} JitState;
+
+bool jitSupported();
+JitState * acquireJit(Chip8 * chip);
+void releaseJit(Chip8 * chip);
+void printJitStats(const Chip8 * chip);
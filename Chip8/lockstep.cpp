@@ -0,0 +1,623 @@
+/**	@file lockstep.cpp
+@note Developed for C++17/vc14.1
+@brief Lockstep engine: runs up to 32 instances of the same ROM together, with the hot
+	   registers laid out across lanes so common opcodes execute for all lanes at once
+*/
+
+#include <cinttypes>
+#include <cstring>
+#include "lockstep.hpp"
+#include "lockstep_avx2.hpp"
+#include "opcodes.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+@name:		cpuHasAvx2
+@purpose:	Returns true if the CPU has AVX2 and the OS saves the YMM registers across switches
+@param:		void
+@return:	bool
+*/
+static bool cpuHasAvx2()
+{
+#if !defined(LOCKSTEP_AVX2)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// OSXSAVE and AVX, then XCR0 bits 1 and 2: the OS saves SSE and AVX state
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// the AVX2 kernels in lockstep_avx2.cpp where the CPU has them, the lane loops below otherwise
+static const bool useAvx2 = cpuHasAvx2();
+static const uint32_t minLanes = useAvx2 ? LOCKSTEP_MIN_LANES_AVX2 : LOCKSTEP_MIN_LANES_SCALAR;
+
+/**
+@name:		lowestLane
+@purpose:	Returns the index of the lowest set bit of a non-zero lane mask
+@param:		uint32_t
+@return:	int
+*/
+static int lowestLane(uint32_t lanes)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, lanes);
+	return (int)index;
+#else
+	return __builtin_ctz(lanes);
+#endif
+}
+
+/**
+@name:		laneCount
+@purpose:	Returns the number of set bits in a lane mask
+@param:		uint32_t
+@return:	int
+*/
+static int laneCount(uint32_t lanes)
+{
+#ifdef _MSC_VER
+	return (int)__popcnt(lanes);
+#else
+	return __builtin_popcount(lanes);
+#endif
+}
+
+/**
+@name:		opCodeAt
+@purpose:	Reads the big-endian opcode at an address of a lane's memory, wrapping like fetchOpCode
+@param:		const Chip8 *, uint16_t
+@return:	uint16_t
+*/
+static uint16_t opCodeAt(const Chip8 * chip, uint16_t addr)
+{
+	return (readMem(chip, addr) << 8) | readMem(chip, addr + 1);
+}
+
+/**
+@name:		lowestLivePc
+@purpose:	Returns the lowest PC among lanes with work left
+@param:		const Lockstep *
+@return:	uint16_t
+*/
+static uint16_t lowestLivePc(const Lockstep * ls)
+{
+#ifdef LOCKSTEP_AVX2
+	if (useAvx2)
+		return lowestLivePcAvx2(ls);
+#endif
+
+	uint16_t lowest = 0xFFFF;
+	for (uint32_t lanes = ls->live_; lanes != 0; lanes &= lanes - 1)
+	{
+		int lane = lowestLane(lanes);
+		if (ls->progCounter_[lane] < lowest)
+			lowest = ls->progCounter_[lane];
+	}
+	return lowest;
+}
+
+/**
+@name:		lanesMatching
+@purpose:	Returns the mask of lanes whose entry in a 16-bit lane array equals value
+@param:		const uint16_t *, uint16_t
+@return:	uint32_t
+*/
+static uint32_t lanesMatching(const uint16_t * words, uint16_t value)
+{
+#ifdef LOCKSTEP_AVX2
+	if (useAvx2)
+		return lanesMatchingAvx2(words, value);
+#endif
+
+	uint32_t lanes = 0;
+	for (int lane = 0; lane < LOCKSTEP_LANES; ++lane)
+		if (words[lane] == value)
+			lanes |= 1u << lane;
+	return lanes;
+}
+
+/**
+@name:		furthestBehindPc
+@purpose:	Returns the PC of the live lane that has run the fewest opcodes
+@param:		const Lockstep *
+@return:	uint16_t
+*/
+static uint16_t furthestBehindPc(const Lockstep * ls)
+{
+	uint64_t fewest = UINT64_MAX;
+	uint16_t pc = 0;
+	for (uint32_t lanes = ls->live_; lanes != 0; lanes &= lanes - 1)
+	{
+		int lane = lowestLane(lanes);
+		uint64_t ran = ls->chips_[lane]->cycles_ + ls->granted_[lane] - ls->left_[lane];
+		if (ran < fewest)
+		{
+			fewest = ran;
+			pc = ls->progCounter_[lane];
+		}
+	}
+	return pc;
+}
+
+/**
+@name:		syncLane
+@purpose:	Moves the opcodes a lane ran since its last grant into its chip's cycle count and
+			out of its remaining budget
+@param:		Lockstep *, int
+@return:	void
+*/
+static void syncLane(Lockstep * ls, int lane)
+{
+	uint16_t ran = ls->granted_[lane] - ls->left_[lane];
+	ls->chips_[lane]->cycles_ += ran;
+	ls->remaining_[lane] -= ran;
+	ls->granted_[lane] = ls->left_[lane];
+}
+
+/**
+@name:		grantLane
+@purpose:	Called when a lane is about to run an opcode with none left granted. Retires the
+			lane if its budget is spent. Otherwise ticks the timers if this opcode is the one
+			executeCode would tick on, and grants opcodes up to the next tick or the end of the
+			budget. Returns false if the lane was retired.
+@param:		Lockstep *, int
+@return:	bool
+*/
+static bool grantLane(Lockstep * ls, int lane)
+{
+	syncLane(ls, lane);
+	if (ls->remaining_[lane] == 0)
+	{
+		ls->live_ &= ~(1u << lane);
+		return false;
+	}
+
+	// the next opcode is cycle cycles_ + 1
+	Chip8 * chip = ls->chips_[lane];
+	if (chip->cycles_ + 1 >= chip->nextFrameCycle_)
+		tickFrame(chip);
+
+	// up to the opcode before the next tick; after a tick this opcode is the first of them
+	uint64_t grant = chip->nextFrameCycle_ > chip->cycles_ + 1 ? chip->nextFrameCycle_ - chip->cycles_ - 1 : 1;
+	if (grant > ls->remaining_[lane])
+		grant = ls->remaining_[lane];
+	if (grant > LOCKSTEP_MAX_GRANT)
+		grant = LOCKSTEP_MAX_GRANT;
+
+	ls->granted_[lane] = ls->left_[lane] = (uint16_t)grant;
+	return true;
+}
+
+/**
+@name:		consumeGrant
+@purpose:	Counts one opcode against the grant of each lane that ran it
+@param:		Lockstep *, uint32_t
+@return:	void
+*/
+static void consumeGrant(Lockstep * ls, uint32_t lanes)
+{
+#ifdef LOCKSTEP_AVX2
+	if (useAvx2)
+	{
+		consumeGrantAvx2(ls, lanes);
+		return;
+	}
+#endif
+
+	for (; lanes != 0; lanes &= lanes - 1)
+		--ls->left_[lowestLane(lanes)];
+}
+
+/**
+@name:		runFallback
+@purpose:	Runs an opcode one lane at a time through executeOp, on each lane's own chip with
+			the lane's registers copied in and back out. Pages the opcode writes are noted so
+			later fetches from them compare every lane's copy. Lanes that halt are retired.
+@param:		Lockstep *, const DecodedOp *, uint32_t, uint16_t
+@return:	void
+*/
+static void runFallback(Lockstep * ls, const DecodedOp * op, uint32_t lanes, uint16_t opCode)
+{
+	ls->stats_.fallbackOps_ += laneCount(lanes);
+
+	for (; lanes != 0; lanes &= lanes - 1)
+	{
+		int lane = lowestLane(lanes);
+		Chip8 * chip = ls->chips_[lane];
+
+		for (int r = 0; r < VREGSIZE; ++r)
+			chip->vReg_[r] = ls->vReg_[r][lane];
+		chip->regIndex_ = ls->regIndex_[lane];
+		chip->progCounter_ = ls->progCounter_[lane];
+		chip->opCode_ = opCode;
+
+		executeOp(chip, op);
+
+		for (int r = 0; r < VREGSIZE; ++r)
+			ls->vReg_[r][lane] = chip->vReg_[r];
+		ls->regIndex_[lane] = chip->regIndex_;
+		ls->progCounter_[lane] = chip->progCounter_;
+
+		if (chip->dirtyPages_ != 0)
+		{
+			for (uint64_t pages = chip->dirtyPages_; pages != 0; pages &= pages - 1)
+			{
+				int page = 0;
+				while (((pages >> page) & 1) == 0)
+					++page;
+				ls->pageWriters_[page] |= 1u << lane;
+			}
+			ls->savedDirty_[lane] |= chip->dirtyPages_;
+			chip->dirtyPages_ = 0;
+		}
+
+		if (chip->halted_)
+			ls->live_ &= ~(1u << lane);
+	}
+}
+
+/**
+@name:		runPerLane
+@purpose:	Runs an opcode that needs a lane's own timers, keys, stack, RNG or screen one lane
+			at a time, reading and writing the lane registers in place rather than copying them
+			all through the chip. Returns false for opcodes that need runFallback.
+@param:		Lockstep *, const DecodedOp *, uint32_t
+@return:	bool
+*/
+static bool runPerLane(Lockstep * ls, const DecodedOp * op, uint32_t lanes)
+{
+	switch (op->instr_)
+	{
+	case INSTR_CALL_RCA_ADDR: case INSTR_CALL_SUB: case INSTR_RETURN:
+	case INSTR_SET_VX_RAND_AND_NN: case INSTR_DRAW_VX_VY_N:
+	case INSTR_SKIP_IF_KEY_PRESSED: case INSTR_SKIP_IF_KEY_NT_PRESSED:
+	case INSTR_SET_VX_TO_DELAY_TIMER: case INSTR_SET_DELAY_TIMER_TO_VX: case INSTR_SET_SOUND_TIMER_TO_VX:
+		break;
+	default:
+		return false;
+	}
+
+	uint8_t * rowX = ls->vReg_[op->x_];
+	for (; lanes != 0; lanes &= lanes - 1)
+	{
+		int lane = lowestLane(lanes);
+		Chip8 * chip = ls->chips_[lane];
+		uint16_t * pc = &ls->progCounter_[lane];
+
+		switch (op->instr_)
+		{
+		case INSTR_CALL_RCA_ADDR:
+			*pc += 2;
+			break;
+		case INSTR_CALL_SUB:
+			chip->stack_[chip->stackPointer_] = *pc;
+			chip->stackPointer_ = (chip->stackPointer_ + 1) & (STACKSIZE - 1);
+			*pc = op->nnn_;
+			break;
+		case INSTR_RETURN:
+			chip->stackPointer_ = (chip->stackPointer_ - 1) & (STACKSIZE - 1);
+			*pc = chip->stack_[chip->stackPointer_] + 2;
+			break;
+		case INSTR_SET_VX_RAND_AND_NN:
+			rowX[lane] = nextRandom(chip) & op->nn_;
+			*pc += 2;
+			break;
+		case INSTR_DRAW_VX_VY_N:
+			// only the coordinates and I go in, only VF comes out
+			chip->vReg_[op->x_] = rowX[lane];
+			chip->vReg_[op->y_] = ls->vReg_[op->y_][lane];
+			chip->regIndex_ = ls->regIndex_[lane];
+			chip->progCounter_ = *pc;
+			opDrawVxVyN(chip, op);
+			ls->vReg_[0xF][lane] = chip->vReg_[0xF];
+			*pc = chip->progCounter_;
+			break;
+		case INSTR_SKIP_IF_KEY_PRESSED:
+			*pc += ((chip->keyMask_ >> (rowX[lane] & 0xF)) & 1) ? 4 : 2;
+			break;
+		case INSTR_SKIP_IF_KEY_NT_PRESSED:
+			*pc += ((chip->keyMask_ >> (rowX[lane] & 0xF)) & 1) ? 2 : 4;
+			break;
+		case INSTR_SET_VX_TO_DELAY_TIMER:
+			rowX[lane] = chip->delayTimer_;
+			*pc += 2;
+			break;
+		case INSTR_SET_DELAY_TIMER_TO_VX:
+			chip->delayTimer_ = rowX[lane];
+			chip->isDelay_ = chip->delayTimer_ > 0;
+			*pc += 2;
+			break;
+		case INSTR_SET_SOUND_TIMER_TO_VX:
+			chip->soundTimer_ = rowX[lane];
+			chip->soundPlaying_ = chip->soundTimer_ > 0;
+			*pc += 2;
+			break;
+		}
+	}
+
+	return true;
+}
+
+/**
+@name:		runVector
+@purpose:	Runs an opcode for every lane in the mask at once, if it only touches the lane
+			registers. Returns false for opcodes that need runFallback.
+@param:		Lockstep *, const DecodedOp *, uint32_t
+@return:	bool
+*/
+static bool runVector(Lockstep * ls, const DecodedOp * op, uint32_t lanes)
+{
+#ifdef LOCKSTEP_AVX2
+	if (useAvx2)
+		return runVectorAvx2(ls, op, lanes);
+#endif
+
+	switch (op->instr_)
+	{
+	case INSTR_GOTO_ADDR: case INSTR_JUMP_TO_ADDR_PLUS_V0:
+	case INSTR_VX_SKIP_EQUAL_ADDR: case INSTR_VX_SKIP_NEQUAL_ADDR: case INSTR_VX_NOT_VY: case INSTR_CHECK_VX_IS_VY:
+	case INSTR_SET_VX_TO_ADDR: case INSTR_SET_VX_VX_PLUS_ADDR: case INSTR_SET_VX_TO_VY:
+	case INSTR_SET_VX_VX_OR_VY: case INSTR_SET_VX_VX_AND_VY: case INSTR_SET_VX_VX_XOR_VY:
+	case INSTR_SET_VX_VX_PLUS_VY: case INSTR_SET_VX_VX_MINUS_VY: case INSTR_SET_VX_SHIFT_ONE_RIGHT:
+	case INSTR_SET_VX_VY_MINUS_VX: case INSTR_SET_VX_SHIFT_ONE_LEFT:
+	case INSTR_SET_INDEX_TO_ADDR_VAL: case INSTR_SET_INDEX_PLUS_VX: case INSTR_SET_INDEX_TO_SPRITE:
+		break;
+	default:
+		return false;
+	}
+
+	uint8_t * rowX = ls->vReg_[op->x_];
+	uint8_t * rowY = ls->vReg_[op->y_];
+	uint8_t * rowF = ls->vReg_[0xF];
+
+	for (; lanes != 0; lanes &= lanes - 1)
+	{
+		int lane = lowestLane(lanes);
+		uint16_t step = 2;
+
+		switch (op->instr_)
+		{
+		case INSTR_GOTO_ADDR:
+			ls->progCounter_[lane] = op->nnn_;
+			continue;
+		case INSTR_JUMP_TO_ADDR_PLUS_V0:
+			ls->progCounter_[lane] = op->nnn_ + ls->vReg_[0][lane];
+			continue;
+		case INSTR_VX_SKIP_EQUAL_ADDR:
+			step = rowX[lane] == op->nn_ ? 4 : 2;
+			break;
+		case INSTR_VX_SKIP_NEQUAL_ADDR:
+			step = rowX[lane] != op->nn_ ? 4 : 2;
+			break;
+		case INSTR_VX_NOT_VY:
+		case INSTR_CHECK_VX_IS_VY:
+			step = rowX[lane] != rowY[lane] ? 4 : 2;
+			break;
+		case INSTR_SET_VX_TO_ADDR:
+			rowX[lane] = op->nn_;
+			break;
+		case INSTR_SET_VX_VX_PLUS_ADDR:
+			rowX[lane] += op->nn_;
+			break;
+		case INSTR_SET_VX_TO_VY:
+			rowX[lane] = rowY[lane];
+			break;
+		case INSTR_SET_VX_VX_OR_VY:
+			rowX[lane] |= rowY[lane];
+			break;
+		case INSTR_SET_VX_VX_AND_VY:
+			rowX[lane] &= rowY[lane];
+			break;
+		case INSTR_SET_VX_VX_XOR_VY:
+			rowX[lane] ^= rowY[lane];
+			break;
+		case INSTR_SET_VX_VX_PLUS_VY:
+			rowF[lane] = rowY[lane] > (0xFF - rowX[lane]) ? 1 : 0;
+			rowX[lane] += rowY[lane];
+			break;
+		case INSTR_SET_VX_VX_MINUS_VY:
+			rowF[lane] = rowY[lane] > rowX[lane] ? 0 : 1;
+			rowX[lane] -= rowY[lane];
+			break;
+		case INSTR_SET_VX_SHIFT_ONE_RIGHT:
+			rowF[lane] = rowX[lane] & 1;
+			rowX[lane] >>= 1;
+			break;
+		case INSTR_SET_VX_VY_MINUS_VX:
+			rowF[lane] = rowX[lane] > rowY[lane] ? 0 : 1;
+			rowX[lane] = rowY[lane] - rowX[lane];
+			break;
+		case INSTR_SET_VX_SHIFT_ONE_LEFT:
+			rowF[lane] = rowX[lane] & 128;
+			rowX[lane] <<= 1;
+			break;
+		case INSTR_SET_INDEX_TO_ADDR_VAL:
+			ls->regIndex_[lane] = op->nnn_;
+			break;
+		case INSTR_SET_INDEX_PLUS_VX:
+			rowF[lane] = (ls->regIndex_[lane] + rowX[lane] > 0x0FFF) ? 1 : 0;
+			ls->regIndex_[lane] += rowX[lane];
+			break;
+		case INSTR_SET_INDEX_TO_SPRITE:
+			ls->regIndex_[lane] = rowX[lane] * 5;
+			break;
+		}
+
+		ls->progCounter_[lane] += step;
+	}
+	return true;
+}
+
+/**
+@name:		runLockstep
+@purpose:	Runs each chip for its own budget of opcodes, all together, leaving every chip in
+			the state runCycles would. Up to LOCKSTEP_LANES chips; meant for instances of one
+			ROM, but any mix runs correctly, just with less sharing. Stats accumulate in ls.
+			Returns false if it stopped early because fewer than minLanes lanes ran
+			each opcode for LOCKSTEP_LOW_CHECKS checks in a row; the chips are then part way
+			through their budgets, in the state runCycles would leave them in.
+@param:		Lockstep *, Chip8 **, const uint64_t *, uint32_t
+@return:	bool
+*/
+bool runLockstep(Lockstep * ls, Chip8 ** chips, const uint64_t * budgets, uint32_t count)
+{
+	if (count > LOCKSTEP_LANES)
+		count = LOCKSTEP_LANES;
+
+	ls->numLanes_ = count;
+	ls->live_ = 0;
+	for (uint32_t lane = 0; lane < LOCKSTEP_LANES; ++lane)
+	{
+		Chip8 * chip = lane < count ? chips[lane] : NULL;
+		ls->chips_[lane] = chip;
+		ls->granted_[lane] = ls->left_[lane] = 0;
+		ls->remaining_[lane] = chip != NULL ? budgets[lane] : 0;
+
+		for (int r = 0; r < VREGSIZE; ++r)
+			ls->vReg_[r][lane] = chip != NULL ? chip->vReg_[r] : 0;
+		ls->regIndex_[lane] = chip != NULL ? chip->regIndex_ : 0;
+		ls->progCounter_[lane] = chip != NULL ? chip->progCounter_ : 0;
+
+		if (chip == NULL)
+			continue;
+
+		// dirtyPages_ collects this run's writes; what it held before is put back at the end
+		ls->savedDirty_[lane] = chip->dirtyPages_;
+		chip->dirtyPages_ = 0;
+		if (ls->remaining_[lane] != 0 && !chip->halted_)
+			ls->live_ |= 1u << lane;
+	}
+
+	// pages that already differ from lane 0's must be fetched per lane
+	for (int page = 0; page < MEMSIZE / CODE_PAGE_SIZE; ++page)
+	{
+		ls->pageWriters_[page] = 0;
+		for (uint32_t lane = 1; lane < count; ++lane)
+			if (memcmp(memAt(chips[lane], page * CODE_PAGE_SIZE), memAt(chips[0], page * CODE_PAGE_SIZE), CODE_PAGE_SIZE) != 0)
+				ls->pageWriters_[page] |= 1u << lane;
+	}
+
+	uint64_t diverged = 0;
+	bool together = true;
+	while (ls->live_ != 0)
+	{
+		if (ls->windowSteps_ == LOCKSTEP_OCCUPANCY_STEPS)
+		{
+			bool low = ls->windowLaneOps_ < (uint64_t)minLanes * LOCKSTEP_OCCUPANCY_STEPS;
+			ls->lowChecks_ = low ? ls->lowChecks_ + 1 : 0;
+			ls->windowSteps_ = 0;
+			ls->windowLaneOps_ = 0;
+			if (ls->lowChecks_ == LOCKSTEP_LOW_CHECKS)
+			{
+				together = false;
+				break;
+			}
+		}
+
+		uint16_t pc = lowestLivePc(ls);
+		uint32_t active = lanesMatching(ls->progCounter_, pc) & ls->live_;
+		if (active != ls->live_ && ++diverged % LOCKSTEP_REGROUP_STEPS == 0)
+		{
+			pc = furthestBehindPc(ls);
+			active = lanesMatching(ls->progCounter_, pc) & ls->live_;
+			++ls->stats_.regroups_;
+		}
+
+		// timer ticks and spent budgets
+		for (uint32_t due = lanesMatching(ls->left_, 0) & active; due != 0; due &= due - 1)
+		{
+			int lane = lowestLane(due);
+			if (!grantLane(ls, lane))
+				active &= ~(1u << lane);
+		}
+		if (active == 0)
+			continue;
+
+		int lead = lowestLane(active);
+		uint16_t opCode = opCodeAt(ls->chips_[lead], pc);
+
+		// lanes that wrote over the code here may hold a different opcode; they wait
+		uint32_t writers = ls->pageWriters_[(pc & ADDR_MASK) / CODE_PAGE_SIZE] | ls->pageWriters_[((pc + 1) & ADDR_MASK) / CODE_PAGE_SIZE];
+		if ((writers & active) != 0)
+		{
+			for (uint32_t others = active & (active - 1); others != 0; others &= others - 1)
+			{
+				int lane = lowestLane(others);
+				if (opCodeAt(ls->chips_[lane], pc) != opCode)
+					active &= ~(1u << lane);
+			}
+		}
+
+		++ls->stats_.steps_;
+		ls->stats_.laneOps_ += laneCount(active);
+		++ls->windowSteps_;
+		ls->windowLaneOps_ += laneCount(active);
+		ls->stats_.liveLanes_ += laneCount(ls->live_);
+
+		DecodedOp decoded = decodeOp(opCode);
+		const DecodedOp * op = &decoded;
+		if (!runVector(ls, op, active))
+		{
+			if (runPerLane(ls, op, active))
+				ls->stats_.perLaneOps_ += laneCount(active);
+			else
+				runFallback(ls, op, active, opCode);
+		}
+		consumeGrant(ls, active);
+	}
+
+	for (uint32_t lane = 0; lane < count; ++lane)
+	{
+		Chip8 * chip = chips[lane];
+		syncLane(ls, lane);
+
+		for (int r = 0; r < VREGSIZE; ++r)
+			chip->vReg_[r] = ls->vReg_[r][lane];
+		chip->regIndex_ = ls->regIndex_[lane];
+		chip->progCounter_ = ls->progCounter_[lane];
+		chip->dirtyPages_ |= ls->savedDirty_[lane];
+	}
+
+	return together;
+}
+
+/**
+@name:		printLockstepStats
+@purpose:	Prints how many lanes each issued opcode ran on, against all lanes and against the
+			lanes that still had work, and how much ran one lane at a time
+@param:		const LockstepStats *
+@return:	void
+*/
+void printLockstepStats(const LockstepStats * stats)
+{
+	if (stats->steps_ == 0)
+		return;
+
+	printf("Lockstep (%s): %" PRIu64 " opcodes issued, %.1f lanes each\n",
+		useAvx2 ? "AVX2" : "scalar", stats->steps_, (double)stats->laneOps_ / stats->steps_);
+	printf("Lane utilisation: %.1f%% of %d lanes, %.1f%% of lanes with work left\n",
+		100.0 * stats->laneOps_ / ((double)stats->steps_ * LOCKSTEP_LANES), LOCKSTEP_LANES,
+		stats->liveLanes_ ? 100.0 * stats->laneOps_ / stats->liveLanes_ : 0.0);
+	printf("One lane at a time: %.1f%% of lane opcodes in place, %.1f%% through executeOp; regroups: %" PRIu64 "\n",
+		stats->laneOps_ ? 100.0 * stats->perLaneOps_ / stats->laneOps_ : 0.0,
+		stats->laneOps_ ? 100.0 * stats->fallbackOps_ / stats->laneOps_ : 0.0, stats->regroups_);
+	if (stats->handedOff_ != 0)
+		printf("Handed off: %" PRIu64 " jobs to their own engine below %u lanes per opcode\n", stats->handedOff_, minLanes);
+}
@@ -0,0 +1,67 @@
+/**	@file lockstep.hpp
+@note Developed for C++17/vc14.1
+@brief Lockstep engine: runs up to 32 instances of the same ROM together, with the hot
+	   registers laid out across lanes so common opcodes execute for all lanes at once
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+
+#define LOCKSTEP_LANES 32
+#define LOCKSTEP_REGROUP_STEPS 64		// diverged steps between picks of the furthest-behind lane
+#define LOCKSTEP_MAX_GRANT 0xFFFF		// most instructions a lane may run between events
+
+// AVX2 kernels are built on x86 and picked at startup if the CPU has AVX2; scalar lane loops otherwise
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LOCKSTEP_AVX2 1
+#endif
+
+// below this many lanes per opcode, running each chip on its own engine is faster
+#define LOCKSTEP_OCCUPANCY_STEPS 16384	// opcodes issued between occupancy checks
+#define LOCKSTEP_LOW_CHECKS 8			// checks in a row below the minimum before giving up
+#define LOCKSTEP_MIN_LANES_AVX2 3
+#define LOCKSTEP_MIN_LANES_SCALAR 24
+
+typedef struct LockstepStats
+{
+	uint64_t steps_;		// opcodes issued
+	uint64_t laneOps_;		// opcodes executed, summed over lanes
+	uint64_t liveLanes_;	// lanes with work left, summed over steps
+	uint64_t perLaneOps_;	// lane opcodes run one lane at a time on the lane registers
+	uint64_t fallbackOps_;	// lane opcodes run one lane at a time through executeOp
+	uint64_t regroups_;		// steps that issued the furthest-behind lane's PC
+	uint64_t handedOff_;	// jobs left to run on their own engine after occupancy fell
+} LockstepStats;
+
+/*
+Lane l's vReg_, regIndex_ and progCounter_ live in column l of the arrays below while the
+engine runs; everything else stays in its own Chip8. Each step issues one PC: the lowest
+one among lanes with work left, so lanes that branched apart meet again at the join, and
+every LOCKSTEP_REGROUP_STEPS diverged steps the PC of the lane furthest behind, so none is
+starved. Lanes at that PC run the opcode together, the rest are masked off.
+*/
+typedef struct Lockstep
+{
+	alignas(32) uint8_t vReg_[VREGSIZE][LOCKSTEP_LANES];
+	alignas(32) uint16_t regIndex_[LOCKSTEP_LANES];
+	alignas(32) uint16_t progCounter_[LOCKSTEP_LANES];
+	alignas(32) uint16_t left_[LOCKSTEP_LANES];		// opcodes each lane may run before its next timer tick or budget check
+
+	Chip8 * chips_[LOCKSTEP_LANES];
+	uint32_t numLanes_;
+	uint32_t live_;				// lanes with budget left that have not halted
+	uint16_t granted_[LOCKSTEP_LANES];
+	uint64_t remaining_[LOCKSTEP_LANES];
+	uint64_t savedDirty_[LOCKSTEP_LANES];
+	uint32_t pageWriters_[MEMSIZE / CODE_PAGE_SIZE];	// lanes whose copy of each page may differ from the others'
+	// occupancy, measured across calls: zero these for a new set of chips
+	uint32_t windowSteps_;		// opcodes issued since the last check
+	uint64_t windowLaneOps_;
+	uint32_t lowChecks_;		// checks in a row that found too few lanes
+
+	LockstepStats stats_;
+} Lockstep;
+
+bool runLockstep(Lockstep * ls, Chip8 ** chips, const uint64_t * budgets, uint32_t count);
+void printLockstepStats(const LockstepStats * stats);
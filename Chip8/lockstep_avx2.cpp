@@ -0,0 +1,278 @@
+/**	@file lockstep_avx2.cpp
+@note Developed for C++17/vc14.1
+@brief AVX2 kernels for the lockstep engine: the only code built for AVX2 (/arch:AVX2 on
+	   this file in the Visual Studio project, a target attribute elsewhere)
+*/
+
+#include "lockstep_avx2.hpp"
+
+#ifdef LOCKSTEP_AVX2
+#include <immintrin.h>
+
+// nothing here may call an inline function from another header: its copy would be built for AVX2 too
+#ifdef _MSC_VER
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+/**
+@name:		byteMask
+@purpose:	Expands a lane mask to one byte per lane, 0xFF where the lane's bit is set
+@param:		uint32_t
+@return:	__m256i
+*/
+AVX2_TARGET static inline __m256i byteMask(uint32_t lanes)
+{
+	const __m256i spread = _mm256_setr_epi64x(0x0000000000000000LL, 0x0101010101010101LL, 0x0202020202020202LL, 0x0303030303030303LL);
+	const __m256i bits = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+
+	__m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32((int)lanes), spread);
+	return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+}
+
+/**
+@name:		laneMask16
+@purpose:	Packs two vectors of 16-bit all-ones/all-zeros lanes (lanes 0-15, 16-31) into a lane mask
+@param:		__m256i, __m256i
+@return:	uint32_t
+*/
+AVX2_TARGET static inline uint32_t laneMask16(__m256i low, __m256i high)
+{
+	// packs works within 128-bit halves, so the quadwords come out as low, high, low, high
+	__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+	return (uint32_t)_mm256_movemask_epi8(packed);
+}
+
+/**
+@name:		gtU8
+@purpose:	Unsigned a > b per byte
+@param:		__m256i, __m256i
+@return:	__m256i
+*/
+AVX2_TARGET static inline __m256i gtU8(__m256i a, __m256i b)
+{
+	const __m256i bias = _mm256_set1_epi8((char)0x80);
+	return _mm256_cmpgt_epi8(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+}
+
+/**
+@name:		storeRow
+@purpose:	Writes a register row for the lanes in a byte mask only
+@param:		uint8_t *, __m256i, __m256i
+@return:	void
+*/
+AVX2_TARGET static inline void storeRow(uint8_t * row, __m256i value, __m256i mask)
+{
+	__m256i old = _mm256_load_si256(reinterpret_cast<const __m256i *>(row));
+	_mm256_store_si256(reinterpret_cast<__m256i *>(row), _mm256_blendv_epi8(old, value, mask));
+}
+
+/**
+@name:		storeWords
+@purpose:	Writes 32 16-bit lanes (as two vectors) for the lanes in the masks only
+@param:		uint16_t *, __m256i, __m256i, __m256i, __m256i
+@return:	void
+*/
+AVX2_TARGET static inline void storeWords(uint16_t * words, __m256i low, __m256i high, __m256i maskLow, __m256i maskHigh)
+{
+	__m256i * out = reinterpret_cast<__m256i *>(words);
+	_mm256_store_si256(out, _mm256_blendv_epi8(_mm256_load_si256(out), low, maskLow));
+	_mm256_store_si256(out + 1, _mm256_blendv_epi8(_mm256_load_si256(out + 1), high, maskHigh));
+}
+
+/**
+@name:		lowestLivePcAvx2
+@purpose:	Returns the lowest PC among lanes with work left
+@param:		const Lockstep *
+@return:	uint16_t
+*/
+AVX2_TARGET uint16_t lowestLivePcAvx2(const Lockstep * ls)
+{
+	__m256i live = byteMask(ls->live_);
+	__m256i liveLow = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(live));
+	__m256i liveHigh = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(live, 1));
+	const __m256i * pcs = reinterpret_cast<const __m256i *>(ls->progCounter_);
+
+	// lanes without work read as 0xFFFF
+	__m256i low = _mm256_or_si256(_mm256_load_si256(pcs), _mm256_andnot_si256(liveLow, _mm256_set1_epi16(-1)));
+	__m256i high = _mm256_or_si256(_mm256_load_si256(pcs + 1), _mm256_andnot_si256(liveHigh, _mm256_set1_epi16(-1)));
+	__m256i both = _mm256_min_epu16(low, high);
+	__m128i half = _mm_min_epu16(_mm256_castsi256_si128(both), _mm256_extracti128_si256(both, 1));
+	return (uint16_t)_mm_extract_epi16(_mm_minpos_epu16(half), 0);
+}
+
+/**
+@name:		lanesMatchingAvx2
+@purpose:	Returns the mask of lanes whose entry in a 16-bit lane array equals value
+@param:		const uint16_t *, uint16_t
+@return:	uint32_t
+*/
+AVX2_TARGET uint32_t lanesMatchingAvx2(const uint16_t * words, uint16_t value)
+{
+	const __m256i * in = reinterpret_cast<const __m256i *>(words);
+	__m256i match = _mm256_set1_epi16((short)value);
+	return laneMask16(_mm256_cmpeq_epi16(_mm256_load_si256(in), match), _mm256_cmpeq_epi16(_mm256_load_si256(in + 1), match));
+}
+
+/**
+@name:		consumeGrantAvx2
+@purpose:	Counts one opcode against the grant of each lane that ran it
+@param:		Lockstep *, uint32_t
+@return:	void
+*/
+AVX2_TARGET void consumeGrantAvx2(Lockstep * ls, uint32_t lanes)
+{
+	__m256i mask = byteMask(lanes);
+	__m256i one = _mm256_set1_epi16(1);
+	__m256i * left = reinterpret_cast<__m256i *>(ls->left_);
+	_mm256_store_si256(left, _mm256_sub_epi16(_mm256_load_si256(left), _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask)), one)));
+	_mm256_store_si256(left + 1, _mm256_sub_epi16(_mm256_load_si256(left + 1), _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask, 1)), one)));
+}
+
+/**
+@name:		runVectorAvx2
+@purpose:	Runs an opcode for every lane in the mask at once, if it only touches the lane
+			registers. Returns false for opcodes that need runFallback.
+@param:		Lockstep *, const DecodedOp *, uint32_t
+@return:	bool
+*/
+AVX2_TARGET bool runVectorAvx2(Lockstep * ls, const DecodedOp * op, uint32_t lanes)
+{
+	const uint8_t x = op->x_;
+	const uint8_t y = op->y_;
+
+	__m256i mask = byteMask(lanes);
+	__m256i maskLow = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask));
+	__m256i maskHigh = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask, 1));
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi16(2);
+
+	__m256i * pcs = reinterpret_cast<__m256i *>(ls->progCounter_);
+	__m256i * index = reinterpret_cast<__m256i *>(ls->regIndex_);
+	uint8_t * rowX = ls->vReg_[x];
+	uint8_t * rowY = ls->vReg_[y];
+	uint8_t * rowF = ls->vReg_[0xF];
+	__m256i vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+	__m256i vy = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowY));
+	__m256i skip = _mm256_setzero_si256();	// per byte lane, for the conditional skips
+
+	switch (op->instr_)
+	{
+	case INSTR_GOTO_ADDR:
+	{
+		__m256i target = _mm256_set1_epi16((short)op->nnn_);
+		storeWords(ls->progCounter_, target, target, maskLow, maskHigh);
+		return true;
+	}
+	case INSTR_JUMP_TO_ADDR_PLUS_V0:
+	{
+		__m256i v0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(ls->vReg_[0]));
+		__m256i base = _mm256_set1_epi16((short)op->nnn_);
+		storeWords(ls->progCounter_, _mm256_add_epi16(base, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v0))),
+			_mm256_add_epi16(base, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v0, 1))), maskLow, maskHigh);
+		return true;
+	}
+	case INSTR_VX_SKIP_EQUAL_ADDR:
+		skip = _mm256_cmpeq_epi8(vx, _mm256_set1_epi8((char)op->nn_));
+		break;
+	case INSTR_VX_SKIP_NEQUAL_ADDR:
+		skip = _mm256_xor_si256(_mm256_cmpeq_epi8(vx, _mm256_set1_epi8((char)op->nn_)), _mm256_set1_epi8(-1));
+		break;
+	case INSTR_VX_NOT_VY:
+	case INSTR_CHECK_VX_IS_VY:		// 5XY0 skips when they differ too
+		skip = _mm256_xor_si256(_mm256_cmpeq_epi8(vx, vy), _mm256_set1_epi8(-1));
+		break;
+	case INSTR_SET_VX_TO_ADDR:
+		storeRow(rowX, _mm256_set1_epi8((char)op->nn_), mask);
+		break;
+	case INSTR_SET_VX_VX_PLUS_ADDR:
+		storeRow(rowX, _mm256_add_epi8(vx, _mm256_set1_epi8((char)op->nn_)), mask);
+		break;
+	case INSTR_SET_VX_TO_VY:
+		storeRow(rowX, vy, mask);
+		break;
+	case INSTR_SET_VX_VX_OR_VY:
+		storeRow(rowX, _mm256_or_si256(vx, vy), mask);
+		break;
+	case INSTR_SET_VX_VX_AND_VY:
+		storeRow(rowX, _mm256_and_si256(vx, vy), mask);
+		break;
+	case INSTR_SET_VX_VX_XOR_VY:
+		storeRow(rowX, _mm256_xor_si256(vx, vy), mask);
+		break;
+
+	// VF is written first, then VX and VY are read again, as the scalar ops do when X or Y is F
+	case INSTR_SET_VX_VX_PLUS_VY:
+		storeRow(rowF, _mm256_and_si256(gtU8(vy, _mm256_xor_si256(vx, _mm256_set1_epi8(-1))), one), mask);
+		vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+		vy = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowY));
+		storeRow(rowX, _mm256_add_epi8(vx, vy), mask);
+		break;
+	case INSTR_SET_VX_VX_MINUS_VY:
+		storeRow(rowF, _mm256_andnot_si256(gtU8(vy, vx), one), mask);
+		vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+		vy = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowY));
+		storeRow(rowX, _mm256_sub_epi8(vx, vy), mask);
+		break;
+	case INSTR_SET_VX_SHIFT_ONE_RIGHT:
+		storeRow(rowF, _mm256_and_si256(vx, one), mask);
+		vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+		storeRow(rowX, _mm256_and_si256(_mm256_srli_epi16(vx, 1), _mm256_set1_epi8(0x7F)), mask);
+		break;
+	case INSTR_SET_VX_VY_MINUS_VX:
+		storeRow(rowF, _mm256_andnot_si256(gtU8(vx, vy), one), mask);
+		vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+		vy = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowY));
+		storeRow(rowX, _mm256_sub_epi8(vy, vx), mask);
+		break;
+	case INSTR_SET_VX_SHIFT_ONE_LEFT:
+		storeRow(rowF, _mm256_and_si256(vx, _mm256_set1_epi8((char)0x80)), mask);
+		vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+		storeRow(rowX, _mm256_add_epi8(vx, vx), mask);
+		break;
+
+	case INSTR_SET_INDEX_TO_ADDR_VAL:
+	{
+		__m256i addr = _mm256_set1_epi16((short)op->nnn_);
+		storeWords(ls->regIndex_, addr, addr, maskLow, maskHigh);
+		break;
+	}
+	case INSTR_SET_INDEX_PLUS_VX:
+	{
+		// VF = I + VX > 0xFFF, compared as unsigned 16-bit: I > 0xFFF - VX
+		const __m256i bias = _mm256_set1_epi16((short)0x8000);
+		const __m256i limit = _mm256_set1_epi16(0x0FFF);
+		__m256i low = _mm256_load_si256(index);
+		__m256i high = _mm256_load_si256(index + 1);
+		__m256i overLow = _mm256_cmpgt_epi16(_mm256_xor_si256(low, bias),
+			_mm256_xor_si256(_mm256_sub_epi16(limit, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(vx))), bias));
+		__m256i overHigh = _mm256_cmpgt_epi16(_mm256_xor_si256(high, bias),
+			_mm256_xor_si256(_mm256_sub_epi16(limit, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(vx, 1))), bias));
+		__m256i over = _mm256_permute4x64_epi64(_mm256_packs_epi16(overLow, overHigh), 0xD8);
+		storeRow(rowF, _mm256_and_si256(over, one), mask);
+
+		vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(rowX));
+		storeWords(ls->regIndex_, _mm256_add_epi16(low, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(vx))),
+			_mm256_add_epi16(high, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(vx, 1))), maskLow, maskHigh);
+		break;
+	}
+	case INSTR_SET_INDEX_TO_SPRITE:
+	{
+		const __m256i five = _mm256_set1_epi16(5);
+		storeWords(ls->regIndex_, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(vx)), five),
+			_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(vx, 1)), five), maskLow, maskHigh);
+		break;
+	}
+	default:
+		return false;
+	}
+
+	// PC += 2, or 4 where a skip was taken
+	__m256i stepLow = _mm256_add_epi16(two, _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(skip)), two));
+	__m256i stepHigh = _mm256_add_epi16(two, _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(skip, 1)), two));
+	_mm256_store_si256(pcs, _mm256_add_epi16(_mm256_load_si256(pcs), _mm256_and_si256(stepLow, maskLow)));
+	_mm256_store_si256(pcs + 1, _mm256_add_epi16(_mm256_load_si256(pcs + 1), _mm256_and_si256(stepHigh, maskHigh)));
+	return true;
+}
+#endif
@@ -0,0 +1,16 @@
+/**	@file lockstep_avx2.hpp
+@note Developed for C++17/vc14.1
+@brief AVX2 kernels for the lockstep engine, for lockstep.cpp to call where the CPU has AVX2
+*/
+
+#pragma once
+#include <cstdint>
+#include "lockstep.hpp"
+#include "opcodes.hpp"
+
+#ifdef LOCKSTEP_AVX2
+uint16_t lowestLivePcAvx2(const Lockstep * ls);
+uint32_t lanesMatchingAvx2(const uint16_t * words, uint16_t value);
+void consumeGrantAvx2(Lockstep * ls, uint32_t lanes);
+bool runVectorAvx2(Lockstep * ls, const DecodedOp * op, uint32_t lanes);
+#endif
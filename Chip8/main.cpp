@@ -6,79 +6,375 @@
 @brief Entry point
 */
 
-#include "graphics.hpp"
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <thread>
+#include "aot.hpp"
+#include "bench.hpp"
+#include "farm.hpp"
+#include "headless.hpp"
+#include "rewind.hpp"
+#include "savestate.hpp"
+#include "scheduler.hpp"
+
+// Define CHIP8_NO_SIGIL to build without SIGIL; only --headless is available then.
+#ifndef CHIP8_NO_SIGIL
+#include "graphics.hpp"
+#endif
 
-// chip8.exe <program_path> --<speed>
+// chip8.exe <program_path> --<speed>/--ips <n> [--turbo] [--frameskip <n>] [--headless/--bench] [--cycles <n>] [--clip] [--engine <name>] [--filter <name>] [--dump <file>] [--record <file>] [--rewind <MB>] [--load-state <file>] [--save-state <file>]
+// chip8.exe <program_path> --translate <out.cpp>
+// chip8.exe <job_list> --farm [--threads <n>] [--repeat <n>] [--lockstep/--host] [--hugepages] [--load-state <file>] [--cycles <n>] [--seed <n>] [--engine <name>]
 
-int main(int argc, char * argv[])
+#ifndef CHIP8_NO_SIGIL
+// Time spent in turbo mode, for the throughput report
+typedef struct TurboStats
 {
-	Chip8 chip;
-	GSI gsi;
+	uint64_t cycles_;
+	double seconds_;
+	uint64_t startCycles_;
+	std::chrono::steady_clock::time_point startTime_;
+} TurboStats;
 
+/**
+@name:		emulate
+@purpose:	CPU thread: runs the chip a 60Hz frame at a time, publishing and recording each
+			frame and latching keys at its end, then waits for the next frame's deadline. In
+			turbo mode there is no wait and only every frameSkip_-th frame is published; timers
+			still tick per emulated frame. In debug mode it runs one instruction per step instead.
+			With a rewind history, every frame is added to it, and while the rewind key is held
+			each frame steps back one instead of running. Stops when running is cleared or the
+			chip halts.
+@param:		GSI *, Scheduler *, Recorder *, Rewind *, TurboStats *, std::atomic<bool> *
+@return:	void
+*/
+static void emulate(GSI * gsi, Scheduler * sched, Recorder * recorder, Rewind * rewind, TurboStats * turbo, std::atomic<bool> * running)
+{
+	Chip8 * chip = gsi->chip_;
+	bool wasTurbo = false;
+	latchInput(gsi);
+
+	while (running->load())
+	{
+		if (!applyInput(gsi))
+		{
+			// paused in the debugger, waiting for N
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			restartSchedule(sched);
+			continue;
+		}
+
+		bool isTurbo = gsi->turbo_.load(std::memory_order_relaxed) && !chip->inDebug_;
+		if (isTurbo != wasTurbo)
+		{
+			// measure turbo spans only; back at normal speed, pacing starts over from now
+			auto now = std::chrono::steady_clock::now();
+			if (isTurbo)
+			{
+				turbo->startCycles_ = chip->cycles_;
+				turbo->startTime_ = now;
+			}
+			else
+			{
+				turbo->cycles_ += chip->cycles_ - turbo->startCycles_;
+				turbo->seconds_ += std::chrono::duration<double>(now - turbo->startTime_).count();
+				restartSchedule(sched);
+			}
+			wasTurbo = isTurbo;
+		}
+
+		if (rewind != NULL && !chip->inDebug_ && gsi->rewind_.load(std::memory_order_relaxed))
+		{
+			// played back at normal speed whatever the turbo setting, so it can be followed
+			rewindFrames(rewind, chip, 1);
+			publishScreen(gsi);
+			latchInput(gsi);
+			waitForFrame(sched);
+			continue;
+		}
+
+		uint64_t frame = chip->frameCount_;
+		if (chip->inDebug_)
+			executeCode(chip);
+
+		// the clock rate sets how many instructions make up a frame; the last one ticks the timers.
+		// Idle loops are skipped up to the tick, so an idle game leaves the thread asleep in
+		// waitForFrame for almost the whole frame.
+		while (!chip->inDebug_ && chip->frameCount_ == frame && !chip->halted_)
+		{
+			skipIdle(chip, UINT64_MAX);
+			executeCode(chip);
+		}
+
+		if (chip->halted_)
+			break;
+
+		if (recorder != NULL && chip->frameCount_ != frame)
+			recordFrame(recorder, chip->gBuffer_, chip->frameCount_);
+		if (rewind != NULL && chip->frameCount_ != frame)
+			recordRewind(rewind, chip);
+
+		if (!isTurbo || chip->frameCount_ % gsi->frameSkip_ == 0)
+			publishScreen(gsi);
+		latchInput(gsi);
+
+		if (chip->inDebug_)
+			restartSchedule(sched);
+		else if (!isTurbo)
+			waitForFrame(sched);
+	}
+
+	if (wasTurbo)
+	{
+		turbo->cycles_ += chip->cycles_ - turbo->startCycles_;
+		turbo->seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - turbo->startTime_).count();
+	}
+
+	running->store(false);
+}
+#endif
+
+static const char usage[] = "Format is: path_name [--slow/--med/--fast/--ips N] [--turbo] [--frameskip N] [--headless/--bench] [--cycles N] [--clip] [--engine switch/table/threaded/blocks/jit/aot] [--filter nearest/scale2x/scale4x] [--dump out.png/out.ppm] [--record out.y4m/out.raw] [--rewind MB] [--load-state in.sav] [--save-state out.sav] [--seed N] [--translate out.cpp]\n"
+	"       job_list --farm [--threads N] [--repeat N] [--lockstep/--host] [--hugepages] [--load-state in.sav] [--cycles N] [--seed N] [--engine name]\n";
+
+int main(int argc, char * argv[])
+{
 	// default speed if there are no arguments
 	long speed = MED_SPEED;
-
-	char path[256] = "\\Games\\PONG.bin";
-	char slowFlag[] = "--slow";
-	char medFlag[] = "--med";
-	char fastFlag[] = "--fast";
+	uint32_t ips = 0;		// overrides speed when set
+	bool turbo = false;
+	uint32_t frameSkip = DEFAULT_FRAME_SKIP;
+	bool headless = false;
+	bool bench = false;
+	bool farm = false;
+	uint32_t threads = 0;		// one per core
+	uint32_t repeat = 1;
+	FarmMode farmMode = FARM_STEAL;
+	bool hugePages = false;
+	uint32_t seed = 0;
+	bool seeded = false;
+	bool clipSprites = false;
+	Engine engine = ENGINE_SWITCH;
+	uint64_t cycles = DEFAULT_HEADLESS_CYCLES;
+	const char * translatePath = NULL;
+	const char * dumpPath = NULL;
+	const char * recordPath = NULL;
+	uint32_t rewindMB = REWIND_DEFAULT_BYTES >> 20;	// the window's history; headless keeps none unless asked
+	bool rewindSet = false;
+	const char * loadStatePath = NULL;
+	const char * saveStatePath = NULL;
+	bool useRaster = false;
+	RasterFilter filter = FILTER_NEAREST;
 
 	if (argc == 1)
 	{
-		printf("Too few arguments!\nFormat is: path_name [--slow/--med/--fast]");
+		printf("Too few arguments!\n%s", usage);
 		exit(1);
 	}
-	if (argc == 2)
-	{
-		memset(path, 0, 256);
-		memcpy_s(path, 256, argv[1], strlen(argv[1]));
-	}
-	else if (argc == 3)
+
+	const char * path = argv[1];
+
+	for (int i = 2; i < argc; ++i)
 	{
-		memset(path, 0, 256);
-		memcpy_s(path, 256, argv[1], strlen(argv[1]));
+		if (strncmp(argv[i], "--", 2) != 0)
+		{
+			printf("Too many arguments!\n%s", usage);
+			exit(1);
+		}
 
-		char flagCheck[3];
-		strncpy_s(flagCheck, argv[2], 2);
-		flagCheck[2] = '\0';
-		if (strcmp(flagCheck, "--") == 0)
+		if (strcmp(argv[i], "--slow") == 0)
+			speed = SLOW_SPEED;
+		else if (strcmp(argv[i], "--med") == 0)
+			speed = MED_SPEED;
+		else if (strcmp(argv[i], "--fast") == 0)
+			speed = FAST_SPEED;
+		else if (strcmp(argv[i], "--turbo") == 0)
+			turbo = true;
+		else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc)
 		{
-			if (strcmp(argv[2], slowFlag) == 0)
-				speed = SLOW_SPEED;
-			else if (strcmp(argv[2], medFlag) == 0)
-				speed = MED_SPEED;
-			else if (strcmp(argv[2], fastFlag) == 0)
-				speed = FAST_SPEED;
-			else
+			frameSkip = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (frameSkip == 0)
 			{
-				printf("Speed flag not recognized!\n");
+				printf("Frame skip must be a positive number: %s\n%s", argv[i], usage);
 				exit(1);
 			}
 		}
-	}
-	else if (argc > 3)
-	{
-		printf("Too many arguments!\nFormat is: path_name [--slow/--med/--fast]");
-		exit(1);
+		else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+		{
+			ips = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (ips == 0)
+			{
+				printf("Instructions per second must be a positive number: %s\n%s", argv[i], usage);
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if (strcmp(argv[i], "--bench") == 0)
+			bench = true;
+		else if (strcmp(argv[i], "--farm") == 0)
+			farm = true;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--lockstep") == 0)
+			farmMode = FARM_LOCKSTEP;
+		else if (strcmp(argv[i], "--host") == 0)
+			farmMode = FARM_HOST;
+		else if (strcmp(argv[i], "--hugepages") == 0)
+			hugePages = true;
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+			seeded = true;
+		}
+		else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+			cycles = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--clip") == 0)
+			clipSprites = true;
+		else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+			dumpPath = argv[++i];
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+			loadStatePath = argv[++i];
+		else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+			saveStatePath = argv[++i];
+		else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc)
+		{
+			rewindMB = (uint32_t)strtoul(argv[++i], NULL, 10);
+			rewindSet = true;
+			if (rewindMB > 1024)
+			{
+				printf("Rewind history must be at most 1024 MB: %s\n%s", argv[i], usage);
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			if (!rasterFilterFromName(argv[++i], &filter))
+			{
+				printf("Filter not recognized: %s\n%s", argv[i], usage);
+				exit(1);
+			}
+			useRaster = true;
+		}
+		else if (strcmp(argv[i], "--translate") == 0 && i + 1 < argc)
+			translatePath = argv[++i];
+		else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+		{
+			if (!engineFromName(argv[++i], &engine))
+			{
+				printf("Engine not recognized: %s\n%s", argv[i], usage);
+				exit(1);
+			}
+		}
+		else
+		{
+			printf("Flag not recognized: %s\n%s", argv[i], usage);
+			exit(1);
+		}
 	}
 
+	uint32_t clockHz = ips != 0 ? ips : (uint32_t)(1'000'000'000 / speed);
+
+	if (translatePath != NULL)
+		return translateRom(path, translatePath);
+
+	if (bench)
+		return runBenchmark(path, cycles, clockHz, clipSprites);
+
+	if (farm)
+		return runFarm(path, cycles, clockHz, engine, clipSprites, seed, repeat, threads, farmMode, hugePages, loadStatePath);
+
+	if (headless)
+		return runHeadless(path, cycles, clockHz, engine, clipSprites, seeded ? &seed : NULL, dumpPath, filter, recordPath, rewindSet ? rewindMB << 20 : 0, loadStatePath, saveStatePath);
+
+#ifdef CHIP8_NO_SIGIL
+	(void)useRaster;
+	(void)turbo;
+	printf("This build has no display; use --headless.\n");
+	return 1;
+#else
+	static Chip8 chip;
+	GSI gsi;
+
 	initChip(&chip);
+	setClockRate(&chip, clockHz);
+	chip.clipSprites_ = clipSprites;
+	if (seeded)
+		seedRandom(&chip, seed);
 	loadGame(&chip, path);
-	setupScreen(&gsi, &chip);
+
+	// the state's memory is used in place, so the file stays mapped until exit
+	static SaveFile state;
+	if (loadStatePath != NULL && (!openSaveState(&state, loadStatePath) || !restoreSaveState(&chip, &state)))
+		exit(1);
+
+	setupScreen(&gsi, &chip, useRaster ? &filter : NULL);
 	slRender();
 
-	while (!slGetKey(SL_KEY_ESCAPE))
+	// frames the disk cannot keep up with are dropped rather than slowing the CPU thread
+	static Recorder recorder;
+	if (recordPath != NULL && !startRecording(&recorder, recordPath, false))
+	{
+		printf("Could not open %s for recording\n", recordPath);
+		exit(1);
+	}
+
+	// this thread renders and reads input; emulation runs on its own thread so a slow
+	// slRender() never holds it up
+	std::atomic<bool> running(true);
+	gsi.turbo_.store(turbo);
+	gsi.frameSkip_ = frameSkip;
+
+	Scheduler sched;
+	TurboStats turboStats = {};
+	initScheduler(&sched, TIMER_HZ);
+	static Rewind rewind;
+	if (rewindMB != 0 && !initRewind(&rewind, rewindMB << 20))
+		exit(1);
+
+	std::thread cpu(emulate, &gsi, &sched, recordPath != NULL ? &recorder : NULL, rewindMB != 0 ? &rewind : NULL, &turboStats, &running);
+
+	while (running.load() && !slGetKey(SL_KEY_ESCAPE))
 	{
 		getInput(&gsi);
-		executeCode(&chip, &gsi);
 		drawScreen(&gsi);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	running.store(false);
+	cpu.join();
+	releaseScheduler(&sched);
+	printFrameStats(&gsi);
+	printSchedulerStats(&sched);
+	if (rewindMB != 0)
+	{
+		printRewindStats(&rewind);
+		releaseRewind(&rewind);
+	}
+	if (turboStats.seconds_ > 0.0)
+		printf("Turbo: %" PRIu64 " instructions in %.3f s (%.0f instructions/second)\n",
+			turboStats.cycles_, turboStats.seconds_, turboStats.cycles_ / turboStats.seconds_);
+	printf("Idle cycles skipped: %" PRIu64 " of %" PRIu64 "\n", chip.idleCycles_, chip.cycles_);
+	if (recordPath != NULL)
+		stopRecording(&recorder);
+	if (saveStatePath != NULL && writeSaveState(&chip, saveStatePath))
+		printf("State saved to %s\n", saveStatePath);
 
-		std::this_thread::sleep_for(std::chrono::nanoseconds(speed));
+	if (chip.halted_)
+	{
+		cleanUpGraphics(&gsi);
+		exit(1);
 	}
 
 	cleanUpGraphics(&gsi);
 	slClose();
 	return 0;
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,136 @@
+/**	@file opcodes.cpp
+@note Developed for C++17/vc14.1
+@brief Opcode decoding and the two-level decode table
+*/
+
+#include "opcodes.hpp"
+
+DecodeGroup decodeGroups[DECODE_GROUPS];
+
+// Instr bytes: 0NNN by its low 12 bits, 8XYN by N, EXNN and FXNN by NN, one each for the rest
+static uint8_t zeroInstrs[0x1000];
+static uint8_t mathInstrs[0x10];
+static uint8_t keyInstrs[0x100];
+static uint8_t miscInstrs[0x100];
+static uint8_t plainInstrs[DECODE_GROUPS];
+
+static const char * const instrNames[INSTR_COUNT] = {
+#define INSTR_NAME(name, handler) #name,
+	FOR_EACH_INSTR(INSTR_NAME)
+#undef INSTR_NAME
+};
+
+/**
+@name:		decodeInstr
+@purpose:	Works out which instruction an opcode is. This mirrors the masks the interpreter has always used.
+@param:		uint16_t
+@return:	Instr
+*/
+Instr decodeInstr(uint16_t opCode)
+{
+	switch (opCode & 0xF000)
+	{
+		case 0x0000:
+			switch (opCode & 0x0FFF)
+			{
+				case CALL_RCA_ADDR:			return INSTR_CALL_RCA_ADDR;
+				case CLEAR_SCREEN:			return INSTR_CLEAR_SCREEN;
+				case RETURN:				return INSTR_RETURN;
+				default:					return INSTR_TRAP;
+			}
+		case GOTO_ADDR:					return INSTR_GOTO_ADDR;
+		case CALL_SUB:					return INSTR_CALL_SUB;
+		case VX_SKIP_EQUAL_ADDR:		return INSTR_VX_SKIP_EQUAL_ADDR;
+		case VX_SKIP_NEQUAL_ADDR:		return INSTR_VX_SKIP_NEQUAL_ADDR;
+		case VX_NOT_VY:					return INSTR_VX_NOT_VY;
+		case SET_VX_TO_ADDR:			return INSTR_SET_VX_TO_ADDR;
+		case SET_VX_VX_PLUS_ADDR:		return INSTR_SET_VX_VX_PLUS_ADDR;
+		case 0x8000:
+			switch (opCode & 0xF00F)
+			{
+				case SET_VX_TO_VY:			return INSTR_SET_VX_TO_VY;
+				case SET_VX_VX_OR_VY:		return INSTR_SET_VX_VX_OR_VY;
+				case SET_VX_VX_AND_VY:		return INSTR_SET_VX_VX_AND_VY;
+				case SET_VX_VX_XOR_VY:		return INSTR_SET_VX_VX_XOR_VY;
+				case SET_VX_VX_PLUS_VY:		return INSTR_SET_VX_VX_PLUS_VY;
+				case SET_VX_VX_MINUS_VY:	return INSTR_SET_VX_VX_MINUS_VY;
+				case SET_VX_SHIFT_ONE_RIGHT:return INSTR_SET_VX_SHIFT_ONE_RIGHT;
+				case SET_VX_VY_MINUS_VX:	return INSTR_SET_VX_VY_MINUS_VX;
+				case SET_VX_SHIFT_ONE_LEFT:	return INSTR_SET_VX_SHIFT_ONE_LEFT;
+				default:					return INSTR_TRAP;
+			}
+		case CHECK_VX_IS_VY:			return INSTR_CHECK_VX_IS_VY;
+		case SET_INDEX_TO_ADDR_VAL:		return INSTR_SET_INDEX_TO_ADDR_VAL;
+		case JUMP_TO_ADDR_PLUS_V0:		return INSTR_JUMP_TO_ADDR_PLUS_V0;
+		case SET_VX_RAND_AND_NN:		return INSTR_SET_VX_RAND_AND_NN;
+		case DRAW_VX_VY_N:				return INSTR_DRAW_VX_VY_N;
+		case 0xE000:
+			switch (opCode & 0xF0FF)
+			{
+				case SKIP_IF_KEY_PRESSED:	return INSTR_SKIP_IF_KEY_PRESSED;
+				case SKIP_IF_KEY_NT_PRESSED:return INSTR_SKIP_IF_KEY_NT_PRESSED;
+				default:					return INSTR_TRAP;
+			}
+		case 0xF000:
+			switch (opCode & 0xF0FF)
+			{
+				case SET_VX_TO_DELAY_TIMER:	return INSTR_SET_VX_TO_DELAY_TIMER;
+				case WAIT_FOR_KEY_PRESS_VX:	return INSTR_WAIT_FOR_KEY_PRESS_VX;
+				case SET_DELAY_TIMER_TO_VX:	return INSTR_SET_DELAY_TIMER_TO_VX;
+				case SET_SOUND_TIMER_TO_VX:	return INSTR_SET_SOUND_TIMER_TO_VX;
+				case SET_INDEX_PLUS_VX:		return INSTR_SET_INDEX_PLUS_VX;
+				case SET_INDEX_TO_SPRITE:	return INSTR_SET_INDEX_TO_SPRITE;
+				case STORE_BINARY_DEC_VX:	return INSTR_STORE_BINARY_DEC_VX;
+				case STORE_V0_TO_VX_AT_IDX:	return INSTR_STORE_V0_TO_VX_AT_IDX;
+				case FILL_V0_TO_VX_AT_IDX:	return INSTR_FILL_V0_TO_VX_AT_IDX;
+				default:					return INSTR_TRAP;
+			}
+	}
+
+	return INSTR_TRAP;
+}
+
+/**
+@name:		instrName
+@purpose:	Returns the printable name of a decoded instruction, for reports
+@param:		uint8_t
+@return:	const char *
+*/
+const char * instrName(uint8_t instr)
+{
+	return instr < INSTR_COUNT ? instrNames[instr] : "?";
+}
+
+/**
+@name:		setGroup
+@purpose:	Points a group at its table and fills the table from decodeInstr
+@param:		uint16_t, uint8_t *, uint16_t
+@return:	void
+*/
+static void setGroup(uint16_t group, uint8_t * instrs, uint16_t mask)
+{
+	decodeGroups[group].instrs_ = instrs;
+	decodeGroups[group].mask_ = mask;
+	for (uint32_t low = 0; low <= mask; ++low)
+		instrs[low] = decodeInstr(static_cast<uint16_t>(group << 12 | low));
+}
+
+/**
+@name:		buildDecodeTable
+@purpose:	Fills decodeGroups once, before main() runs
+@param:		void
+@return:	bool
+*/
+static bool buildDecodeTable()
+{
+	for (uint16_t group = 0; group < DECODE_GROUPS; ++group)
+		setGroup(group, &plainInstrs[group], 0);
+
+	setGroup(0x0, zeroInstrs, 0x0FFF);
+	setGroup(0x8, mathInstrs, 0x000F);
+	setGroup(0xE, keyInstrs, 0x00FF);
+	setGroup(0xF, miscInstrs, 0x00FF);
+	return true;
+}
+
+static const bool decodeTableBuilt = buildDecodeTable();
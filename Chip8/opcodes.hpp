@@ -0,0 +1,505 @@
+/**	@file opcodes.hpp
+@note Developed for C++17/vc14.1
+@brief Decoded instruction format, two-level decode table, and the semantics of every OpCode.
+	   Every execution engine dispatches into the op functions below, so they all agree.
+*/
+
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include "chip8.hpp"
+
+#define ADDR_MASK 0x0FFF
+#define DECODE_GROUPS 16		// one per top nibble
+
+// X(instr, handler) - one entry per decoded instruction kind, in Instr order
+#define FOR_EACH_INSTR(X) \
+	X(TRAP,						opTrap) \
+	X(CALL_RCA_ADDR,			opCallRcaAddr) \
+	X(CLEAR_SCREEN,				opClearScreen) \
+	X(RETURN,					opReturn) \
+	X(GOTO_ADDR,				opGotoAddr) \
+	X(CALL_SUB,					opCallSub) \
+	X(VX_SKIP_EQUAL_ADDR,		opVxSkipEqualAddr) \
+	X(VX_SKIP_NEQUAL_ADDR,		opVxSkipNequalAddr) \
+	X(VX_NOT_VY,				opVxNotVy) \
+	X(SET_VX_TO_ADDR,			opSetVxToAddr) \
+	X(SET_VX_VX_PLUS_ADDR,		opSetVxVxPlusAddr) \
+	X(SET_VX_TO_VY,				opSetVxToVy) \
+	X(SET_VX_VX_OR_VY,			opSetVxVxOrVy) \
+	X(SET_VX_VX_AND_VY,			opSetVxVxAndVy) \
+	X(SET_VX_VX_XOR_VY,			opSetVxVxXorVy) \
+	X(SET_VX_VX_PLUS_VY,		opSetVxVxPlusVy) \
+	X(SET_VX_VX_MINUS_VY,		opSetVxVxMinusVy) \
+	X(SET_VX_SHIFT_ONE_RIGHT,	opSetVxShiftOneRight) \
+	X(SET_VX_VY_MINUS_VX,		opSetVxVyMinusVx) \
+	X(SET_VX_SHIFT_ONE_LEFT,	opSetVxShiftOneLeft) \
+	X(CHECK_VX_IS_VY,			opCheckVxIsVy) \
+	X(SET_INDEX_TO_ADDR_VAL,	opSetIndexToAddrVal) \
+	X(JUMP_TO_ADDR_PLUS_V0,		opJumpToAddrPlusV0) \
+	X(SET_VX_RAND_AND_NN,		opSetVxRandAndNn) \
+	X(DRAW_VX_VY_N,				opDrawVxVyN) \
+	X(SKIP_IF_KEY_PRESSED,		opSkipIfKeyPressed) \
+	X(SKIP_IF_KEY_NT_PRESSED,	opSkipIfKeyNtPressed) \
+	X(SET_VX_TO_DELAY_TIMER,	opSetVxToDelayTimer) \
+	X(WAIT_FOR_KEY_PRESS_VX,	opWaitForKeyPressVx) \
+	X(SET_DELAY_TIMER_TO_VX,	opSetDelayTimerToVx) \
+	X(SET_SOUND_TIMER_TO_VX,	opSetSoundTimerToVx) \
+	X(SET_INDEX_PLUS_VX,		opSetIndexPlusVx) \
+	X(SET_INDEX_TO_SPRITE,		opSetIndexToSprite) \
+	X(STORE_BINARY_DEC_VX,		opStoreBinaryDecVx) \
+	X(STORE_V0_TO_VX_AT_IDX,	opStoreV0ToVxAtIdx) \
+	X(FILL_V0_TO_VX_AT_IDX,		opFillV0ToVxAtIdx)
+
+// Decoded instruction kinds. INSTR_TRAP catches every opcode the interpreter does not know.
+enum Instr : uint8_t
+{
+#define INSTR_ENUM(name, handler) INSTR_##name,
+	FOR_EACH_INSTR(INSTR_ENUM)
+#undef INSTR_ENUM
+	INSTR_COUNT
+};
+
+// An opcode with its handler and operands already extracted
+typedef struct DecodedOp
+{
+	uint16_t nnn_;
+	uint8_t instr_;
+	uint8_t x_;
+	uint8_t y_;
+	uint8_t nn_;
+} DecodedOp;
+
+/*
+The top nibble picks a group; the bits of the rest that tell its instructions apart (none,
+the low nibble, the low byte or, for 0NNN, all 12) index the group's table of Instr bytes.
+The tables are about 4.6KB in all, built once at start-up, and stay in L1 where a table
+of whole DecodedOps for every opcode would not. Operands are plain bit fields.
+*/
+typedef struct DecodeGroup
+{
+	const uint8_t * instrs_;
+	uint16_t mask_;
+} DecodeGroup;
+
+extern DecodeGroup decodeGroups[DECODE_GROUPS];
+
+Instr decodeInstr(uint16_t opCode);
+const char * instrName(uint8_t instr);
+void unknownOpCode(Chip8 * chip);
+void dumpRegisters(const Chip8 * chip);
+
+/**
+@name:		decodeOp
+@purpose:	Decodes an opcode into its instruction and operands, through decodeGroups
+@param:		uint16_t
+@return:	DecodedOp
+*/
+inline DecodedOp decodeOp(uint16_t opCode)
+{
+	const DecodeGroup * group = &decodeGroups[opCode >> 12];
+	DecodedOp op;
+	op.nnn_ = opCode & 0x0FFF;
+	op.instr_ = group->instrs_[opCode & group->mask_];
+	op.x_ = (opCode & 0x0F00) >> 8;
+	op.y_ = (opCode & 0x00F0) >> 4;
+	op.nn_ = opCode & 0x00FF;
+	return op;
+}
+
+/**
+@name:		fetchOpCode
+@purpose:	Reads the big-endian opcode at the PC
+@param:		const Chip8 *
+@return:	uint16_t
+*/
+inline uint16_t fetchOpCode(const Chip8 * chip)
+{
+	uint16_t addr = chip->progCounter_ & ADDR_MASK;
+	const uint8_t * at = memAt(chip, addr);
+
+	// both bytes are on one page unless the PC is odd and at a page's last byte
+	if (addr % MEM_PAGE_SIZE != MEM_PAGE_SIZE - 1)
+		return (at[0] << 8) | at[1];
+	return (at[0] << 8) | readMem(chip, addr + 1);
+}
+
+/**
+@name:		markDirty
+@purpose:	Records that a memory byte was written, so decoded copies of its page can be dropped
+@param:		Chip8 *, uint16_t
+@return:	void
+*/
+inline void markDirty(Chip8 * chip, uint16_t addr)
+{
+	chip->dirtyPages_ |= 1ULL << ((addr & ADDR_MASK) / CODE_PAGE_SIZE);
+}
+
+inline void opTrap(Chip8 * chip, const DecodedOp * op)
+{
+	// the decoded form does not keep the top nibble, so re-read the opcode for the message
+	chip->opCode_ = fetchOpCode(chip);
+	unknownOpCode(chip);
+}
+
+inline void opCallRcaAddr(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += 2;
+}
+
+inline void opClearScreen(Chip8 * chip, const DecodedOp * op)
+{
+	clearFrame(chip);
+}
+
+inline void opReturn(Chip8 * chip, const DecodedOp * op)
+{
+	chip->stackPointer_ = (chip->stackPointer_ - 1) & (STACKSIZE - 1);
+	chip->progCounter_ = chip->stack_[chip->stackPointer_];
+	chip->progCounter_ += 2;
+}
+
+inline void opGotoAddr(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ = op->nnn_;
+}
+
+inline void opCallSub(Chip8 * chip, const DecodedOp * op)
+{
+	chip->stack_[chip->stackPointer_] = chip->progCounter_;
+	chip->stackPointer_ = (chip->stackPointer_ + 1) & (STACKSIZE - 1);
+	chip->progCounter_ = op->nnn_;
+}
+
+inline void opVxSkipEqualAddr(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += (chip->vReg_[op->x_] == op->nn_) ? 4 : 2;
+}
+
+inline void opVxSkipNequalAddr(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += (chip->vReg_[op->x_] != op->nn_) ? 4 : 2;
+}
+
+inline void opVxNotVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += (chip->vReg_[op->x_] != chip->vReg_[op->y_]) ? 4 : 2;
+}
+
+inline void opSetVxToAddr(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] = op->nn_;
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVxPlusAddr(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] += op->nn_;
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxToVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] = chip->vReg_[op->y_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVxOrVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] |= chip->vReg_[op->y_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVxAndVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] &= chip->vReg_[op->y_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVxXorVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] ^= chip->vReg_[op->y_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVxPlusVy(Chip8 * chip, const DecodedOp * op)
+{
+	uint8_t carry = chip->vReg_[op->y_] > (0xFF - chip->vReg_[op->x_]) ? 1 : 0;
+	chip->vReg_[0xF] = carry;
+	chip->vReg_[op->x_] += chip->vReg_[op->y_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVxMinusVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[0xF] = chip->vReg_[op->y_] > chip->vReg_[op->x_] ? 0 : 1;
+	chip->vReg_[op->x_] -= chip->vReg_[op->y_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxShiftOneRight(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[0xF] = chip->vReg_[op->x_] & 1;		// xVal & 0000 0001
+	chip->vReg_[op->x_] >>= 1;
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxVyMinusVx(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[0xF] = chip->vReg_[op->x_] > chip->vReg_[op->y_] ? 0 : 1;
+	chip->vReg_[op->x_] = chip->vReg_[op->y_] - chip->vReg_[op->x_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetVxShiftOneLeft(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[0xF] = chip->vReg_[op->x_] & 128;	// xVal & 1000 0000
+	chip->vReg_[op->x_] <<= 1;
+	chip->progCounter_ += 2;
+}
+
+inline void opCheckVxIsVy(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += (chip->vReg_[op->x_] == chip->vReg_[op->y_]) ? 2 : 4;
+}
+
+inline void opSetIndexToAddrVal(Chip8 * chip, const DecodedOp * op)
+{
+	chip->regIndex_ = op->nnn_;
+	chip->progCounter_ += 2;
+}
+
+inline void opJumpToAddrPlusV0(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ = op->nnn_ + chip->vReg_[0];
+}
+
+inline void opSetVxRandAndNn(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] = nextRandom(chip) & op->nn_;
+	chip->progCounter_ += 2;
+}
+
+inline void opDrawVxVyN(Chip8 * chip, const DecodedOp * op)
+{
+	// the start position always wraps; clipSprites_ decides what happens past the edges
+	uint8_t xCoord = chip->vReg_[op->x_] % SCREEN_WIDTH;
+	uint8_t yCoord = chip->vReg_[op->y_] % SCREEN_HEIGHT;
+	uint8_t height = op->nn_ & 0x0F;
+	bool clip = chip->clipSprites_;
+	uint64_t collision = 0;
+
+	for (uint8_t y = 0; y < height; ++y)
+	{
+		uint8_t row = yCoord + y;
+		if (row >= SCREEN_HEIGHT)
+		{
+			if (clip)
+				break;
+			row -= SCREEN_HEIGHT;
+		}
+
+		uint64_t bits = spriteRowBits(readMem(chip, chip->regIndex_ + y), xCoord, clip);
+		collision |= chip->gBuffer_[row] & bits;
+		chip->gBuffer_[row] ^= bits;
+		if (bits != 0)
+			chip->dirtyRows_ |= 1u << row;
+	}
+	chip->vReg_[0xF] = collision != 0 ? 1 : 0;
+	chip->drawFlag_ = true;
+	chip->progCounter_ += 2;
+}
+
+inline void opSkipIfKeyPressed(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += ((chip->keyMask_ >> (chip->vReg_[op->x_] & 0xF)) & 1) ? 4 : 2;
+}
+
+inline void opSkipIfKeyNtPressed(Chip8 * chip, const DecodedOp * op)
+{
+	chip->progCounter_ += ((chip->keyMask_ >> (chip->vReg_[op->x_] & 0xF)) & 1) ? 2 : 4;
+}
+
+inline void opSetVxToDelayTimer(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[op->x_] = chip->delayTimer_;
+	chip->progCounter_ += 2;
+}
+
+inline void opWaitForKeyPressVx(Chip8 * chip, const DecodedOp * op)
+{
+	// the PC stays put, so this opcode runs again until a key is down
+	uint16_t mask = chip->keyMask_;
+	if (mask == 0)
+		return;
+
+	// with several keys down, the highest one wins
+	uint8_t key = KEYSIZE - 1;
+	while ((mask >> key) == 0)
+		--key;
+
+	chip->vReg_[op->x_] = key;
+	chip->progCounter_ += 2;
+}
+
+inline void opSetDelayTimerToVx(Chip8 * chip, const DecodedOp * op)
+{
+	chip->delayTimer_ = chip->vReg_[op->x_];
+	chip->isDelay_ = chip->delayTimer_ > 0;
+	chip->progCounter_ += 2;
+}
+
+inline void opSetSoundTimerToVx(Chip8 * chip, const DecodedOp * op)
+{
+	chip->soundTimer_ = chip->vReg_[op->x_];
+	chip->soundPlaying_ = chip->soundTimer_ > 0;
+	chip->progCounter_ += 2;
+}
+
+inline void opSetIndexPlusVx(Chip8 * chip, const DecodedOp * op)
+{
+	chip->vReg_[0xF] = (chip->regIndex_ + chip->vReg_[op->x_] > 0x0FFF) ? 1 : 0;
+	chip->regIndex_ += chip->vReg_[op->x_];
+	chip->progCounter_ += 2;
+}
+
+inline void opSetIndexToSprite(Chip8 * chip, const DecodedOp * op)
+{
+	chip->regIndex_ = chip->vReg_[op->x_] * 5;	// 4x5 font, offset by 5 to find character
+	chip->progCounter_ += 2;
+}
+
+inline void opStoreBinaryDecVx(Chip8 * chip, const DecodedOp * op)
+{
+	uint8_t xVal = chip->vReg_[op->x_];
+
+	writeMem(chip, chip->regIndex_, (xVal / 100) % 10);
+	writeMem(chip, chip->regIndex_ + 1, (xVal / 10) % 10);
+	writeMem(chip, chip->regIndex_ + 2, xVal % 10);
+	markDirty(chip, chip->regIndex_);
+	markDirty(chip, chip->regIndex_ + 2);
+
+	chip->progCounter_ += 2;
+}
+
+inline void opStoreV0ToVxAtIdx(Chip8 * chip, const DecodedOp * op)
+{
+	for (unsigned i = 0; i <= op->x_; ++i)
+		writeMem(chip, chip->regIndex_ + i, chip->vReg_[i]);
+	markDirty(chip, chip->regIndex_);
+	markDirty(chip, chip->regIndex_ + op->x_);
+
+	chip->regIndex_ += chip->vReg_[op->x_] + 1;
+	chip->progCounter_ += 2;
+}
+
+inline void opFillV0ToVxAtIdx(Chip8 * chip, const DecodedOp * op)
+{
+	for (unsigned i = 0; i <= op->x_; ++i)
+		chip->vReg_[i] = readMem(chip, chip->regIndex_ + i);
+
+	chip->regIndex_ += chip->vReg_[op->x_] + 1;
+	chip->progCounter_ += 2;
+}
+
+/**
+@name:		executeOp
+@purpose:	Runs one decoded instruction through a dense jump table over the instruction kinds.
+			The entry is copied so the compiler can keep the operands in registers across byte
+			stores to the chip.
+@param:		Chip8 *, const DecodedOp *
+@return:	void
+*/
+inline void executeOp(Chip8 * chip, const DecodedOp * decoded)
+{
+	DecodedOp op = *decoded;
+	switch (op.instr_)
+	{
+#define INSTR_CASE(name, handler) case INSTR_##name: handler(chip, &op); break;
+		FOR_EACH_INSTR(INSTR_CASE)
+#undef INSTR_CASE
+	}
+}
+
+/**
+@name:		executeSwitch
+@purpose:	Decodes and runs one opcode with nested switches on its bits, with no table. For
+			an interpreter that runs each opcode once, this is the quickest dispatch: the first
+			jump depends only on the opcode, not on table loads.
+@param:		Chip8 *, uint16_t
+@return:	void
+*/
+inline void executeSwitch(Chip8 * chip, uint16_t opCode)
+{
+	DecodedOp op;
+	op.nnn_ = opCode & 0x0FFF;
+	op.x_ = (opCode & 0x0F00) >> 8;
+	op.y_ = (opCode & 0x00F0) >> 4;
+	op.nn_ = static_cast<uint8_t>(opCode & 0x00FF);
+
+	switch (opCode & static_cast<uint16_t>(0xF000))
+	{
+		case 0x000:
+			switch (opCode & static_cast<uint16_t>(0x0FFF))
+			{
+				case CALL_RCA_ADDR:			opCallRcaAddr(chip, &op); break;
+				case CLEAR_SCREEN:			opClearScreen(chip, &op); break;
+				case RETURN:				opReturn(chip, &op); break;
+				default:					opTrap(chip, &op); break;
+			}
+			break;
+		case GOTO_ADDR:					opGotoAddr(chip, &op); break;
+		case CALL_SUB:					opCallSub(chip, &op); break;
+		case VX_SKIP_EQUAL_ADDR:		opVxSkipEqualAddr(chip, &op); break;
+		case VX_SKIP_NEQUAL_ADDR:		opVxSkipNequalAddr(chip, &op); break;
+		case VX_NOT_VY:					opVxNotVy(chip, &op); break;
+		case SET_VX_TO_ADDR:			opSetVxToAddr(chip, &op); break;
+		case SET_VX_VX_PLUS_ADDR:		opSetVxVxPlusAddr(chip, &op); break;
+		case 0x8000:
+			switch (opCode & static_cast<uint16_t>(0xF00F))
+			{
+				case SET_VX_TO_VY:			opSetVxToVy(chip, &op); break;
+				case SET_VX_VX_OR_VY:		opSetVxVxOrVy(chip, &op); break;
+				case SET_VX_VX_AND_VY:		opSetVxVxAndVy(chip, &op); break;
+				case SET_VX_VX_XOR_VY:		opSetVxVxXorVy(chip, &op); break;
+				case SET_VX_VX_PLUS_VY:		opSetVxVxPlusVy(chip, &op); break;
+				case SET_VX_VX_MINUS_VY:	opSetVxVxMinusVy(chip, &op); break;
+				case SET_VX_SHIFT_ONE_RIGHT:opSetVxShiftOneRight(chip, &op); break;
+				case SET_VX_VY_MINUS_VX:	opSetVxVyMinusVx(chip, &op); break;
+				case SET_VX_SHIFT_ONE_LEFT:	opSetVxShiftOneLeft(chip, &op); break;
+				default:					opTrap(chip, &op); break;
+			}
+			break;
+		case CHECK_VX_IS_VY:			opCheckVxIsVy(chip, &op); break;
+		case SET_INDEX_TO_ADDR_VAL:		opSetIndexToAddrVal(chip, &op); break;
+		case JUMP_TO_ADDR_PLUS_V0:		opJumpToAddrPlusV0(chip, &op); break;
+		case SET_VX_RAND_AND_NN:		opSetVxRandAndNn(chip, &op); break;
+		case DRAW_VX_VY_N:				opDrawVxVyN(chip, &op); break;
+		case 0xE000:
+			switch (opCode & static_cast<uint16_t>(0xF0FF))
+			{
+				case SKIP_IF_KEY_PRESSED:	opSkipIfKeyPressed(chip, &op); break;
+				case SKIP_IF_KEY_NT_PRESSED:opSkipIfKeyNtPressed(chip, &op); break;
+				default:					opTrap(chip, &op); break;
+			}
+			break;
+		case 0xF000:
+			switch (opCode & static_cast<uint16_t>(0xF0FF))
+			{
+				case SET_VX_TO_DELAY_TIMER:	opSetVxToDelayTimer(chip, &op); break;
+				case WAIT_FOR_KEY_PRESS_VX:	opWaitForKeyPressVx(chip, &op); break;
+				case SET_DELAY_TIMER_TO_VX:	opSetDelayTimerToVx(chip, &op); break;
+				case SET_SOUND_TIMER_TO_VX:	opSetSoundTimerToVx(chip, &op); break;
+				case SET_INDEX_PLUS_VX:		opSetIndexPlusVx(chip, &op); break;
+				case SET_INDEX_TO_SPRITE:	opSetIndexToSprite(chip, &op); break;
+				case STORE_BINARY_DEC_VX:	opStoreBinaryDecVx(chip, &op); break;
+				case STORE_V0_TO_VX_AT_IDX:	opStoreV0ToVxAtIdx(chip, &op); break;
+				case FILL_V0_TO_VX_AT_IDX:	opFillV0ToVxAtIdx(chip, &op); break;
+				default:					opTrap(chip, &op); break;
+			}
+			break;
+		default:
+			opTrap(chip, &op);
+			break;
+	}
+}
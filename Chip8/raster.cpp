@@ -0,0 +1,393 @@
+/**	@file raster.cpp
+@note Developed for C++17/vc14.1
+@brief CPU rasterizer with SSE2 kernels, and PPM/PNG writers for its output
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "raster.hpp"
+
+#ifdef RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+static const char * const filterNames[FILTER_COUNT] = { "nearest", "scale2x", "scale4x" };
+
+/**
+@name:		rasterFilterFromName
+@purpose:	Looks up a filter by its command-line name. Returns false if there is no such filter.
+@param:		const char *, RasterFilter *
+@return:	bool
+*/
+bool rasterFilterFromName(const char * name, RasterFilter * filter)
+{
+	for (int i = 0; i < FILTER_COUNT; ++i)
+	{
+		if (strcmp(name, filterNames[i]) == 0)
+		{
+			*filter = static_cast<RasterFilter>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+@name:		rasterFilterName
+@purpose:	Returns the command-line name of a filter
+@param:		RasterFilter
+@return:	const char *
+*/
+const char * rasterFilterName(RasterFilter filter)
+{
+	return filter < FILTER_COUNT ? filterNames[filter] : "?";
+}
+
+/**
+@name:		initRaster
+@purpose:	Sets the filter and the default white-on-black colours
+@param:		Raster *, RasterFilter
+@return:	void
+*/
+void initRaster(Raster * raster, RasterFilter filter)
+{
+	static const uint8_t white[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+	static const uint8_t black[4] = { 0x00, 0x00, 0x00, 0xFF };
+
+	raster->filter_ = filter;
+	raster->bottomUp_ = false;
+	memcpy(raster->onColor_, white, sizeof(white));
+	memcpy(raster->offColor_, black, sizeof(black));
+	memset(raster->pixels_, 0, sizeof(raster->pixels_));
+}
+
+/**
+@name:		unpackRows
+@purpose:	Turns the packed framebuffer rows into one 0x00/0xFF byte per pixel
+@param:		const uint64_t *, uint8_t *
+@return:	void
+*/
+static void unpackRows(const uint64_t * rows, uint8_t * mask)
+{
+	for (int y = 0; y < SCREEN_HEIGHT; ++y)
+		for (int x = 0; x < SCREEN_WIDTH; ++x)
+			mask[y * SCREEN_WIDTH + x] = ((rows[y] >> (SCREEN_WIDTH - 1 - x)) & 1) ? 0xFF : 0x00;
+}
+
+/**
+@name:		scale2x
+@purpose:	Doubles a 0x00/0xFF mask with the scale2x (EPX) rules, clamping at the edges.
+			Widths must be multiples of 16 and no more than 128.
+@param:		const uint8_t *, int, int, uint8_t *
+@return:	void
+*/
+static void scale2x(const uint8_t * src, int width, int height, uint8_t * dst)
+{
+	uint8_t padded[SCREEN_WIDTH * 2 + 2];
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t * above = src + (y > 0 ? y - 1 : 0) * width;
+		const uint8_t * row = src + y * width;
+		const uint8_t * below = src + (y < height - 1 ? y + 1 : y) * width;
+		uint8_t * top = dst + (2 * y) * (2 * width);
+		uint8_t * bottom = top + 2 * width;
+
+		// padded[x] is the left neighbour of row[x], padded[x + 2] the right one
+		padded[0] = row[0];
+		memcpy(padded + 1, row, width);
+		padded[width + 1] = row[width - 1];
+
+#ifdef RASTER_SSE2
+		for (int x = 0; x < width; x += 16)
+		{
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(padded + x));
+			__m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(padded + x + 1));
+			__m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(padded + x + 2));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x));
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + x));
+
+			__m128i db = _mm_cmpeq_epi8(d, b);
+			__m128i bf = _mm_cmpeq_epi8(b, f);
+			__m128i dh = _mm_cmpeq_epi8(d, h);
+			__m128i fh = _mm_cmpeq_epi8(f, h);
+
+			// cN = condition for corner N to take the neighbour instead of e
+			__m128i c0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+			__m128i c1 = _mm_andnot_si128(_mm_or_si128(db, fh), bf);
+			__m128i c2 = _mm_andnot_si128(_mm_or_si128(db, fh), dh);
+			__m128i c3 = _mm_andnot_si128(_mm_or_si128(dh, bf), fh);
+
+			__m128i e0 = _mm_or_si128(_mm_and_si128(c0, d), _mm_andnot_si128(c0, e));
+			__m128i e1 = _mm_or_si128(_mm_and_si128(c1, f), _mm_andnot_si128(c1, e));
+			__m128i e2 = _mm_or_si128(_mm_and_si128(c2, d), _mm_andnot_si128(c2, e));
+			__m128i e3 = _mm_or_si128(_mm_and_si128(c3, f), _mm_andnot_si128(c3, e));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(top + 2 * x), _mm_unpacklo_epi8(e0, e1));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(top + 2 * x + 16), _mm_unpackhi_epi8(e0, e1));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(bottom + 2 * x), _mm_unpacklo_epi8(e2, e3));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(bottom + 2 * x + 16), _mm_unpackhi_epi8(e2, e3));
+		}
+#else
+		for (int x = 0; x < width; ++x)
+		{
+			uint8_t d = padded[x], e = padded[x + 1], f = padded[x + 2];
+			uint8_t b = above[x], h = below[x];
+
+			top[2 * x] = (d == b && b != f && d != h) ? d : e;
+			top[2 * x + 1] = (b == f && b != d && f != h) ? f : e;
+			bottom[2 * x] = (d == h && d != b && h != f) ? d : e;
+			bottom[2 * x + 1] = (h == f && d != h && b != f) ? f : e;
+		}
+#endif
+	}
+}
+
+/**
+@name:		expandMask
+@purpose:	Writes a 0x00/0xFF mask to the RGBA image, each mask pixel becoming a square block
+			so the result is RASTER_WIDTH x RASTER_HEIGHT
+@param:		Raster *, const uint8_t *, int, int
+@return:	void
+*/
+static void expandMask(Raster * raster, const uint8_t * mask, int width, int height)
+{
+	const int scale = RASTER_WIDTH / width;
+	const size_t rowBytes = RASTER_WIDTH * 4;
+	uint32_t on, off;
+	memcpy(&on, raster->onColor_, 4);
+	memcpy(&off, raster->offColor_, 4);
+
+#ifdef RASTER_SSE2
+	const __m128i onVec = _mm_set1_epi32(static_cast<int>(on));
+	const __m128i offVec = _mm_set1_epi32(static_cast<int>(off));
+#endif
+
+	for (int y = 0; y < height; ++y)
+	{
+		int outRow = raster->bottomUp_ ? (height - 1 - y) * scale : y * scale;
+		uint8_t * out = raster->pixels_ + (size_t)outRow * rowBytes;
+		const uint8_t * in = mask + y * width;
+
+#ifdef RASTER_SSE2
+		// scale is at least 4, so every source pixel fills whole 16-byte stores
+		__m128i * dst = reinterpret_cast<__m128i *>(out);
+		for (int x = 0; x < width; ++x)
+		{
+			__m128i m = _mm_set1_epi8(static_cast<char>(in[x]));
+			__m128i colour = _mm_or_si128(_mm_and_si128(m, onVec), _mm_andnot_si128(m, offVec));
+			for (int i = 0; i < scale / 4; ++i)
+				_mm_storeu_si128(dst++, colour);
+		}
+#else
+		uint32_t * dst = reinterpret_cast<uint32_t *>(out);
+		for (int x = 0; x < width; ++x)
+		{
+			uint32_t colour = in[x] ? on : off;
+			for (int i = 0; i < scale; ++i)
+				*dst++ = colour;
+		}
+#endif
+
+		for (int i = 1; i < scale; ++i)
+			memcpy(out + i * rowBytes, out, rowBytes);
+	}
+}
+
+/**
+@name:		rasterize
+@purpose:	Renders packed framebuffer rows (SCREEN_HEIGHT of them) into raster->pixels_ with the raster's filter
+@param:		Raster *, const uint64_t *
+@return:	void
+*/
+void rasterize(Raster * raster, const uint64_t * rows)
+{
+	unpackRows(rows, raster->mask_);
+
+	switch (raster->filter_)
+	{
+		case FILTER_SCALE2X:
+			scale2x(raster->mask_, SCREEN_WIDTH, SCREEN_HEIGHT, raster->mask2x_);
+			expandMask(raster, raster->mask2x_, SCREEN_WIDTH * 2, SCREEN_HEIGHT * 2);
+			break;
+		case FILTER_SCALE4X:
+			scale2x(raster->mask_, SCREEN_WIDTH, SCREEN_HEIGHT, raster->mask2x_);
+			scale2x(raster->mask2x_, SCREEN_WIDTH * 2, SCREEN_HEIGHT * 2, raster->mask4x_);
+			expandMask(raster, raster->mask4x_, SCREEN_WIDTH * 4, SCREEN_HEIGHT * 4);
+			break;
+		default:
+			expandMask(raster, raster->mask_, SCREEN_WIDTH, SCREEN_HEIGHT);
+			break;
+	}
+}
+
+/**
+@name:		writePPM
+@purpose:	Saves the image as a binary PPM. Returns false if the file could not be written.
+			The raster should be top row first.
+@param:		const Raster *, const char *
+@return:	bool
+*/
+bool writePPM(const Raster * raster, const char * path)
+{
+	FILE * file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+
+	static uint8_t rgb[RASTER_WIDTH * RASTER_HEIGHT * 3];
+	for (size_t i = 0; i < (size_t)RASTER_WIDTH * RASTER_HEIGHT; ++i)
+		memcpy(rgb + i * 3, raster->pixels_ + i * 4, 3);
+
+	fprintf(file, "P6\n%d %d\n255\n", RASTER_WIDTH, RASTER_HEIGHT);
+	bool ok = fwrite(rgb, 1, sizeof(rgb), file) == sizeof(rgb);
+	return fclose(file) == 0 && ok;
+}
+
+/**
+@name:		crc32
+@purpose:	Continues a PNG/zlib CRC-32 over more bytes. Start with 0.
+@param:		uint32_t, const uint8_t *, size_t
+@return:	uint32_t
+*/
+static uint32_t crc32(uint32_t crc, const uint8_t * data, size_t length)
+{
+	static uint32_t table[256];
+	static bool built = false;
+
+	if (!built)
+	{
+		for (uint32_t n = 0; n < 256; ++n)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		built = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; ++i)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/**
+@name:		putBE32
+@purpose:	Stores a big-endian 32-bit value
+@param:		uint8_t *, uint32_t
+@return:	void
+*/
+static void putBE32(uint8_t * out, uint32_t value)
+{
+	out[0] = static_cast<uint8_t>(value >> 24);
+	out[1] = static_cast<uint8_t>(value >> 16);
+	out[2] = static_cast<uint8_t>(value >> 8);
+	out[3] = static_cast<uint8_t>(value);
+}
+
+/**
+@name:		writeChunk
+@purpose:	Writes one PNG chunk: length, type, data and CRC
+@param:		FILE *, const char *, const uint8_t *, uint32_t
+@return:	bool
+*/
+static bool writeChunk(FILE * file, const char * type, const uint8_t * data, uint32_t length)
+{
+	uint8_t header[8];
+	putBE32(header, length);
+	memcpy(header + 4, type, 4);
+
+	uint8_t footer[4];
+	putBE32(footer, crc32(crc32(0, header + 4, 4), data, length));
+
+	return fwrite(header, 1, 8, file) == 8 && fwrite(data, 1, length, file) == length && fwrite(footer, 1, 4, file) == 4;
+}
+
+/**
+@name:		writePNG
+@purpose:	Saves the image as an RGBA PNG. The pixel data is stored uncompressed in the zlib
+			stream, so no compression library is needed. Returns false if the file could not be written.
+			The raster should be top row first.
+@param:		const Raster *, const char *
+@return:	bool
+*/
+bool writePNG(const Raster * raster, const char * path)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	const size_t rowBytes = RASTER_WIDTH * 4 + 1;		// filter byte + pixels
+	const size_t rawBytes = rowBytes * RASTER_HEIGHT;
+	const size_t maxStored = 65535;
+	const size_t numBlocks = (rawBytes + maxStored - 1) / maxStored;
+	const size_t idatBytes = 2 + numBlocks * 5 + rawBytes + 4;
+
+	uint8_t * idat = static_cast<uint8_t *>(malloc(idatBytes));
+	if (idat == NULL)
+		return false;
+
+	// zlib header, then stored deflate blocks over the filtered rows
+	uint8_t * out = idat;
+	*out++ = 0x78;
+	*out++ = 0x01;
+
+	uint32_t adlerA = 1, adlerB = 0;
+	size_t done = 0;
+	while (done < rawBytes)
+	{
+		size_t length = rawBytes - done < maxStored ? rawBytes - done : maxStored;
+		*out++ = (done + length == rawBytes) ? 1 : 0;
+		*out++ = static_cast<uint8_t>(length);
+		*out++ = static_cast<uint8_t>(length >> 8);
+		*out++ = static_cast<uint8_t>(~length);
+		*out++ = static_cast<uint8_t>(~length >> 8);
+
+		for (size_t i = 0; i < length; ++i, ++done)
+		{
+			size_t column = done % rowBytes;
+			uint8_t byte = (column == 0) ? 0 : raster->pixels_[(done / rowBytes) * (rowBytes - 1) + column - 1];
+			*out++ = byte;
+			adlerA = (adlerA + byte) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+	}
+	putBE32(out, (adlerB << 16) | adlerA);
+
+	uint8_t ihdr[13];
+	putBE32(ihdr, RASTER_WIDTH);
+	putBE32(ihdr + 4, RASTER_HEIGHT);
+	ihdr[8] = 8;		// bits per channel
+	ihdr[9] = 6;		// RGBA
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+	FILE * file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		free(idat);
+		return false;
+	}
+
+	bool ok = fwrite(signature, 1, sizeof(signature), file) == sizeof(signature)
+		&& writeChunk(file, "IHDR", ihdr, sizeof(ihdr))
+		&& writeChunk(file, "IDAT", idat, static_cast<uint32_t>(idatBytes))
+		&& writeChunk(file, "IEND", NULL, 0);
+
+	free(idat);
+	return fclose(file) == 0 && ok;
+}
+
+/**
+@name:		writeScreenshot
+@purpose:	Saves the image as PNG if the path ends in .png, otherwise as PPM
+@param:		const Raster *, const char *
+@return:	bool
+*/
+bool writeScreenshot(const Raster * raster, const char * path)
+{
+	size_t length = strlen(path);
+	if (length >= 4 && strcmp(path + length - 4, ".png") == 0)
+		return writePNG(raster, path);
+
+	return writePPM(raster, path);
+}
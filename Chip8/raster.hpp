@@ -0,0 +1,50 @@
+/**	@file raster.hpp
+@note Developed for C++17/vc14.1
+@brief CPU rasterizer: expands the 64x32 framebuffer into a 1024x512 RGBA image,
+	   for uploading as one texture or saving as a PPM/PNG screenshot
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+
+#define RASTER_WIDTH 1024
+#define RASTER_HEIGHT 512
+#define RASTER_SCALE (RASTER_WIDTH / SCREEN_WIDTH)
+
+// SSE2 kernels are used whenever the target has SSE2; everything else runs the scalar versions
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE2 1
+#endif
+
+enum RasterFilter : uint8_t
+{
+	FILTER_NEAREST,		// each pixel becomes a 16x16 block
+	FILTER_SCALE2X,		// scale2x edge smoothing, then 8x8 blocks
+	FILTER_SCALE4X,		// scale2x twice, then 4x4 blocks
+	FILTER_COUNT
+};
+
+typedef struct Raster
+{
+	RasterFilter filter_;
+	bool bottomUp_;			// store the bottom row first, as OpenGL textures expect
+	uint8_t onColor_[4];	// RGBA of lit pixels
+	uint8_t offColor_[4];
+
+	// one byte per pixel, 0x00 or 0xFF, at each scale2x step
+	uint8_t mask_[SCREEN_WIDTH * SCREEN_HEIGHT];
+	uint8_t mask2x_[SCREEN_WIDTH * 2 * SCREEN_HEIGHT * 2];
+	uint8_t mask4x_[SCREEN_WIDTH * 4 * SCREEN_HEIGHT * 4];
+
+	// RGBA, 4 bytes per pixel
+	uint8_t pixels_[RASTER_WIDTH * RASTER_HEIGHT * 4];
+} Raster;
+
+bool rasterFilterFromName(const char * name, RasterFilter * filter);
+const char * rasterFilterName(RasterFilter filter);
+void initRaster(Raster * raster, RasterFilter filter);
+void rasterize(Raster * raster, const uint64_t * rows);
+bool writePPM(const Raster * raster, const char * path);
+bool writePNG(const Raster * raster, const char * path);
+bool writeScreenshot(const Raster * raster, const char * path);
@@ -0,0 +1,185 @@
+/**	@file recorder.cpp
+@note Developed for C++17/vc14.1
+@brief Video capture: frames are queued by the emulation thread and written to a Y4M or raw
+	   greyscale file by a background writer thread
+*/
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include "recorder.hpp"
+
+#define RECORD_ON_LUMA 0xEB		// video-range white
+#define RECORD_OFF_LUMA 0x10	// video-range black
+#define RECORD_CHROMA 0x80		// no colour
+
+/**
+@name:		convertFrame
+@purpose:	Expands a frame's rows into a scaled luma plane, followed by grey chroma planes when
+			writing Y4M. Returns the number of bytes written to out.
+@param:		const Frame *, bool, uint8_t *
+@return:	size_t
+*/
+static size_t convertFrame(const Frame * frame, bool y4m, uint8_t * out)
+{
+	uint8_t * start = out;
+	if (y4m)
+	{
+		memcpy(out, RECORD_FRAME_HEADER, RECORD_FRAME_HEADER_SIZE);
+		out += RECORD_FRAME_HEADER_SIZE;
+	}
+
+	for (int y = 0; y < SCREEN_HEIGHT; ++y)
+	{
+		uint64_t bits = frame->rows_[y];
+		uint8_t * line = out;
+		for (int x = 0; x < SCREEN_WIDTH; ++x, bits <<= 1)
+			memset(line + x * RECORD_SCALE, (bits >> 63) ? RECORD_ON_LUMA : RECORD_OFF_LUMA, RECORD_SCALE);
+
+		for (int i = 1; i < RECORD_SCALE; ++i)
+			memcpy(line + i * RECORD_WIDTH, line, RECORD_WIDTH);
+		out += RECORD_SCALE * RECORD_WIDTH;
+	}
+
+	if (y4m)
+	{
+		memset(out, RECORD_CHROMA, RECORD_LUMA_SIZE / 2);
+		out += RECORD_LUMA_SIZE / 2;
+	}
+
+	return out - start;
+}
+
+/**
+@name:		writerLoop
+@purpose:	Writer thread: converts queued frames a batch at a time and writes each batch with
+			one call, until stop_ is set and the queue is empty
+@param:		Recorder *
+@return:	void
+*/
+static void writerLoop(Recorder * recorder)
+{
+	for (;;)
+	{
+		uint32_t tail = recorder->tail_.load(std::memory_order_relaxed);
+		uint32_t queued = recorder->head_.load(std::memory_order_acquire) - tail;
+
+		if (queued == 0)
+		{
+			if (recorder->stop_.load(std::memory_order_acquire))
+			{
+				// a frame may have been queued just before stop_ was set
+				if (recorder->head_.load(std::memory_order_acquire) == tail)
+					break;
+				continue;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		uint32_t count = queued < RECORD_BATCH ? queued : RECORD_BATCH;
+		size_t size = 0;
+		for (uint32_t i = 0; i < count; ++i)
+			size += convertFrame(&recorder->pool_[(tail + i) % RECORD_POOL_SIZE], recorder->y4m_, recorder->batch_ + size);
+
+		// the slots are free again as soon as they are converted, before the disk write
+		recorder->tail_.store(tail + count, std::memory_order_release);
+
+		if (!recorder->failed_ && fwrite(recorder->batch_, 1, size, recorder->file_) != size)
+		{
+			fprintf(stderr, "Could not write to %s\n", recorder->path_);
+			recorder->failed_ = true;
+		}
+
+		if (!recorder->failed_)
+			recorder->written_.fetch_add(count, std::memory_order_relaxed);
+		recorder->writes_.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/**
+@name:		startRecording
+@purpose:	Opens path and starts the writer thread. Files ending in .y4m get a 60fps YUV4MPEG2
+			stream; anything else gets raw 8-bit greyscale frames. With lossless, recordFrame
+			waits for the writer instead of dropping frames. Returns false if the file cannot be opened.
+@param:		Recorder *, const char *, bool
+@return:	bool
+*/
+bool startRecording(Recorder * recorder, const char * path, bool lossless)
+{
+	recorder->file_ = fopen(path, "wb");
+	if (recorder->file_ == NULL)
+		return false;
+
+	size_t len = strlen(path);
+	recorder->path_ = path;
+	recorder->y4m_ = len >= 4 && strcmp(path + len - 4, ".y4m") == 0;
+	recorder->lossless_ = lossless;
+	recorder->failed_ = false;
+
+	recorder->stop_.store(false);
+	recorder->head_.store(0);
+	recorder->tail_.store(0);
+	recorder->captured_.store(0);
+	recorder->dropped_.store(0);
+	recorder->written_.store(0);
+	recorder->writes_.store(0);
+
+	if (recorder->y4m_)
+		fprintf(recorder->file_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", RECORD_WIDTH, RECORD_HEIGHT, TIMER_HZ);
+
+	recorder->writer_ = std::thread(writerLoop, recorder);
+	return true;
+}
+
+/**
+@name:		recordFrame
+@purpose:	Queues a copy of the framebuffer rows for the writer. When the queue is full, the frame
+			is dropped and counted, or waited for in lossless mode. Emulation thread only.
+@param:		Recorder *, const uint64_t *, uint64_t
+@return:	void
+*/
+void recordFrame(Recorder * recorder, const uint64_t * rows, uint64_t frameCount)
+{
+	uint32_t head = recorder->head_.load(std::memory_order_relaxed);
+	recorder->captured_.fetch_add(1, std::memory_order_relaxed);
+
+	while (head - recorder->tail_.load(std::memory_order_acquire) >= RECORD_POOL_SIZE)
+	{
+		if (!recorder->lossless_)
+		{
+			recorder->dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		std::this_thread::yield();
+	}
+
+	Frame * frame = &recorder->pool_[head % RECORD_POOL_SIZE];
+	memcpy(frame->rows_, rows, sizeof(frame->rows_));
+	frame->frameCount_ = frameCount;
+	recorder->head_.store(head + 1, std::memory_order_release);
+}
+
+/**
+@name:		stopRecording
+@purpose:	Lets the writer drain the queue, joins it, closes the file and prints the frame
+			counts. Returns false if any write failed.
+@param:		Recorder *
+@return:	bool
+*/
+bool stopRecording(Recorder * recorder)
+{
+	recorder->stop_.store(true, std::memory_order_release);
+	recorder->writer_.join();
+
+	if (fclose(recorder->file_) != 0)
+		recorder->failed_ = true;
+
+	printf("Recording: %s (%s, %dx%d)\n", recorder->path_, recorder->y4m_ ? "y4m" : "raw gray", RECORD_WIDTH, RECORD_HEIGHT);
+	printf("Frames captured: %" PRIu64 ", written: %" PRIu64 ", dropped: %" PRIu64 " (%" PRIu64 " writes)\n",
+		recorder->captured_.load(), recorder->written_.load(), recorder->dropped_.load(), recorder->writes_.load());
+
+	return !recorder->failed_;
+}
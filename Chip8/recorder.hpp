@@ -0,0 +1,59 @@
+/**	@file recorder.hpp
+@note Developed for C++17/vc14.1
+@brief Video capture: frames are queued by the emulation thread and written to a Y4M or raw
+	   greyscale file by a background writer thread
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include "chip8.hpp"
+#include "triplebuffer.hpp"
+
+#define RECORD_SCALE 4				// each pixel becomes a 4x4 block
+#define RECORD_WIDTH (SCREEN_WIDTH * RECORD_SCALE)
+#define RECORD_HEIGHT (SCREEN_HEIGHT * RECORD_SCALE)
+#define RECORD_POOL_SIZE 256		// frames queued between the threads; a power of two
+#define RECORD_BATCH 16				// most frames converted per write call
+
+// Y4M frames are 4:2:0: a full-size luma plane, then two quarter-size chroma planes
+#define RECORD_LUMA_SIZE (RECORD_WIDTH * RECORD_HEIGHT)
+#define RECORD_FRAME_SIZE (RECORD_LUMA_SIZE + RECORD_LUMA_SIZE / 2)
+#define RECORD_FRAME_HEADER "FRAME\n"
+#define RECORD_FRAME_HEADER_SIZE (sizeof(RECORD_FRAME_HEADER) - 1)
+
+/*
+pool_ is a single-producer, single-consumer ring: the emulation thread copies frames into
+pool_[head_], the writer thread converts them from pool_[tail_]. Nothing is allocated once
+recording starts. When the ring is full, a frame is dropped, unless lossless_ is set, in
+which case the emulation thread waits for the writer instead.
+*/
+typedef struct Recorder
+{
+	FILE * file_;
+	const char * path_;
+	bool y4m_;			// otherwise raw 8-bit greyscale, luma only
+	bool lossless_;
+	std::thread writer_;
+	std::atomic<bool> stop_;
+
+	Frame pool_[RECORD_POOL_SIZE];
+	std::atomic<uint32_t> head_;
+	std::atomic<uint32_t> tail_;
+
+	// writer thread only
+	uint8_t batch_[RECORD_BATCH * (RECORD_FRAME_HEADER_SIZE + RECORD_FRAME_SIZE)];
+	bool failed_;
+
+	// stats
+	std::atomic<uint64_t> captured_;
+	std::atomic<uint64_t> dropped_;
+	std::atomic<uint64_t> written_;
+	std::atomic<uint64_t> writes_;
+} Recorder;
+
+bool startRecording(Recorder * recorder, const char * path, bool lossless);
+void recordFrame(Recorder * recorder, const uint64_t * rows, uint64_t frameCount);
+bool stopRecording(Recorder * recorder);
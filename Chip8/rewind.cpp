@@ -0,0 +1,368 @@
+/**	@file rewind.cpp
+@note Developed for C++17/vc14.1
+@brief Rewind history: a bounded ring of per-frame states, stored as run-length coded XOR
+	   deltas against the last keyframe, that a chip can be stepped back through
+*/
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "rewind.hpp"
+
+#define REWIND_STATE_SIZE sizeof(ChipSnapshot)
+#define REWIND_MAX_RECORD (1 + 2 * REWIND_STATE_SIZE + 16)	// every byte a literal, in runs of one
+#define REWIND_MIN_ZEROS 4		// shorter runs of zeros stay inside a literal
+
+/**
+@name:		putVarint
+@purpose:	Writes a count 7 bits a byte, low bits first. Returns the byte after it.
+@param:		uint8_t *, uint32_t
+@return:	uint8_t *
+*/
+static uint8_t * putVarint(uint8_t * out, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
+
+/**
+@name:		getVarint
+@purpose:	Reads a count written by putVarint. Returns the byte after it.
+@param:		const uint8_t *, uint32_t *
+@return:	const uint8_t *
+*/
+static const uint8_t * getVarint(const uint8_t * in, uint32_t * value)
+{
+	uint32_t result = 0;
+	int shift = 0;
+	while (*in & 0x80)
+	{
+		result |= (uint32_t)(*in++ & 0x7F) << shift;
+		shift += 7;
+	}
+	*value = result | (uint32_t)*in++ << shift;
+	return in;
+}
+
+/**
+@name:		encodeState
+@purpose:	Encodes the XOR of a state with a base state, or the state itself with no base,
+			as a record of the given type in encoded_. Returns the record's size.
+@param:		Rewind *, RewindRecord, const ChipSnapshot *
+@return:	uint32_t
+*/
+static uint32_t encodeState(Rewind * rewind, RewindRecord type, const ChipSnapshot * base)
+{
+	const uint8_t * state = reinterpret_cast<const uint8_t *>(rewind->frame_);
+	const uint8_t * with = reinterpret_cast<const uint8_t *>(base);
+	uint8_t * out = rewind->encoded_;
+	*out++ = type;
+
+	// always ends on a run of zeros, empty if a literal reached the end
+	uint32_t pos = 0;
+	while (true)
+	{
+		// between frames most of the state is unchanged, so skip equal words first
+		uint32_t start = pos;
+		if (base != NULL)
+		{
+			while (pos + 8 <= REWIND_STATE_SIZE && memcmp(state + pos, with + pos, 8) == 0)
+				pos += 8;
+			while (pos < REWIND_STATE_SIZE && state[pos] == with[pos])
+				++pos;
+		}
+		else
+		{
+			while (pos < REWIND_STATE_SIZE && state[pos] == 0)
+				++pos;
+		}
+		out = putVarint(out, pos - start);
+		if (pos == REWIND_STATE_SIZE)
+			break;
+
+		// a literal runs until REWIND_MIN_ZEROS zero bytes in a row, or the end
+		uint32_t literal = pos;
+		uint32_t zeros = 0;
+		for (; pos < REWIND_STATE_SIZE && zeros < REWIND_MIN_ZEROS; ++pos)
+			zeros = (state[pos] ^ (base != NULL ? with[pos] : 0)) == 0 ? zeros + 1 : 0;
+		pos -= zeros;
+
+		out = putVarint(out, pos - literal);
+		for (uint32_t i = literal; i < pos; ++i)
+			*out++ = state[i] ^ (base != NULL ? with[i] : 0);
+	}
+
+	return (uint32_t)(out - rewind->encoded_);
+}
+
+/**
+@name:		decodeState
+@purpose:	Decodes a record into a state: a keyframe on its own, a delta on top of base
+@param:		const uint8_t *, const ChipSnapshot *, ChipSnapshot *
+@return:	void
+*/
+static void decodeState(const uint8_t * record, const ChipSnapshot * base, ChipSnapshot * out)
+{
+	uint8_t * state = reinterpret_cast<uint8_t *>(out);
+	if (*record++ == REWIND_KEY)
+		memset(state, 0, REWIND_STATE_SIZE);
+	else if (base != out)
+		memcpy(state, base, REWIND_STATE_SIZE);
+
+	uint32_t pos = 0;
+	while (true)
+	{
+		uint32_t count;
+		record = getVarint(record, &count);
+		pos += count;
+		if (pos >= REWIND_STATE_SIZE)
+			break;
+
+		record = getVarint(record, &count);
+		for (uint32_t i = 0; i < count; ++i)
+			state[pos + i] ^= record[i];
+		record += count;
+		pos += count;
+	}
+}
+
+/**
+@name:		isKey
+@purpose:	True if the frame at an index of the ring is a keyframe
+@param:		const Rewind *, uint32_t
+@return:	bool
+*/
+static bool isKey(const Rewind * rewind, uint32_t index)
+{
+	return rewind->data_[rewind->frames_[index].offset_] == REWIND_KEY;
+}
+
+/**
+@name:		evictOldest
+@purpose:	Drops the oldest frame, then any deltas it leaves without their keyframe
+@param:		Rewind *
+@return:	void
+*/
+static void evictOldest(Rewind * rewind)
+{
+	do
+	{
+		rewind->used_ -= rewind->frames_[rewind->first_].size_;
+		rewind->first_ = (rewind->first_ + 1) % rewind->maxFrames_;
+		--rewind->count_;
+		++rewind->evicted_;
+	} while (rewind->count_ != 0 && !isKey(rewind, rewind->first_));
+
+	if (rewind->count_ == 0)
+		rewind->write_ = 0;
+}
+
+/**
+@name:		makeRoom
+@purpose:	Evicts the oldest frames until a record of the given size fits at write_, or past
+			the end of data_ at its start, and returns where it goes
+@param:		Rewind *, uint32_t
+@return:	uint32_t
+*/
+static uint32_t makeRoom(Rewind * rewind, uint32_t size)
+{
+	if (rewind->count_ == rewind->maxFrames_)
+		evictOldest(rewind);
+
+	while (rewind->count_ != 0)
+	{
+		uint32_t oldest = rewind->frames_[rewind->first_].offset_;
+		if (rewind->write_ > oldest)
+		{
+			// free space is after write_ and before oldest
+			if (rewind->bytes_ - rewind->write_ >= size)
+				return rewind->write_;
+			if (oldest > size)
+				return 0;
+		}
+		else if (oldest - rewind->write_ > size)
+		{
+			// wrapped: free space is between write_ and oldest, kept from closing up entirely
+			return rewind->write_;
+		}
+
+		evictOldest(rewind);
+	}
+
+	return 0;
+}
+
+/**
+@name:		initRewind
+@purpose:	Allocates a rewind history of about the given size, at least REWIND_MIN_BYTES.
+			Returns false and prints why on failure.
+@param:		Rewind *, uint32_t
+@return:	bool
+*/
+bool initRewind(Rewind * rewind, uint32_t bytes)
+{
+	memset(rewind, 0, sizeof(Rewind));
+	rewind->bytes_ = bytes > REWIND_MIN_BYTES ? bytes : REWIND_MIN_BYTES;
+	rewind->maxFrames_ = rewind->bytes_ / REWIND_BYTES_PER_FRAME;
+
+	rewind->data_ = static_cast<uint8_t *>(malloc(rewind->bytes_));
+	rewind->frames_ = static_cast<RewindFrame *>(malloc(rewind->maxFrames_ * sizeof(RewindFrame)));
+	rewind->encoded_ = static_cast<uint8_t *>(malloc(REWIND_MAX_RECORD));
+	rewind->key_ = new (std::nothrow) ChipSnapshot();
+	rewind->frame_ = new (std::nothrow) ChipSnapshot();
+
+	if (rewind->data_ == NULL || rewind->frames_ == NULL || rewind->encoded_ == NULL || rewind->key_ == NULL || rewind->frame_ == NULL)
+	{
+		fprintf(stderr, "Out of memory for %u bytes of rewind history\n", rewind->bytes_);
+		releaseRewind(rewind);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+@name:		recordRewind
+@purpose:	Adds the chip's state as the newest frame, dropping the oldest ones if the history
+			is full. Call once per emulated frame.
+@param:		Rewind *, const Chip8 *
+@return:	void
+*/
+void recordRewind(Rewind * rewind, const Chip8 * chip)
+{
+	takeSnapshot(chip, rewind->frame_);
+
+	bool key = rewind->count_ == 0 || rewind->sinceKey_ + 1 >= REWIND_KEY_INTERVAL;
+	uint32_t size = key ? encodeState(rewind, REWIND_KEY, NULL) : encodeState(rewind, REWIND_DELTA, rewind->key_);
+	uint32_t offset = makeRoom(rewind, size);
+
+	// making room took the delta's keyframe with it
+	if (!key && rewind->count_ == 0)
+	{
+		key = true;
+		size = encodeState(rewind, REWIND_KEY, NULL);
+		offset = makeRoom(rewind, size);
+	}
+
+	memcpy(rewind->data_ + offset, rewind->encoded_, size);
+	RewindFrame * frame = &rewind->frames_[(rewind->first_ + rewind->count_) % rewind->maxFrames_];
+	frame->offset_ = offset;
+	frame->size_ = size;
+	++rewind->count_;
+	rewind->write_ = offset + size;
+	rewind->used_ += size;
+
+	if (key)
+	{
+		// the snapshots swap roles rather than copying: frame_ is rewritten next time anyway
+		ChipSnapshot * swap = rewind->key_;
+		rewind->key_ = rewind->frame_;
+		rewind->frame_ = swap;
+		rewind->sinceKey_ = 0;
+		++rewind->keyframes_;
+	}
+	else
+		++rewind->sinceKey_;
+
+	++rewind->recorded_;
+	rewind->recordedBytes_ += size;
+}
+
+/**
+@name:		rewindFrames
+@purpose:	Puts the chip back to the state it had the given number of frames before the
+			newest one recorded, or the oldest one held, and forgets the frames after it so
+			recording carries on from there. Returns how many frames it went back.
+@param:		Rewind *, Chip8 *, uint32_t
+@return:	uint32_t
+*/
+uint32_t rewindFrames(Rewind * rewind, Chip8 * chip, uint32_t frames)
+{
+	if (rewind->count_ == 0)
+		return 0;
+	if (frames > rewind->count_ - 1)
+		frames = rewind->count_ - 1;
+
+	// the target's keyframe is the last one at or before it
+	uint32_t target = rewind->count_ - 1 - frames;
+	uint32_t key = target;
+	while (!isKey(rewind, (rewind->first_ + key) % rewind->maxFrames_))
+		--key;
+
+	// target's keyframe becomes the newest, so key_ must hold it; it often already does
+	if (key != rewind->count_ - 1 - rewind->sinceKey_)
+		decodeState(rewind->data_ + rewind->frames_[(rewind->first_ + key) % rewind->maxFrames_].offset_, NULL, rewind->key_);
+
+	const ChipSnapshot * state = rewind->key_;
+	if (target != key)
+	{
+		decodeState(rewind->data_ + rewind->frames_[(rewind->first_ + target) % rewind->maxFrames_].offset_, rewind->key_, rewind->frame_);
+		state = rewind->frame_;
+	}
+	restoreSnapshot(chip, state);
+
+	for (uint32_t i = target + 1; i < rewind->count_; ++i)
+		rewind->used_ -= rewind->frames_[(rewind->first_ + i) % rewind->maxFrames_].size_;
+
+	const RewindFrame * last = &rewind->frames_[(rewind->first_ + target) % rewind->maxFrames_];
+	rewind->write_ = last->offset_ + last->size_;
+	rewind->count_ = target + 1;
+	rewind->sinceKey_ = target - key;
+	rewind->rewound_ += frames;
+	return frames;
+}
+
+/**
+@name:		releaseRewind
+@purpose:	Frees a rewind history
+@param:		Rewind *
+@return:	void
+*/
+void releaseRewind(Rewind * rewind)
+{
+	free(rewind->data_);
+	free(rewind->frames_);
+	free(rewind->encoded_);
+	delete rewind->key_;
+	delete rewind->frame_;
+	rewind->data_ = NULL;
+	rewind->frames_ = NULL;
+	rewind->encoded_ = NULL;
+	rewind->key_ = rewind->frame_ = NULL;
+	rewind->count_ = 0;
+}
+
+/**
+@name:		rewindMemory
+@purpose:	Returns everything a rewind history holds allocated: the ring, the frame index,
+			and its working buffers. It does not grow.
+@param:		const Rewind *
+@return:	size_t
+*/
+size_t rewindMemory(const Rewind * rewind)
+{
+	return rewind->bytes_ + (size_t)rewind->maxFrames_ * sizeof(RewindFrame) + REWIND_MAX_RECORD + 2 * sizeof(ChipSnapshot);
+}
+
+/**
+@name:		printRewindStats
+@purpose:	Prints how much history is held, in how much memory, and how well it compressed
+@param:		const Rewind *
+@return:	void
+*/
+void printRewindStats(const Rewind * rewind)
+{
+	printf("Rewind: %u frames held (%.1f s), %.1f KB used of %.1f KB, %.1f KB allocated in all\n",
+		rewind->count_, rewind->count_ / (double)TIMER_HZ, rewind->used_ / 1024.0, rewind->bytes_ / 1024.0, rewindMemory(rewind) / 1024.0);
+
+	if (rewind->recorded_ != 0)
+		printf("Rewind: %" PRIu64 " frames recorded, %" PRIu64 " keyframes, %.1f bytes/frame against %zu raw; %" PRIu64 " rewound, %" PRIu64 " evicted\n",
+			rewind->recorded_, rewind->keyframes_, (double)rewind->recordedBytes_ / rewind->recorded_, sizeof(ChipSnapshot),
+			rewind->rewound_, rewind->evicted_);
+}
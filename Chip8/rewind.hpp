@@ -0,0 +1,67 @@
+/**	@file rewind.hpp
+@note Developed for C++17/vc14.1
+@brief Rewind history: a bounded ring of per-frame states, stored as run-length coded XOR
+	   deltas against the last keyframe, that a chip can be stepped back through
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+#include "snapshot.hpp"
+
+#define REWIND_DEFAULT_BYTES (4u << 20)
+#define REWIND_MIN_BYTES (64u << 10)		// room for a few keyframes
+#define REWIND_KEY_INTERVAL 120				// frames from one keyframe to the next
+#define REWIND_BYTES_PER_FRAME 32			// sizes the frame index: the least a frame is expected to take
+
+enum RewindRecord : uint8_t
+{
+	REWIND_KEY,			// run-length coded snapshot
+	REWIND_DELTA		// run-length coded XOR of the snapshot and the last keyframe's
+};
+
+// Where one frame's record sits in data_
+typedef struct RewindFrame
+{
+	uint32_t offset_;
+	uint32_t size_;
+} RewindFrame;
+
+/*
+data_ is a ring of records, oldest first. Each starts with its RewindRecord byte, then
+alternates a varint count of zero bytes to skip and a varint count of literal bytes that
+follow. A delta only decodes on top of its keyframe, so when the ring is full the oldest
+keyframe is dropped along with every delta after it. Nothing is allocated once initRewind
+has run.
+*/
+typedef struct Rewind
+{
+	uint8_t * data_;
+	uint32_t bytes_;
+	uint32_t write_;			// where the next record goes
+	uint32_t used_;				// bytes held by records
+
+	RewindFrame * frames_;		// ring of maxFrames_ entries, oldest at first_
+	uint32_t maxFrames_;
+	uint32_t first_;
+	uint32_t count_;
+	uint32_t sinceKey_;			// frames recorded since the newest keyframe
+
+	ChipSnapshot * key_;		// the newest keyframe, decoded
+	ChipSnapshot * frame_;		// the frame being recorded or restored
+	uint8_t * encoded_;			// worst-case room for one record
+
+	// stats
+	uint64_t recorded_;
+	uint64_t recordedBytes_;
+	uint64_t keyframes_;
+	uint64_t rewound_;
+	uint64_t evicted_;
+} Rewind;
+
+bool initRewind(Rewind * rewind, uint32_t bytes);
+void recordRewind(Rewind * rewind, const Chip8 * chip);
+uint32_t rewindFrames(Rewind * rewind, Chip8 * chip, uint32_t frames);
+void releaseRewind(Rewind * rewind);
+size_t rewindMemory(const Rewind * rewind);
+void printRewindStats(const Rewind * rewind);
@@ -0,0 +1,284 @@
+/**	@file savestate.cpp
+@note Developed for C++17/vc14.1
+@brief Save-state files: a chip's state in a fixed, versioned layout that is mapped into
+	   memory and used in place, so loading one is a header check and a few copies
+*/
+
+#include <cstring>
+#include "savestate.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the layout is the file format: these only change along with SAVESTATE_VERSION
+static_assert(offsetof(SaveState, vReg_) == 64, "save-state header moved");
+static_assert(offsetof(SaveState, rngState_) == 124, "save-state registers moved");
+static_assert(offsetof(SaveState, gBuffer_) == 128, "save-state registers moved");
+static_assert(offsetof(SaveState, reservedMem_) == 128 + SCREEN_HEIGHT * 8, "save-state framebuffer moved");
+static_assert(offsetof(SaveState, mem_) == 512 && 512 % MEM_PAGE_SIZE == 0, "save-state framebuffer moved");
+static_assert(sizeof(SaveState) == 512 + MEMSIZE, "save-state size changed");
+
+/**
+@name:		writeSaveState
+@purpose:	Writes a chip's state to a file in the SaveState layout. Returns false and prints
+			why on failure.
+@param:		const Chip8 *, const char *
+@return:	bool
+*/
+bool writeSaveState(const Chip8 * chip, const char * path)
+{
+	static SaveState state;
+	memset(&state, 0, sizeof(state));
+
+	memcpy(state.magic_, SAVESTATE_MAGIC, SAVESTATE_MAGIC_SIZE);
+	state.version_ = SAVESTATE_VERSION;
+	state.size_ = sizeof(SaveState);
+	state.romHash_ = chip->romHash_;
+	state.romSize_ = chip->romSize_;
+	state.clockHz_ = chip->clockHz_;
+	state.cycles_ = chip->cycles_;
+	state.nextFrameCycle_ = chip->nextFrameCycle_;
+	state.frameCount_ = chip->frameCount_;
+	state.idleCycles_ = chip->idleCycles_;
+	state.rngState_ = chip->rngState_;
+
+	memcpy(state.vReg_, chip->vReg_, sizeof(state.vReg_));
+	memcpy(state.stack_, chip->stack_, sizeof(state.stack_));
+	state.regIndex_ = chip->regIndex_;
+	state.progCounter_ = chip->progCounter_;
+	state.stackPointer_ = chip->stackPointer_;
+	state.keyMask_ = chip->keyMask_;
+	state.delayTimer_ = chip->delayTimer_;
+	state.soundTimer_ = chip->soundTimer_;
+	state.flags_ = (chip->halted_ ? SAVESTATE_HALTED : 0) | (chip->isDelay_ ? SAVESTATE_DELAY : 0)
+		| (chip->soundPlaying_ ? SAVESTATE_SOUND : 0) | (chip->clipSprites_ ? SAVESTATE_CLIP : 0);
+
+	memcpy(state.gBuffer_, chip->gBuffer_, sizeof(state.gBuffer_));
+	for (int page = 0; page < MEM_PAGES; ++page)
+		memcpy(state.mem_ + page * MEM_PAGE_SIZE, chip->memPages_[page], MEM_PAGE_SIZE);
+
+	FILE * file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open file %s\n", path);
+		return false;
+	}
+
+	bool ok = fwrite(&state, sizeof(state), 1, file) == 1;
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		fprintf(stderr, "Could not write the save state to %s\n", path);
+	return ok;
+}
+
+/**
+@name:		mapFile
+@purpose:	Maps a whole file read-only. Returns NULL on failure.
+@param:		SaveFile *, const char *
+@return:	const void *
+*/
+static const void * mapFile(SaveFile * file, const char * path)
+{
+#ifdef _WIN32
+	file->file_ = file->mapping_ = NULL;
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(handle, &size) && size.QuadPart != 0)
+		mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	const void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	file->file_ = handle;
+	file->mapping_ = mapping;
+	file->bytes_ = (size_t)size.QuadPart;
+	return view;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat info;
+	void * view = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size != 0)
+		view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	// the mapping keeps the file open
+	close(fd);
+	if (view == MAP_FAILED)
+		return NULL;
+
+	file->bytes_ = (size_t)info.st_size;
+	return view;
+#endif
+}
+
+/**
+@name:		unmapFile
+@purpose:	Undoes mapFile
+@param:		SaveFile *
+@return:	void
+*/
+static void unmapFile(SaveFile * file)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(file->state_);
+	CloseHandle(file->mapping_);
+	CloseHandle(file->file_);
+#else
+	munmap(const_cast<SaveState *>(file->state_), file->bytes_);
+#endif
+	file->state_ = NULL;
+}
+
+/**
+@name:		stateValid
+@purpose:	True if the fields the engines index or divide by hold values a running chip can
+			have, so a damaged file cannot send them out of bounds or into an endless loop
+@param:		const SaveState *
+@return:	bool
+*/
+static bool stateValid(const SaveState * state)
+{
+	if (state->clockHz_ < TIMER_HZ || state->stackPointer_ >= STACKSIZE || state->progCounter_ >= MEMSIZE)
+		return false;
+	if ((state->flags_ & ~(SAVESTATE_HALTED | SAVESTATE_DELAY | SAVESTATE_SOUND | SAVESTATE_CLIP)) != 0)
+		return false;
+
+	// the next tick is where tickFrame would have put it
+	return state->nextFrameCycle_ == ((state->frameCount_ + 1) * state->clockHz_ + TIMER_HZ - 1) / TIMER_HZ;
+}
+
+/**
+@name:		openSaveState
+@purpose:	Maps a save-state file and checks its header (magic, version and size) and the
+			fields stateValid covers. Nothing else is read until a chip is restored from it.
+			Returns false and prints why on failure.
+@param:		SaveFile *, const char *
+@return:	bool
+*/
+bool openSaveState(SaveFile * file, const char * path)
+{
+	file->state_ = static_cast<const SaveState *>(mapFile(file, path));
+	if (file->state_ == NULL)
+	{
+		fprintf(stderr, "Could not map file %s\n", path);
+		return false;
+	}
+
+	const SaveState * state = file->state_;
+	if (file->bytes_ < sizeof(SaveState) || memcmp(state->magic_, SAVESTATE_MAGIC, SAVESTATE_MAGIC_SIZE) != 0)
+	{
+		fprintf(stderr, "%s is not a save state.\n", path);
+		closeSaveState(file);
+		return false;
+	}
+	if (state->version_ != SAVESTATE_VERSION || state->size_ != sizeof(SaveState) || file->bytes_ != sizeof(SaveState))
+	{
+		fprintf(stderr, "%s is a version %u save state; this build reads version %u.\n", path, state->version_, SAVESTATE_VERSION);
+		closeSaveState(file);
+		return false;
+	}
+	if (!stateValid(state))
+	{
+		fprintf(stderr, "%s is a damaged save state.\n", path);
+		closeSaveState(file);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+@name:		saveStateMatches
+@purpose:	True if a save state was saved from the ROM with the given hashRom and size
+@param:		const SaveFile *, uint64_t, uint32_t
+@return:	bool
+*/
+bool saveStateMatches(const SaveFile * file, uint64_t romHash, uint32_t romSize)
+{
+	return file->state_->romHash_ == romHash && file->state_->romSize_ == romSize;
+}
+
+/**
+@name:		restoreSaveState
+@purpose:	Puts a chip into the state a save-state file holds. The chip must have been loaded
+			with the same ROM; if not, it is left alone and false returned. Its memory map points
+			into the file's mapping, which must stay open until the chip is released or loaded
+			again. The chip keeps its engine caches and debugger flags.
+@param:		Chip8 *, const SaveFile *
+@return:	bool
+*/
+bool restoreSaveState(Chip8 * chip, const SaveFile * file)
+{
+	const SaveState * state = file->state_;
+	if (!saveStateMatches(file, chip->romHash_, chip->romSize_))
+	{
+		fprintf(stderr, "The save state is for a different ROM.\n");
+		return false;
+	}
+
+	chip->clockHz_ = state->clockHz_;
+	chip->cycles_ = state->cycles_;
+	chip->nextFrameCycle_ = state->nextFrameCycle_;
+	chip->frameCount_ = state->frameCount_;
+	chip->idleCycles_ = state->idleCycles_;
+	chip->rngState_ = state->rngState_;
+
+	memcpy(chip->vReg_, state->vReg_, sizeof(chip->vReg_));
+	memcpy(chip->stack_, state->stack_, sizeof(chip->stack_));
+	chip->regIndex_ = state->regIndex_;
+	chip->progCounter_ = state->progCounter_;
+	chip->stackPointer_ = state->stackPointer_;
+	chip->keyMask_ = state->keyMask_;
+	chip->delayTimer_ = state->delayTimer_;
+	chip->soundTimer_ = state->soundTimer_;
+	chip->halted_ = (state->flags_ & SAVESTATE_HALTED) != 0;
+	chip->isDelay_ = (state->flags_ & SAVESTATE_DELAY) != 0;
+	chip->soundPlaying_ = (state->flags_ & SAVESTATE_SOUND) != 0;
+	chip->clipSprites_ = (state->flags_ & SAVESTATE_CLIP) != 0;
+
+	memcpy(chip->gBuffer_, state->gBuffer_, sizeof(chip->gBuffer_));
+	chip->dirtyRows_ = ALL_ROWS_DIRTY;
+	chip->drawFlag_ = true;
+
+	// the file's memory is shared like a ROM image: writeMem copies a page before changing it
+	releaseMemPages(chip);
+	for (int page = 0; page < MEM_PAGES; ++page)
+		chip->memPages_[page] = const_cast<uint8_t *>(state->mem_ + page * MEM_PAGE_SIZE);
+	chip->dirtyPages_ = ALL_PAGES_DIRTY;
+	return true;
+}
+
+/**
+@name:		closeSaveState
+@purpose:	Unmaps a save-state file. No chip restored from it may run afterwards until it is
+			loaded or restored again.
+@param:		SaveFile *
+@return:	void
+*/
+void closeSaveState(SaveFile * file)
+{
+	if (file->state_ != NULL)
+		unmapFile(file);
+}
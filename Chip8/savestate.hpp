@@ -0,0 +1,78 @@
+/**	@file savestate.hpp
+@note Developed for C++17/vc14.1
+@brief Save-state files: a chip's state in a fixed, versioned layout that is mapped into
+	   memory and used in place, so loading one is a header check and a few copies
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "chip8.hpp"
+
+#define SAVESTATE_MAGIC "CH8STATE"		// 8 bytes, no terminator in the file
+#define SAVESTATE_MAGIC_SIZE 8
+#define SAVESTATE_VERSION 1
+
+// SaveState flags_
+#define SAVESTATE_HALTED 0x01
+#define SAVESTATE_DELAY 0x02
+#define SAVESTATE_SOUND 0x04
+#define SAVESTATE_CLIP 0x08
+
+/*
+The file is this struct byte for byte, in the machine's own (little-endian) byte order, with
+only fixed-size fields, each at its natural alignment, and every padding byte declared as a
+reserved field, so no alignment rule adds any. The static_asserts in savestate.cpp pin it.
+Memory is its last 4KB, whole and page-aligned within the file; restoring points a chip's
+memory map straight at it, shared read-only like a ROM image, so a chip only copies the
+pages it goes on to write. Any change to the layout must bump SAVESTATE_VERSION.
+*/
+typedef struct SaveState
+{
+	// header, checked before anything else is used
+	char magic_[SAVESTATE_MAGIC_SIZE];
+	uint32_t version_;
+	uint32_t size_;				// sizeof(SaveState)
+	uint64_t romHash_;			// hashRom of the ROM the state was saved from
+	uint32_t romSize_;
+	uint32_t clockHz_;
+	uint64_t cycles_;
+	uint64_t nextFrameCycle_;
+	uint64_t frameCount_;
+	uint64_t idleCycles_;
+
+	// registers, from byte 64
+	uint8_t vReg_[VREGSIZE];
+	uint16_t stack_[STACKSIZE];
+	uint16_t regIndex_;
+	uint16_t progCounter_;
+	uint16_t stackPointer_;
+	uint16_t keyMask_;
+	uint8_t delayTimer_;
+	uint8_t soundTimer_;
+	uint8_t flags_;
+	uint8_t reserved_;
+	uint32_t rngState_;
+
+	// framebuffer, from byte 128, then memory from byte 512
+	uint64_t gBuffer_[SCREEN_HEIGHT];
+	uint8_t reservedMem_[128];	// starts memory on a page boundary
+	uint8_t mem_[MEMSIZE];
+} SaveState;
+
+// An open save-state file, mapped read-only
+typedef struct SaveFile
+{
+	const SaveState * state_;
+	size_t bytes_;
+#ifdef _WIN32
+	void * file_;
+	void * mapping_;
+#endif
+} SaveFile;
+
+bool writeSaveState(const Chip8 * chip, const char * path);
+bool openSaveState(SaveFile * file, const char * path);
+bool saveStateMatches(const SaveFile * file, uint64_t romHash, uint32_t romSize);
+bool restoreSaveState(Chip8 * chip, const SaveFile * file);
+void closeSaveState(SaveFile * file);
@@ -0,0 +1,125 @@
+/**	@file scheduler.cpp
+@note Developed for C++17/vc14.1
+@brief Frame pacing: waits out the rest of each 60Hz frame with a sleep followed by a short spin
+*/
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include "scheduler.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+/**
+@name:		initScheduler
+@purpose:	Sets the frame rate, clears the stats and starts the schedule from now. On Windows,
+			also asks for a 1ms system timer period, since the default 15.6ms tick would wake a
+			sleep well past the deadline; releaseScheduler hands it back. If that is refused,
+			the whole last tick before each deadline is spun instead.
+@param:		Scheduler *, uint32_t
+@return:	void
+*/
+void initScheduler(Scheduler * sched, uint32_t framesPerSecond)
+{
+	sched->framePeriod_ = std::chrono::duration_cast<SchedClock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+#ifdef _WIN32
+	sched->fineTimer_ = timeBeginPeriod(1) == TIMERR_NOERROR;
+#else
+	sched->fineTimer_ = false;
+#endif
+	sched->spinMargin_ = std::chrono::microseconds(SCHED_SPIN_MARGIN_US);
+#ifdef _WIN32
+	if (!sched->fineTimer_)
+		sched->spinMargin_ = std::chrono::microseconds(SCHED_COARSE_SPIN_MARGIN_US);
+#endif
+	sched->frames_ = sched->overruns_ = sched->resyncs_ = 0;
+	sched->jitterSumUs_ = sched->jitterSqSumUs_ = sched->jitterMaxUs_ = 0.0;
+	restartSchedule(sched);
+}
+
+/**
+@name:		restartSchedule
+@purpose:	Makes the next frame due one period from now, e.g. after the debugger paused emulation
+@param:		Scheduler *
+@return:	void
+*/
+void restartSchedule(Scheduler * sched)
+{
+	sched->deadline_ = SchedClock::now() + sched->framePeriod_;
+}
+
+/**
+@name:		waitForFrame
+@purpose:	Called when a frame's instructions are done. Sleeps until shortly before the frame's
+			deadline, spins the rest of the way, then moves the deadline on by one period.
+			Deadlines advance by whole periods, so lateness does not accumulate as drift.
+@param:		Scheduler *
+@return:	void
+*/
+void waitForFrame(Scheduler * sched)
+{
+	SchedClock::time_point now = SchedClock::now();
+	++sched->frames_;
+
+	if (now >= sched->deadline_)
+	{
+		// the frame's work took longer than the frame; start the next one right away
+		++sched->overruns_;
+		if (now - sched->deadline_ > sched->framePeriod_ * SCHED_MAX_BEHIND_FRAMES)
+		{
+			++sched->resyncs_;
+			sched->deadline_ = now;
+		}
+		sched->deadline_ += sched->framePeriod_;
+		return;
+	}
+
+	if (sched->deadline_ - now > sched->spinMargin_)
+		std::this_thread::sleep_for(sched->deadline_ - now - sched->spinMargin_);
+
+	while ((now = SchedClock::now()) < sched->deadline_)
+		std::this_thread::yield();
+
+	double lateUs = std::chrono::duration<double, std::micro>(now - sched->deadline_).count();
+	sched->jitterSumUs_ += lateUs;
+	sched->jitterSqSumUs_ += lateUs * lateUs;
+	if (lateUs > sched->jitterMaxUs_)
+		sched->jitterMaxUs_ = lateUs;
+
+	sched->deadline_ += sched->framePeriod_;
+}
+
+/**
+@name:		printSchedulerStats
+@purpose:	Prints how far past their deadlines frames started, and how often there was no time left to wait
+@param:		const Scheduler *
+@return:	void
+*/
+void printSchedulerStats(const Scheduler * sched)
+{
+	uint64_t waited = sched->frames_ - sched->overruns_;
+	double mean = waited > 0 ? sched->jitterSumUs_ / waited : 0.0;
+	double variance = waited > 0 ? sched->jitterSqSumUs_ / waited - mean * mean : 0.0;
+
+	printf("Frames paced: %" PRIu64 ", overruns: %" PRIu64 ", resyncs: %" PRIu64 "\n", sched->frames_, sched->overruns_, sched->resyncs_);
+	printf("Wake-up jitter: %.1f us average, %.1f us std dev, %.1f us max\n", mean, std::sqrt(variance > 0.0 ? variance : 0.0), sched->jitterMaxUs_);
+}
+
+/**
+@name:		releaseScheduler
+@purpose:	Hands back the 1ms system timer period initScheduler asked for, if it got one
+@param:		Scheduler *
+@return:	void
+*/
+void releaseScheduler(Scheduler * sched)
+{
+#ifdef _WIN32
+	if (sched->fineTimer_)
+		timeEndPeriod(1);
+#endif
+	sched->fineTimer_ = false;
+}
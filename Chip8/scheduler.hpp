@@ -0,0 +1,37 @@
+/**	@file scheduler.hpp
+@note Developed for C++17/vc14.1
+@brief Frame pacing: waits out the rest of each 60Hz frame with a sleep followed by a short spin
+*/
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+#define SCHED_SPIN_MARGIN_US 2000		// the last stretch before a deadline is spun, not slept; covers OS timer slack
+#define SCHED_COARSE_SPIN_MARGIN_US 16000	// the same where the timer could not be set to 1ms: one default Windows tick (15.6ms)
+#define SCHED_MAX_BEHIND_FRAMES 4		// further behind than this, the schedule restarts instead of catching up
+#define DEFAULT_FRAME_SKIP 10			// frames emulated per frame presented in turbo mode, where nothing is paced
+
+typedef std::chrono::steady_clock SchedClock;
+
+typedef struct Scheduler
+{
+	SchedClock::duration framePeriod_;
+	SchedClock::time_point deadline_;	// when the next frame may start
+	SchedClock::duration spinMargin_;
+	bool fineTimer_;					// holds a 1ms system timer period until releaseScheduler
+
+	// stats: how late each wake-up was against its deadline
+	uint64_t frames_;
+	uint64_t overruns_;		// frames whose work ran past their deadline, so there was nothing to wait for
+	uint64_t resyncs_;
+	double jitterSumUs_;
+	double jitterSqSumUs_;
+	double jitterMaxUs_;
+} Scheduler;
+
+void initScheduler(Scheduler * sched, uint32_t framesPerSecond);
+void waitForFrame(Scheduler * sched);
+void restartSchedule(Scheduler * sched);
+void printSchedulerStats(const Scheduler * sched);
+void releaseScheduler(Scheduler * sched);
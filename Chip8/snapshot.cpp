@@ -0,0 +1,100 @@
+/**	@file snapshot.cpp
+@note Developed for C++17/vc14.1
+@brief In-memory save states: copies of a chip's whole state that it can be put back to,
+	   cheap enough to take every frame
+*/
+
+#include <cstring>
+#include "snapshot.hpp"
+
+/**
+@name:		pageBits
+@purpose:	Returns the dirtyPages_ bits covering one memory page
+@param:		uint16_t
+@return:	uint64_t
+*/
+static uint64_t pageBits(uint16_t page)
+{
+	const int perPage = MEM_PAGE_SIZE / CODE_PAGE_SIZE;
+	return ((1ULL << perPage) - 1) << (page * perPage);
+}
+
+/**
+@name:		takeSnapshot
+@purpose:	Copies a chip's state into a snapshot: the struct, and the pages it has written
+@param:		const Chip8 *, ChipSnapshot *
+@return:	void
+*/
+void takeSnapshot(const Chip8 * chip, ChipSnapshot * snap)
+{
+	memcpy(&snap->chip_, chip, sizeof(Chip8));
+
+	for (uint16_t page = 0; page < MEM_PAGES; ++page)
+		if (chip->privatePages_ & (1u << page))
+			memcpy(snap->pages_[page], chip->memPages_[page], MEM_PAGE_SIZE);
+}
+
+/**
+@name:		restoreSnapshot
+@purpose:	Puts a chip back to the state in a snapshot, which may have been taken from another
+			instance, onto one that has been through initChip. The chip keeps its engine
+			caches, its own pages, reusing them for whatever the snapshot has in them, and its
+			debugger flags. Only code pages whose contents change are marked dirty, so decoded
+			blocks elsewhere survive, and every framebuffer row is marked for the front-end to
+			redraw.
+@param:		Chip8 *, const ChipSnapshot *
+@return:	void
+*/
+void restoreSnapshot(Chip8 * chip, const ChipSnapshot * snap)
+{
+	struct BlockCache * blockCache = chip->blockCache_;
+	struct JitState * jit = chip->jit_;
+	uint64_t dirty = chip->dirtyPages_;
+	uint16_t own = chip->privatePages_;
+	uint8_t * pages[MEM_PAGES];
+	memcpy(pages, chip->memPages_, sizeof(pages));
+	bool inDebug = chip->inDebug_, dumpRegs = chip->dumpRegs_, printInst = chip->printInst_, goNext = chip->goNext_;
+
+	memcpy(chip, &snap->chip_, sizeof(Chip8));
+	chip->blockCache_ = blockCache;
+	chip->jit_ = jit;
+	chip->inDebug_ = inDebug;
+	chip->dumpRegs_ = dumpRegs;
+	chip->printInst_ = printInst;
+	chip->goNext_ = goNext;
+
+	chip->privatePages_ = own;
+	for (uint16_t page = 0; page < MEM_PAGES; ++page)
+	{
+		bool snapOwn = (snap->chip_.privatePages_ & (1u << page)) != 0;
+		const uint8_t * from = snapOwn ? snap->pages_[page] : snap->chip_.memPages_[page];
+
+		if (own & (1u << page))
+		{
+			// the chip's own page takes the contents, whether the snapshot's page was shared or not
+			chip->memPages_[page] = pages[page];
+			if (memcmp(pages[page], from, MEM_PAGE_SIZE) != 0)
+			{
+				memcpy(pages[page], from, MEM_PAGE_SIZE);
+				dirty |= pageBits(page);
+			}
+		}
+		else if (snapOwn)
+		{
+			// the one case that allocates: the chip has not written this page, the snapshot's had
+			chip->memPages_[page] = const_cast<uint8_t *>(from);
+			privatisePage(chip, page);
+			if (memcmp(pages[page], from, MEM_PAGE_SIZE) != 0)
+				dirty |= pageBits(page);
+		}
+		else if (pages[page] != from)
+		{
+			// shared on both sides, but from another ROM's image
+			dirty |= pageBits(page);
+		}
+	}
+
+	chip->dirtyPages_ = dirty;
+	chip->dirtyRows_ = ALL_ROWS_DIRTY;
+	chip->drawFlag_ = true;
+}
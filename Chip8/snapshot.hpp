@@ -0,0 +1,25 @@
+/**	@file snapshot.hpp
+@note Developed for C++17/vc14.1
+@brief In-memory save states: copies of a chip's whole state that it can be put back to,
+	   cheap enough to take every frame
+*/
+
+#pragma once
+#include <cstdint>
+#include "chip8.hpp"
+
+/*
+A snapshot holds the Chip8 struct as it was, which covers the registers, stack, timers, RNG,
+framebuffer and memory map, plus the bytes of each page the chip had written. Pages still
+shared are left as pointers into their image, which is never freed, so a snapshot of a chip
+that has written one page copies under a kilobyte. Taking and restoring one never allocates
+once the restored chip has its own copy of every page the snapshot holds.
+*/
+typedef struct ChipSnapshot
+{
+	Chip8 chip_;
+	alignas(CACHE_LINE_SIZE) uint8_t pages_[MEM_PAGES][MEM_PAGE_SIZE];	// chip_.privatePages_ says which hold data
+} ChipSnapshot;
+
+void takeSnapshot(const Chip8 * chip, ChipSnapshot * snap);
+void restoreSnapshot(Chip8 * chip, const ChipSnapshot * snap);
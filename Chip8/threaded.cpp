@@ -0,0 +1,60 @@
+/**	@file threaded.cpp
+@note Developed for C++17/vc14.1
+@brief Direct-threaded interpreter: each handler jumps straight to the next one
+	   through GCC/Clang labels-as-values, so there is no central dispatch branch
+*/
+
+#include "engine.hpp"
+#include "opcodes.hpp"
+
+/**
+@name:		runThreaded
+@purpose:	Executes up to the given number of opcodes with computed-goto dispatch, stopping
+			early if the chip halts. Returns the number executed. Compilers without
+			labels-as-values (MSVC), and chips with debugger output on, use runCycles instead.
+@param:		Chip8 *, uint64_t
+@return:	uint64_t
+*/
+uint64_t runThreaded(Chip8 * chip, uint64_t cycles)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	static void * const labels[INSTR_COUNT] = {
+#define INSTR_LABEL(name, handler) &&do_##name,
+		FOR_EACH_INSTR(INSTR_LABEL)
+#undef INSTR_LABEL
+	};
+
+	if (chip->printInst_ || chip->dumpRegs_)
+		return runCycles(chip, cycles);
+
+	uint64_t done = 0;
+	DecodedOp op;
+
+	// the timer check and fetch are repeated at the end of every handler, which gives
+	// each handler its own indirect jump and its own slot in the branch predictor
+#define DISPATCH() \
+	do \
+	{ \
+		if (done == cycles || chip->halted_) \
+			goto finish; \
+		++done; \
+		if (++chip->cycles_ >= chip->nextFrameCycle_) \
+			tickFrame(chip); \
+		chip->opCode_ = fetchOpCode(chip); \
+		op = decodeOp(chip->opCode_); \
+		goto *labels[op.instr_]; \
+	} while (0)
+
+	DISPATCH();
+
+#define INSTR_BODY(name, handler) do_##name: handler(chip, &op); DISPATCH();
+	FOR_EACH_INSTR(INSTR_BODY)
+#undef INSTR_BODY
+#undef DISPATCH
+
+finish:
+	return done;
+#else
+	return runCycles(chip, cycles);
+#endif
+}
@@ -0,0 +1,71 @@
+/**	@file triplebuffer.cpp
+@note Developed for C++17/vc14.1
+@brief Lock-free triple buffer for handing finished frames from the CPU thread to the render thread
+*/
+
+#include <cstring>
+#include "triplebuffer.hpp"
+
+/**
+@name:		initTripleBuffer
+@purpose:	Empties the buffer and resets its counters. Must run before either thread uses it.
+@param:		TripleBuffer *
+@return:	void
+*/
+void initTripleBuffer(TripleBuffer * buffer)
+{
+	memset(buffer->frames_, 0, sizeof(buffer->frames_));
+	buffer->back_ = 0;
+	buffer->middle_.store(1);
+	buffer->front_ = 2;
+
+	buffer->published_.store(0);
+	buffer->dropped_.store(0);
+	buffer->presented_.store(0);
+}
+
+/**
+@name:		backFrame
+@purpose:	Returns the frame the writer may fill. Writer thread only.
+@param:		TripleBuffer *
+@return:	Frame *
+*/
+Frame * backFrame(TripleBuffer * buffer)
+{
+	return &buffer->frames_[buffer->back_];
+}
+
+/**
+@name:		publishFrame
+@purpose:	Hands the filled back frame to the reader and takes the middle one back to fill
+			next. Counts a drop if the frame it replaces was never taken. Writer thread only.
+@param:		TripleBuffer *
+@return:	void
+*/
+void publishFrame(TripleBuffer * buffer)
+{
+	uint8_t old = buffer->middle_.exchange(buffer->back_ | FRAME_NEW_BIT, std::memory_order_acq_rel);
+	buffer->back_ = old & FRAME_INDEX_MASK;
+
+	buffer->published_.fetch_add(1, std::memory_order_relaxed);
+	if ((old & FRAME_NEW_BIT) != 0)
+		buffer->dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+@name:		acquireFrame
+@purpose:	Returns the latest published frame, or NULL if nothing new was published since the
+			last call. The frame stays valid until the next call. Reader thread only.
+@param:		TripleBuffer *
+@return:	const Frame *
+*/
+const Frame * acquireFrame(TripleBuffer * buffer)
+{
+	if ((buffer->middle_.load(std::memory_order_relaxed) & FRAME_NEW_BIT) == 0)
+		return NULL;
+
+	uint8_t old = buffer->middle_.exchange(buffer->front_, std::memory_order_acq_rel);
+	buffer->front_ = old & FRAME_INDEX_MASK;
+	buffer->presented_.fetch_add(1, std::memory_order_relaxed);
+	return &buffer->frames_[buffer->front_];
+}
@@ -0,0 +1,43 @@
+/**	@file triplebuffer.hpp
+@note Developed for C++17/vc14.1
+@brief Lock-free triple buffer for handing finished frames from the CPU thread to the render thread
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "chip8.hpp"
+
+#define FRAME_INDEX_MASK 0x3
+#define FRAME_NEW_BIT 0x4		// set in middle_ while the reader has not taken the frame there
+
+// A copy of the framebuffer as it was at the end of an emulated frame
+typedef struct Frame
+{
+	uint64_t rows_[SCREEN_HEIGHT];
+	uint64_t frameCount_;
+	int64_t inputTime_;		// steady_clock ns of the last key change latched before this frame, 0 if none
+} Frame;
+
+/*
+The writer fills frames_[back_] and swaps it with the middle frame; the reader swaps its
+front_ frame with the middle one when a new frame is there. Neither side ever waits: a
+frame the reader did not take before the next publish is dropped.
+*/
+typedef struct TripleBuffer
+{
+	Frame frames_[3];
+	std::atomic<uint8_t> middle_;
+	uint8_t back_;		// writer only
+	uint8_t front_;		// reader only
+
+	// stats
+	std::atomic<uint64_t> published_;
+	std::atomic<uint64_t> dropped_;
+	std::atomic<uint64_t> presented_;
+} TripleBuffer;
+
+void initTripleBuffer(TripleBuffer * buffer);
+Frame * backFrame(TripleBuffer * buffer);
+void publishFrame(TripleBuffer * buffer);
+const Frame * acquireFrame(TripleBuffer * buffer);